@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The pages are shared with every other process mapping the file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (m_pData) UnmapViewOfFile(m_pData);
+#else
+        if (m_pData) munmap(const_cast<uint8_t*>(m_pData), m_Size);
+#endif
+    }
+
+    bool Open(const std::string& p_Path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(p_Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &size) && (size.QuadPart > 0)) mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) return false;
+
+        m_pData = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(mapping); // The view keeps the mapping alive
+        m_Size = m_pData ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+        const int file = open(p_Path.c_str(), O_RDONLY);
+        if (file < 0) return false;
+
+        struct stat status;
+        void* pData = MAP_FAILED;
+        if ((fstat(file, &status) == 0) && (status.st_size > 0)) pData = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+        close(file); // The mapping keeps the file alive
+        if (pData == MAP_FAILED) return false;
+
+        m_pData = static_cast<const uint8_t*>(pData);
+        m_Size = static_cast<size_t>(status.st_size);
+#endif
+        return m_pData != nullptr;
+    }
+
+    const uint8_t* Data() const { return m_pData; }
+    size_t Size() const { return m_Size; }
+
+private:
+    const uint8_t* m_pData = nullptr;
+    size_t m_Size = 0;
+};
@@ -0,0 +1,489 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ResourceFormat.h"
+
+// Build-time mesh preprocessing for -type mesh. A Wavefront OBJ file is parsed in place (from a MappedFile),
+// polygons are triangulated as fans, and every corner is quantized to a MeshVertex; identical vertices are merged,
+// triangles are reordered for the post-transform vertex cache (Forsyth's linear-speed algorithm), and vertices
+// are renumbered in order of first use so vertex fetch walks the buffer forward.
+struct MeshStats
+{
+    uint32_t cornerCount = 0; // Vertices of the unindexed input
+    uint32_t vertexCount = 0; // Written to the mesh, after unused vertices are dropped
+    uint32_t triangleCount = 0;
+    float inputAcmr = 0.0f; // Input triangle order, after merging identical vertices
+    float outputAcmr = 0.0f;
+};
+
+// Input layout the quantized vertex replaces: float position, UV and normal
+constexpr size_t MESH_INPUT_VERTEX_SIZE = 8 * sizeof(float);
+
+// FIFO size of the ACMR (average cache miss ratio, vertex shader runs per triangle) reported at build time.
+// The optimizer itself models a larger LRU cache, which degrades gracefully on smaller hardware caches.
+constexpr uint32_t MESH_ACMR_CACHE_SIZE = 16;
+
+class MeshCompiler
+{
+public:
+    // Returns false and sets p_Error if the file isn't a usable OBJ
+    bool Compile(const uint8_t* p_pData, size_t p_Size, std::vector<uint8_t>& p_Output, MeshStats& p_Stats, std::string& p_Error)
+    {
+        if (!ParseObj(reinterpret_cast<const char*>(p_pData), reinterpret_cast<const char*>(p_pData) + p_Size, p_Error)) return false;
+        if (m_Corners.empty())
+        {
+            p_Error = "no faces";
+            return false;
+        }
+        if (m_Normals.empty()) GenerateNormals();
+
+        std::vector<MeshVertex> vertices;
+        std::vector<uint32_t> indices;
+        Quantize(vertices, indices);
+        if (indices.empty())
+        {
+            p_Error = "every triangle is degenerate";
+            return false;
+        }
+
+        p_Stats.cornerCount = static_cast<uint32_t>(m_Corners.size());
+        p_Stats.triangleCount = static_cast<uint32_t>(indices.size() / 3);
+        p_Stats.inputAcmr = ComputeAcmr(indices, MESH_ACMR_CACHE_SIZE);
+        OptimizeVertexCache(indices, static_cast<uint32_t>(vertices.size()));
+        OptimizeVertexFetch(vertices, indices);
+        p_Stats.outputAcmr = ComputeAcmr(indices, MESH_ACMR_CACHE_SIZE);
+
+        m_Header.magic = MeshHeader::MAGIC;
+        m_Header.vertexCount = static_cast<uint32_t>(vertices.size());
+        m_Header.indexCount = static_cast<uint32_t>(indices.size());
+        m_Header.indexSize = (vertices.size() <= 0x10000) ? 2 : 4;
+        p_Stats.vertexCount = m_Header.vertexCount;
+
+        p_Output.resize(sizeof(MeshHeader) + vertices.size() * sizeof(MeshVertex) + indices.size() * m_Header.indexSize);
+        uint8_t* pOutput = p_Output.data();
+        memcpy(pOutput, &m_Header, sizeof(m_Header));
+        pOutput += sizeof(m_Header);
+        memcpy(pOutput, vertices.data(), vertices.size() * sizeof(MeshVertex));
+        pOutput += vertices.size() * sizeof(MeshVertex);
+        for (uint32_t index : indices)
+        {
+            const uint16_t shortIndex = static_cast<uint16_t>(index);
+            memcpy(pOutput, (m_Header.indexSize == 2) ? static_cast<const void*>(&shortIndex) : &index, m_Header.indexSize);
+            pOutput += m_Header.indexSize;
+        }
+        return true;
+    }
+
+    // Vertex shader invocations per triangle with a FIFO post-transform cache of p_CacheSize entries: 3 without
+    // reuse, 0.5 at best for a regular grid
+    static float ComputeAcmr(const std::vector<uint32_t>& p_Indices, uint32_t p_CacheSize)
+    {
+        if (p_Indices.empty()) return 0.0f;
+
+        uint32_t vertexCount = 0;
+        for (uint32_t index : p_Indices) vertexCount = std::max(vertexCount, index + 1);
+        std::vector<uint64_t> cacheTime(vertexCount, 0); // Miss count when the vertex was last loaded
+        uint64_t missCount = 0;
+        for (uint32_t index : p_Indices)
+        {
+            if ((cacheTime[index] == 0) || (missCount - cacheTime[index] >= p_CacheSize)) cacheTime[index] = ++missCount;
+        }
+        return static_cast<float>(missCount) / static_cast<float>(p_Indices.size() / 3);
+    }
+
+private:
+    struct Corner
+    {
+        uint32_t position;
+        uint32_t uv; // UINT32_MAX if absent
+        uint32_t normal;
+    };
+
+    struct VertexHash
+    {
+        size_t operator()(const MeshVertex& p_Vertex) const { return static_cast<size_t>(HashBytes(&p_Vertex, sizeof(p_Vertex))); }
+    };
+
+    struct VertexEqual
+    {
+        bool operator()(const MeshVertex& p_A, const MeshVertex& p_B) const { return memcmp(&p_A, &p_B, sizeof(MeshVertex)) == 0; }
+    };
+
+    static constexpr uint32_t CACHE_SIZE = 32; // LRU cache modelled by the optimizer
+    static constexpr uint32_t MAX_VALENCE_SCORE = 32; // Triangles per vertex with a precomputed valence score
+
+    std::vector<float> m_Positions; // xyz
+    std::vector<float> m_Uvs; // uv
+    std::vector<float> m_Normals; // xyz
+    std::vector<Corner> m_Corners; // 3 per triangle
+    MeshHeader m_Header = {};
+
+    static bool IsSpace(char p_Char) { return (p_Char == ' ') || (p_Char == '\t'); }
+
+    // The mapping isn't null-terminated, so numbers are parsed by hand instead of with strtof
+    static bool ParseFloat(const char*& p_pText, const char* p_pEnd, float& p_Value)
+    {
+        while ((p_pText < p_pEnd) && IsSpace(*p_pText)) p_pText++;
+        const char* pStart = p_pText;
+        const bool isNegative = (p_pText < p_pEnd) && (*p_pText == '-');
+        if ((p_pText < p_pEnd) && ((*p_pText == '-') || (*p_pText == '+'))) p_pText++;
+
+        double value = 0.0;
+        double scale = 1.0;
+        bool hasDigits = false;
+        for (; (p_pText < p_pEnd) && (*p_pText >= '0') && (*p_pText <= '9'); p_pText++, hasDigits = true) value = value * 10.0 + (*p_pText - '0');
+        if ((p_pText < p_pEnd) && (*p_pText == '.'))
+        {
+            for (p_pText++; (p_pText < p_pEnd) && (*p_pText >= '0') && (*p_pText <= '9'); p_pText++, hasDigits = true)
+            {
+                scale *= 0.1;
+                value += (*p_pText - '0') * scale;
+            }
+        }
+        if (!hasDigits)
+        {
+            p_pText = pStart;
+            return false;
+        }
+        if ((p_pText < p_pEnd) && ((*p_pText == 'e') || (*p_pText == 'E')))
+        {
+            p_pText++;
+            const bool isNegativeExponent = (p_pText < p_pEnd) && (*p_pText == '-');
+            if ((p_pText < p_pEnd) && ((*p_pText == '-') || (*p_pText == '+'))) p_pText++;
+            int exponent = 0;
+            for (; (p_pText < p_pEnd) && (*p_pText >= '0') && (*p_pText <= '9'); p_pText++) exponent = std::min(exponent * 10 + (*p_pText - '0'), 1000);
+            value *= std::pow(10.0, isNegativeExponent ? -exponent : exponent);
+        }
+        p_Value = static_cast<float>(isNegative ? -value : value);
+        return true;
+    }
+
+    // OBJ indices are 1-based, negative ones count back from the last element read so far. Returns false for 0
+    // and out of range indices.
+    static bool ParseIndex(const char*& p_pText, const char* p_pEnd, size_t p_Count, uint32_t& p_Index)
+    {
+        const bool isNegative = (p_pText < p_pEnd) && (*p_pText == '-');
+        if (isNegative) p_pText++;
+        int64_t value = 0;
+        const char* pDigits = p_pText;
+        for (; (p_pText < p_pEnd) && (*p_pText >= '0') && (*p_pText <= '9'); p_pText++) value = std::min<int64_t>(value * 10 + (*p_pText - '0'), INT64_C(1) << 40);
+        if ((p_pText == pDigits) || (value == 0) || (value > static_cast<int64_t>(p_Count))) return false;
+        p_Index = static_cast<uint32_t>(isNegative ? static_cast<int64_t>(p_Count) - value : value - 1);
+        return true;
+    }
+
+    bool ParseObj(const char* p_pText, const char* p_pEnd, std::string& p_Error)
+    {
+        std::vector<Corner> polygon;
+        size_t lineNumber = 0;
+        for (const char* pLine = p_pText; pLine < p_pEnd;)
+        {
+            const char* pLineEnd = static_cast<const char*>(memchr(pLine, '\n', p_pEnd - pLine));
+            if (!pLineEnd) pLineEnd = p_pEnd;
+            lineNumber++;
+
+            const char* pText = pLine;
+            pLine = pLineEnd + 1;
+            while ((pText < pLineEnd) && IsSpace(*pText)) pText++;
+            const char* pKeyword = pText;
+            while ((pText < pLineEnd) && !IsSpace(*pText) && (*pText != '\r')) pText++;
+            const std::string keyword(pKeyword, pText);
+
+            // Groups, materials, smoothing groups, lines and comments don't affect the triangles
+            float values[3] = {};
+            if ((keyword == "v") || (keyword == "vn"))
+            {
+                for (float& value : values)
+                {
+                    if (!ParseFloat(pText, pLineEnd, value)) return ParseError(p_Error, lineNumber, "expected 3 coordinates");
+                }
+                std::vector<float>& target = (keyword == "v") ? m_Positions : m_Normals;
+                target.insert(target.end(), values, values + 3);
+            }
+            else if (keyword == "vt")
+            {
+                if (!ParseFloat(pText, pLineEnd, values[0])) return ParseError(p_Error, lineNumber, "expected a texture coordinate");
+                ParseFloat(pText, pLineEnd, values[1]);
+                // OBJ puts v = 0 at the bottom of the image, Vulkan at the top
+                m_Uvs.push_back(values[0]);
+                m_Uvs.push_back(1.0f - values[1]);
+            }
+            else if (keyword == "f")
+            {
+                polygon.clear();
+                while (true)
+                {
+                    while ((pText < pLineEnd) && IsSpace(*pText)) pText++;
+                    if ((pText == pLineEnd) || (*pText == '\r')) break;
+
+                    // v, v/vt, v//vn or v/vt/vn
+                    Corner corner = { 0, UINT32_MAX, UINT32_MAX };
+                    if (!ParseIndex(pText, pLineEnd, m_Positions.size() / 3, corner.position)) return ParseError(p_Error, lineNumber, "invalid position index");
+                    if ((pText < pLineEnd) && (*pText == '/'))
+                    {
+                        pText++;
+                        if ((pText < pLineEnd) && (*pText != '/') && !ParseIndex(pText, pLineEnd, m_Uvs.size() / 2, corner.uv)) return ParseError(p_Error, lineNumber, "invalid texture coordinate index");
+                        if ((pText < pLineEnd) && (*pText == '/'))
+                        {
+                            pText++;
+                            if (!ParseIndex(pText, pLineEnd, m_Normals.size() / 3, corner.normal)) return ParseError(p_Error, lineNumber, "invalid normal index");
+                        }
+                    }
+                    polygon.push_back(corner);
+                }
+                if (polygon.size() < 3) return ParseError(p_Error, lineNumber, "face with less than 3 vertices");
+
+                for (size_t i = 2; i < polygon.size(); i++)
+                {
+                    m_Corners.push_back(polygon[0]);
+                    m_Corners.push_back(polygon[i - 1]);
+                    m_Corners.push_back(polygon[i]);
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool ParseError(std::string& p_Error, size_t p_LineNumber, const char* p_pMessage)
+    {
+        p_Error = "line " + std::to_string(p_LineNumber) + ": " + p_pMessage;
+        return false;
+    }
+
+    // Smooth normals for files without any: the area-weighted face normals around each position
+    void GenerateNormals()
+    {
+        m_Normals.assign(m_Positions.size(), 0.0f);
+        for (size_t i = 0; i < m_Corners.size(); i += 3)
+        {
+            const float* p0 = &m_Positions[m_Corners[i].position * 3];
+            const float* p1 = &m_Positions[m_Corners[i + 1].position * 3];
+            const float* p2 = &m_Positions[m_Corners[i + 2].position * 3];
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            for (size_t j = i; j < i + 3; j++)
+            {
+                for (int k = 0; k < 3; k++) m_Normals[m_Corners[j].position * 3 + k] += normal[k];
+                m_Corners[j].normal = m_Corners[j].position;
+            }
+        }
+    }
+
+    // Quantizes every corner and merges the ones that end up identical
+    void Quantize(std::vector<MeshVertex>& p_Vertices, std::vector<uint32_t>& p_Indices)
+    {
+        float positionMin[3] = { INFINITY, INFINITY, INFINITY };
+        float positionMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+        float uvMin[2] = { 0.0f, 0.0f };
+        float uvMax[2] = { 0.0f, 0.0f };
+        bool hasUvs = false;
+        for (const Corner& corner : m_Corners)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                positionMin[k] = std::min(positionMin[k], m_Positions[corner.position * 3 + k]);
+                positionMax[k] = std::max(positionMax[k], m_Positions[corner.position * 3 + k]);
+            }
+            if (corner.uv == UINT32_MAX) continue;
+            for (int k = 0; k < 2; k++)
+            {
+                uvMin[k] = hasUvs ? std::min(uvMin[k], m_Uvs[corner.uv * 2 + k]) : m_Uvs[corner.uv * 2 + k];
+                uvMax[k] = hasUvs ? std::max(uvMax[k], m_Uvs[corner.uv * 2 + k]) : m_Uvs[corner.uv * 2 + k];
+            }
+            hasUvs = true;
+        }
+
+        auto quantize = [](float p_Value, float p_Min, float p_Max) {
+            return (p_Max > p_Min) ? static_cast<uint16_t>(std::lround(std::clamp((p_Value - p_Min) / (p_Max - p_Min), 0.0f, 1.0f) * 65535.0f)) : uint16_t(0);
+        };
+        for (int k = 0; k < 3; k++)
+        {
+            m_Header.positionOffset[k] = positionMin[k];
+            m_Header.positionScale[k] = positionMax[k] - positionMin[k];
+        }
+        for (int k = 0; k < 2; k++)
+        {
+            m_Header.uvOffset[k] = uvMin[k];
+            m_Header.uvScale[k] = uvMax[k] - uvMin[k];
+        }
+
+        std::unordered_map<MeshVertex, uint32_t, VertexHash, VertexEqual> vertexIndices;
+        vertexIndices.reserve(m_Corners.size());
+        p_Indices.reserve(m_Corners.size());
+        for (size_t i = 0; i < m_Corners.size(); i++)
+        {
+            const Corner& corner = m_Corners[i];
+            MeshVertex vertex = {};
+            for (int k = 0; k < 3; k++) vertex.position[k] = quantize(m_Positions[corner.position * 3 + k], positionMin[k], positionMax[k]);
+            if (corner.uv != UINT32_MAX)
+            {
+                for (int k = 0; k < 2; k++) vertex.uv[k] = quantize(m_Uvs[corner.uv * 2 + k], uvMin[k], uvMax[k]);
+            }
+            if (corner.normal != UINT32_MAX) EncodeOctahedralNormal(&m_Normals[corner.normal * 3], vertex.normal);
+
+            const auto inserted = vertexIndices.emplace(vertex, static_cast<uint32_t>(p_Vertices.size()));
+            if (inserted.second) p_Vertices.push_back(vertex);
+            p_Indices.push_back(inserted.first->second);
+
+            // Triangles that collapsed to a line or a point draw nothing
+            const size_t triangle = p_Indices.size() - (i % 3) - 1;
+            if ((i % 3 == 2) && ((p_Indices[triangle] == p_Indices[triangle + 1]) || (p_Indices[triangle + 1] == p_Indices[triangle + 2]) || (p_Indices[triangle] == p_Indices[triangle + 2])))
+            {
+                p_Indices.resize(triangle);
+            }
+        }
+    }
+
+    // Greedy triangle ordering (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"). Vertices are scored on
+    // their position in a modelled LRU cache and on how many triangles still use them, and the next triangle is the
+    // best scored one around the cache, or the best of all when the cache has no triangle left.
+    static void OptimizeVertexCache(std::vector<uint32_t>& p_Indices, uint32_t p_VertexCount)
+    {
+        const size_t triangleCount = p_Indices.size() / 3;
+
+        float cacheScores[CACHE_SIZE];
+        for (uint32_t i = 0; i < CACHE_SIZE; i++)
+        {
+            // The triangle just emitted scores a fixed value, so its vertices don't compete with each other
+            cacheScores[i] = (i < 3) ? 0.75f : std::pow(1.0f - float(i - 3) / float(CACHE_SIZE - 3), 1.5f);
+        }
+        float valenceScores[MAX_VALENCE_SCORE + 1];
+        valenceScores[0] = 0.0f;
+        for (uint32_t i = 1; i <= MAX_VALENCE_SCORE; i++) valenceScores[i] = 2.0f / std::sqrt(float(i));
+
+        // Triangles of each vertex, the first remainingValence[v] entries are the ones not emitted yet
+        std::vector<uint32_t> triangleOffsets(p_VertexCount + 1, 0);
+        for (uint32_t index : p_Indices) triangleOffsets[index + 1]++;
+        for (uint32_t i = 0; i < p_VertexCount; i++) triangleOffsets[i + 1] += triangleOffsets[i];
+        std::vector<uint32_t> remainingValence(p_VertexCount, 0);
+        std::vector<uint32_t> vertexTriangles(p_Indices.size());
+        for (size_t i = 0; i < p_Indices.size(); i++)
+        {
+            const uint32_t vertex = p_Indices[i];
+            vertexTriangles[triangleOffsets[vertex] + remainingValence[vertex]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        std::vector<int32_t> cachePositions(p_VertexCount, -1);
+        std::vector<float> vertexScores(p_VertexCount);
+        auto scoreVertex = [&](uint32_t p_Vertex) {
+            const uint32_t valence = remainingValence[p_Vertex];
+            if (valence == 0) return -1.0f; // Nothing left to draw with it
+            const int32_t cachePosition = cachePositions[p_Vertex];
+            return ((cachePosition >= 0) ? cacheScores[cachePosition] : 0.0f) + valenceScores[std::min(valence, MAX_VALENCE_SCORE)];
+        };
+        for (uint32_t i = 0; i < p_VertexCount; i++) vertexScores[i] = scoreVertex(i);
+
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<bool> isEmitted(triangleCount, false);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            triangleScores[i] = vertexScores[p_Indices[i * 3]] + vertexScores[p_Indices[i * 3 + 1]] + vertexScores[p_Indices[i * 3 + 2]];
+        }
+
+        std::vector<uint32_t> output;
+        output.reserve(p_Indices.size());
+        std::vector<uint32_t> cache;
+        std::vector<uint32_t> newCache;
+        cache.reserve(CACHE_SIZE + 3);
+        newCache.reserve(CACHE_SIZE + 3);
+        size_t nextUnemitted = 0; // Every triangle before it is emitted
+        uint32_t bestTriangle = 0;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            if (triangleScores[i] > bestScore)
+            {
+                bestScore = triangleScores[i];
+                bestTriangle = static_cast<uint32_t>(i);
+            }
+        }
+
+        while (output.size() < p_Indices.size())
+        {
+            if (bestScore < 0.0f)
+            {
+                // Nothing around the cache: the best remaining triangle would cost a full scan, the next one in
+                // input order is nearly as good and keeps this linear
+                while (isEmitted[nextUnemitted]) nextUnemitted++;
+                bestTriangle = static_cast<uint32_t>(nextUnemitted);
+            }
+
+            isEmitted[bestTriangle] = true;
+            const uint32_t* pTriangle = &p_Indices[bestTriangle * 3];
+            output.insert(output.end(), pTriangle, pTriangle + 3);
+
+            // Move the triangle's vertices to the front of the cache and remove it from their triangle lists
+            newCache.assign(pTriangle, pTriangle + 3);
+            for (uint32_t vertex : cache)
+            {
+                if ((vertex != pTriangle[0]) && (vertex != pTriangle[1]) && (vertex != pTriangle[2])) newCache.push_back(vertex);
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                const uint32_t vertex = pTriangle[k];
+                uint32_t* pTriangles = &vertexTriangles[triangleOffsets[vertex]];
+                uint32_t* pLast = pTriangles + remainingValence[vertex] - 1;
+                *std::find(pTriangles, pLast, bestTriangle) = *pLast;
+                remainingValence[vertex]--;
+            }
+
+            for (size_t i = CACHE_SIZE; i < newCache.size(); i++)
+            {
+                cachePositions[newCache[i]] = -1;
+                vertexScores[newCache[i]] = scoreVertex(newCache[i]);
+            }
+            newCache.resize(std::min<size_t>(newCache.size(), CACHE_SIZE));
+            cache.swap(newCache);
+
+            // Rescore the cached vertices and the triangles around them, and pick the best of those
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                cachePositions[cache[i]] = static_cast<int32_t>(i);
+                vertexScores[cache[i]] = scoreVertex(cache[i]);
+            }
+            bestScore = -1.0f;
+            for (uint32_t vertex : cache)
+            {
+                for (uint32_t i = 0; i < remainingValence[vertex]; i++)
+                {
+                    const uint32_t triangle = vertexTriangles[triangleOffsets[vertex] + i];
+                    const uint32_t* pVertices = &p_Indices[triangle * 3];
+                    triangleScores[triangle] = vertexScores[pVertices[0]] + vertexScores[pVertices[1]] + vertexScores[pVertices[2]];
+                    if (triangleScores[triangle] > bestScore)
+                    {
+                        bestScore = triangleScores[triangle];
+                        bestTriangle = triangle;
+                    }
+                }
+            }
+        }
+        p_Indices.swap(output);
+    }
+
+    // Renumbers vertices in order of first use, so consecutive triangles fetch nearby vertices. Vertices no index
+    // refers to, such as those of degenerate triangles only, are dropped.
+    static void OptimizeVertexFetch(std::vector<MeshVertex>& p_Vertices, std::vector<uint32_t>& p_Indices)
+    {
+        std::vector<uint32_t> remap(p_Vertices.size(), UINT32_MAX);
+        std::vector<MeshVertex> vertices;
+        vertices.reserve(p_Vertices.size());
+        for (uint32_t& index : p_Indices)
+        {
+            if (remap[index] == UINT32_MAX)
+            {
+                remap[index] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(p_Vertices[index]);
+            }
+            index = remap[index];
+        }
+        p_Vertices.swap(vertices);
+    }
+};
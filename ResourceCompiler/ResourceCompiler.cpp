@@ -1,67 +1,556 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
-int main(int argc, char* argv[])
+#include "MappedFile.h"
+#include "MeshCompiler.h"
+#include "ResourceFormat.h"
+
+// Bump when the generated output changes for the same input, so cached results are not reused
+constexpr uint64_t OUTPUT_VERSION = 1;
+
+struct ResourceEntry
 {
+    std::string name;
     std::string inputPath;
+    std::string type = "binary"; // binary, spirv or mesh
+    std::string compression = "none"; // none or lz4
+};
+
+struct ProcessedResource
+{
+    uint32_t flags = 0;
+    uint64_t hash = 0;
+    std::string dataPath; // File holding the final bytes, for .incbin
+    std::vector<uint8_t> data; // Final bytes, only loaded when emitting C
+    bool isRebuilt = false; // Content or options changed since the previous run
+};
+
+static bool ReadFile(const std::string& p_Path, std::vector<uint8_t>& p_Data)
+{
+    std::ifstream file(p_Path, std::ios::binary | std::ios::in | std::ios::ate);
+    if (!file) return false;
+
+    p_Data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0, std::ios::beg);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(p_Data.data()), p_Data.size()));
+}
+
+static bool WriteFile(const std::string& p_Path, const void* p_pData, size_t p_Size)
+{
+    std::ofstream file(p_Path, std::ios::binary | std::ios::out | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(p_pData), p_Size);
+    file.close();
+    return static_cast<bool>(file);
+}
+
+// Leaves the file untouched if it already has this content, so its timestamp doesn't trigger a recompile
+static bool WriteFileIfDifferent(const std::string& p_Path, const void* p_pData, size_t p_Size)
+{
+    std::vector<uint8_t> existing;
+    if (ReadFile(p_Path, existing) && (existing.size() == p_Size) && (memcmp(existing.data(), p_pData, p_Size) == 0)) return true;
+    return WriteFile(p_Path, p_pData, p_Size);
+}
+
+static bool WriteFileIfDifferent(const std::string& p_Path, const std::string& p_Content)
+{
+    return WriteFileIfDifferent(p_Path, p_Content.data(), p_Content.size());
+}
+
+static std::string FormatHash(uint64_t p_Hash)
+{
+    std::ostringstream text;
+    text << std::hex << std::setw(16) << std::setfill('0') << p_Hash;
+    return text.str();
+}
+
+// Emits the data as a C array. Portable, but slow to compile for large resources.
+static void AppendCSource(std::string& p_Output, const std::vector<uint8_t>& p_Data, const std::string& p_ResourceName, uint32_t p_Flags)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    p_Output.reserve(p_Output.size() + p_Data.size() * 5 + p_Data.size() / 100 + 256);
+    p_Output += "const unsigned char rc_data_" + p_ResourceName + "[] = {";
+    for (size_t i = 0; i < p_Data.size(); i++)
+    {
+        if ((i % 100) == 0) p_Output += '\n';
+        p_Output += "0x";
+        if (p_Data[i] >= 0x10) p_Output += hexDigits[p_Data[i] >> 4];
+        p_Output += hexDigits[p_Data[i] & 0xf];
+        p_Output += ',';
+    }
+    p_Output += "};\n\n";
+    p_Output += "const size_t rc_size_" + p_ResourceName + " = sizeof(rc_data_" + p_ResourceName + ");\n";
+    p_Output += "const uint32_t rc_flags_" + p_ResourceName + " = " + std::to_string(p_Flags) + ";\n\n";
+}
+
+// Emits the data as a uint32_t array, so it can be used in place where 4-byte alignment is required (SPIR-V)
+static void AppendCWordSource(std::string& p_Output, const std::vector<uint8_t>& p_Data, const std::string& p_ResourceName, uint32_t p_Flags)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    p_Output.reserve(p_Output.size() + p_Data.size() / 4 * 12 + p_Data.size() / 40 + 256);
+    p_Output += "const uint32_t rc_data_" + p_ResourceName + "[] = {";
+    for (size_t i = 0; i < p_Data.size() / 4; i++)
+    {
+        uint32_t word;
+        memcpy(&word, p_Data.data() + i * 4, sizeof(word));
+        if ((i % 10) == 0) p_Output += '\n';
+        p_Output += "0x";
+        for (int shift = 28; shift >= 0; shift -= 4) p_Output += hexDigits[(word >> shift) & 0xf];
+        p_Output += ',';
+    }
+    p_Output += "};\n\n";
+    p_Output += "const size_t rc_size_" + p_ResourceName + " = sizeof(rc_data_" + p_ResourceName + ");\n";
+    p_Output += "const uint32_t rc_flags_" + p_ResourceName + " = " + std::to_string(p_Flags) + ";\n\n";
+}
+
+static const char C_SOURCE_HEADER[] =
+    "#include <stddef.h> // size_t\n"
+    "#include <stdint.h> // uint32_t\n\n";
+
+// Assembler sources pull the files in with .incbin, so the data never goes through the C parser. They are run
+// through the C preprocessor (.S) to pick the section syntax, symbol prefix and size_t width of the target.
+static const char ASM_SOURCE_HEADER[] =
+    "#if defined(__APPLE__)\n"
+    "#define RC_SYMBOL(name) _##name\n"
+    "    .const\n"
+    "#elif defined(_WIN32)\n"
+    "#define RC_SYMBOL(name) name\n"
+    "    .section .rdata,\"dr\"\n"
+    "#else\n"
+    "#define RC_SYMBOL(name) name\n"
+    "    .section .rodata\n"
+    "#endif\n";
+
+static const char ASM_SOURCE_FOOTER[] =
+    "\n"
+    "#if defined(__ELF__)\n"
+    "    .section .note.GNU-stack,\"\",%progbits\n"
+    "#endif\n";
+
+static void AppendAsmSource(std::string& p_Output, const std::string& p_DataPath, const std::string& p_ResourceName, uint32_t p_Flags, uint64_t p_Hash)
+{
+    std::string escapedPath;
+    for (char c : p_DataPath)
+    {
+        if ((c == '\\') || (c == '"')) escapedPath += '\\';
+        escapedPath += c;
+    }
+
+    const std::string data = "rc_data_" + p_ResourceName;
+    const std::string size = "rc_size_" + p_ResourceName;
+    const std::string end = "rc_end_" + p_ResourceName;
+    const std::string flags = "rc_flags_" + p_ResourceName;
+
+    // The content hash makes the source change whenever the .incbin'ed data does
+    p_Output +=
+        "\n"
+        "// " + p_ResourceName + ", content hash " + FormatHash(p_Hash) + "\n"
+        "    .globl RC_SYMBOL(" + data + ")\n"
+        "    .balign 16\n"
+        "RC_SYMBOL(" + data + "):\n"
+        "    .incbin \"" + escapedPath + "\"\n"
+        "RC_SYMBOL(" + end + "):\n"
+        "\n"
+        "    .globl RC_SYMBOL(" + size + ")\n"
+        "    .balign 8\n"
+        "RC_SYMBOL(" + size + "):\n"
+        "#if defined(__SIZEOF_POINTER__) && (__SIZEOF_POINTER__ == 4)\n"
+        "    .long RC_SYMBOL(" + end + ") - RC_SYMBOL(" + data + ")\n"
+        "#else\n"
+        "    .quad RC_SYMBOL(" + end + ") - RC_SYMBOL(" + data + ")\n"
+        "#endif\n"
+        "\n"
+        "    .globl RC_SYMBOL(" + flags + ")\n"
+        "    .balign 4\n"
+        "RC_SYMBOL(" + flags + "):\n"
+        "    .long " + std::to_string(p_Flags) + "\n"
+        "\n"
+        "#if defined(__ELF__)\n"
+        "    .type " + data + ", %object\n"
+        "    .size " + data + ", " + end + " - " + data + "\n"
+        "    .type " + size + ", %object\n"
+        "    .size " + size + ", __SIZEOF_POINTER__\n"
+        "    .type " + flags + ", %object\n"
+        "    .size " + flags + ", 4\n"
+        "#endif\n";
+}
+
+// Table of every resource of a batch, so they can be looked up by name at runtime (see ResourceTableEntry)
+static std::string GenerateTableSource(const std::vector<ResourceEntry>& p_Entries, const std::vector<ProcessedResource>& p_Resources, const std::string& p_TableName)
+{
+    std::string output = C_SOURCE_HEADER;
+    output += "struct rc_table_entry { const char* name; const void* data; const size_t* size; uint32_t flags; };\n\n";
+    for (size_t i = 0; i < p_Entries.size(); i++)
+    {
+        const bool isSpirv = (p_Resources[i].flags & RESOURCE_FLAG_SPIRV) != 0;
+        output += std::string("extern const ") + (isSpirv ? "uint32_t" : "unsigned char") + " rc_data_" + p_Entries[i].name + "[];\n";
+        output += "extern const size_t rc_size_" + p_Entries[i].name + ";\n";
+    }
+    output += "\nconst struct rc_table_entry rc_table_" + p_TableName + "[] = {\n";
+    for (size_t i = 0; i < p_Entries.size(); i++)
+    {
+        const std::string& name = p_Entries[i].name;
+        output += "    { \"" + name + "\", rc_data_" + name + ", &rc_size_" + name + ", " + std::to_string(p_Resources[i].flags) + " },\n";
+    }
+    if (p_Entries.empty()) output += "    { 0, 0, 0, 0 },\n";
+    output += "};\n\n";
+    output += "const size_t rc_table_count_" + p_TableName + " = " + std::to_string(p_Entries.size()) + ";\n";
+    return output;
+}
+
+// Packs the resources in one file that the runtime maps (see ResourcePackHeader)
+static std::vector<uint8_t> GeneratePack(const std::vector<ResourceEntry>& p_Entries, const std::vector<ProcessedResource>& p_Resources)
+{
+    ResourcePackHeader header = {};
+    header.magic = ResourcePackHeader::MAGIC;
+    header.entryCount = static_cast<uint32_t>(p_Entries.size());
+    header.bucketCount = 1;
+    while (header.bucketCount < header.entryCount) header.bucketCount *= 2;
+
+    // Entries are grouped by bucket, so a bucket is a range of entries
+    std::vector<ResourcePackEntry> packEntries(p_Entries.size());
+    std::vector<size_t> order(p_Entries.size());
+    std::string names;
+    for (size_t i = 0; i < p_Entries.size(); i++)
+    {
+        const std::string& name = p_Entries[i].name;
+        packEntries[i].nameHash = HashBytes(name.data(), name.size());
+        packEntries[i].size = p_Resources[i].data.size();
+        packEntries[i].flags = p_Resources[i].flags;
+        packEntries[i].nameOffset = static_cast<uint32_t>(names.size());
+        packEntries[i].nameSize = static_cast<uint32_t>(name.size());
+        names += name;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t p_A, size_t p_B) {
+        return GetResourcePackBucket(packEntries[p_A].nameHash, header.bucketCount) < GetResourcePackBucket(packEntries[p_B].nameHash, header.bucketCount);
+    });
+    header.namesSize = static_cast<uint32_t>(names.size());
+
+    std::vector<uint32_t> buckets(header.bucketCount + 1, 0);
+    for (const ResourcePackEntry& entry : packEntries) buckets[GetResourcePackBucket(entry.nameHash, header.bucketCount) + 1]++;
+    for (size_t i = 1; i < buckets.size(); i++) buckets[i] += buckets[i - 1];
+
+    uint64_t offset = sizeof(header) + buckets.size() * sizeof(uint32_t) + packEntries.size() * sizeof(ResourcePackEntry) + names.size();
+    for (size_t i : order)
+    {
+        offset = (offset + RESOURCE_PACK_ALIGNMENT - 1) & ~uint64_t(RESOURCE_PACK_ALIGNMENT - 1);
+        packEntries[i].offset = offset;
+        offset += packEntries[i].size;
+    }
+    header.fileSize = offset;
+
+    std::vector<uint8_t> pack(static_cast<size_t>(header.fileSize), 0);
+    uint8_t* pOutput = pack.data();
+    memcpy(pOutput, &header, sizeof(header));
+    pOutput += sizeof(header);
+    memcpy(pOutput, buckets.data(), buckets.size() * sizeof(uint32_t));
+    pOutput += buckets.size() * sizeof(uint32_t);
+    for (size_t i : order)
+    {
+        memcpy(pOutput, &packEntries[i], sizeof(ResourcePackEntry));
+        pOutput += sizeof(ResourcePackEntry);
+        if (!p_Resources[i].data.empty()) memcpy(pack.data() + packEntries[i].offset, p_Resources[i].data.data(), p_Resources[i].data.size());
+    }
+    memcpy(pOutput, names.data(), names.size());
+    return pack;
+}
+
+// Builds a mesh resource from an OBJ file and writes it to p_MeshPath, where the assembler can .incbin it
+static bool CompileMesh(const ResourceEntry& p_Entry, const MappedFile& p_Input, const std::string& p_MeshPath, std::vector<uint8_t>& p_MeshData)
+{
+    MeshCompiler compiler;
+    MeshStats stats;
+    std::string error;
+    if (!compiler.Compile(p_Input.Data(), p_Input.Size(), p_MeshData, stats, error))
+    {
+        std::cerr << "\"" << p_Entry.inputPath << "\" is not a valid OBJ mesh: " << error << "." << std::endl;
+        return false;
+    }
+    if (!WriteFile(p_MeshPath, p_MeshData.data(), p_MeshData.size()))
+    {
+        std::cerr << "Failed to write output file \"" << p_MeshPath << "\"." << std::endl;
+        return false;
+    }
+
+    // One write, so lines of meshes built on other threads don't interleave
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(3) << "Mesh \"" << p_Entry.name << "\": " << stats.cornerCount << " -> " << stats.vertexCount
+        << " vertices, " << stats.triangleCount << " triangles, ACMR " << stats.inputAcmr << " -> " << stats.outputAcmr << " ("
+        << MESH_ACMR_CACHE_SIZE << "-entry FIFO), " << MESH_INPUT_VERTEX_SIZE << " -> " << sizeof(MeshVertex) << " bytes per vertex, "
+        << (stats.cornerCount * MESH_INPUT_VERTEX_SIZE) << " -> " << p_MeshData.size() << " bytes\n";
+    std::cout << message.str();
+    return true;
+}
+
+// Validates and compresses one resource. The content hash of the input bytes and options is kept in the cache
+// directory; a compressed resource or a mesh whose hash matches the previous run reuses the cached result.
+static bool ProcessResource(const ResourceEntry& p_Entry, const std::string& p_Format, const std::string& p_CacheDir, ProcessedResource& p_Result)
+{
+    // Meshes are parsed straight from the mapping
+    const bool isMesh = (p_Entry.type == "mesh");
+    MappedFile mappedInput;
+    std::vector<uint8_t> inputData;
+    if (isMesh ? !mappedInput.Open(p_Entry.inputPath) : !ReadFile(p_Entry.inputPath, inputData))
+    {
+        std::cerr << "Failed to read input file \"" << p_Entry.inputPath << "\"." << std::endl;
+        return false;
+    }
+
+    const std::string options = p_Entry.type + "/" + p_Entry.compression + "/" + std::to_string(OUTPUT_VERSION);
+    const uint64_t optionsHash = HashBytes(options.data(), options.size());
+    p_Result.hash = isMesh ? HashBytes(mappedInput.Data(), mappedInput.Size(), optionsHash) : HashBytes(inputData.data(), inputData.size(), optionsHash);
+    p_Result.dataPath = p_Entry.inputPath;
+
+    const std::string hashText = FormatHash(p_Result.hash);
+    const std::string hashPath = p_CacheDir + "/" + p_Entry.name + ".hash";
+    std::vector<uint8_t> cachedHash;
+    const bool isUpToDate = ReadFile(hashPath, cachedHash) && (std::string(cachedHash.begin(), cachedHash.end()) == hashText);
+
+    if (p_Entry.type == "spirv")
+    {
+        p_Result.flags |= RESOURCE_FLAG_SPIRV;
+
+        uint32_t magic = 0;
+        if (inputData.size() >= sizeof(magic)) memcpy(&magic, inputData.data(), sizeof(magic));
+        if (magic != SPIRV_MAGIC)
+        {
+            std::cerr << "\"" << p_Entry.inputPath << "\" is not a SPIR-V module (magic number 0x" << std::hex << magic << std::dec << ")." << std::endl;
+            return false;
+        }
+        if (((inputData.size() % 4) != 0) || (inputData.size() / 4 < SPIRV_HEADER_WORDS))
+        {
+            std::cerr << "\"" << p_Entry.inputPath << "\" is not a whole number of SPIR-V words or is shorter than the header (" << inputData.size() << " bytes)." << std::endl;
+            return false;
+        }
+    }
+
+    if (isMesh)
+    {
+        p_Result.flags |= RESOURCE_FLAG_MESH;
+        p_Result.dataPath = p_CacheDir + "/" + p_Entry.name + ".mesh";
+        if ((!isUpToDate || !ReadFile(p_Result.dataPath, inputData)) && !CompileMesh(p_Entry, mappedInput, p_Result.dataPath, inputData)) return false;
+    }
+
+    if (p_Entry.compression == "lz4")
+    {
+        p_Result.flags |= RESOURCE_FLAG_COMPRESSED;
+        p_Result.dataPath = p_CacheDir + "/" + p_Entry.name + ".lz4";
+
+        std::vector<uint8_t> cachedData;
+        if (isUpToDate && ((p_Format == "asm") ? std::filesystem::exists(p_Result.dataPath) : ReadFile(p_Result.dataPath, cachedData)))
+        {
+            p_Result.data = std::move(cachedData);
+            return true;
+        }
+
+        const size_t inputSize = inputData.size();
+        inputData = CompressResource(inputData.data(), inputData.size());
+
+        // One write, so lines of resources compressed on other threads don't interleave
+        std::ostringstream message;
+        message << "Resource \"" << p_Entry.name << "\": " << inputSize << " -> " << inputData.size() << " bytes ("
+            << (inputSize ? (100 * inputData.size() / inputSize) : 100) << "%)\n";
+        std::cout << message.str();
+
+        if (!WriteFile(p_Result.dataPath, inputData.data(), inputData.size()))
+        {
+            std::cerr << "Failed to write output file \"" << p_Result.dataPath << "\"." << std::endl;
+            return false;
+        }
+    }
+
+    // The hash is written last, an interrupted run leaves a stale hash that won't match
+    p_Result.isRebuilt = !isUpToDate;
+    if (!isUpToDate && !WriteFile(hashPath, hashText.data(), hashText.size()))
+    {
+        std::cerr << "Failed to write output file \"" << hashPath << "\"." << std::endl;
+        return false;
+    }
+
+    // The assembler reads the data itself
+    if (p_Format != "asm") p_Result.data = std::move(inputData);
+    return true;
+}
+
+// Manifest lines: name<TAB>input path[<TAB>type[<TAB>compression]]
+static bool ReadManifest(const std::string& p_Path, std::vector<ResourceEntry>& p_Entries)
+{
+    std::ifstream file(p_Path);
+    if (!file) return false;
+
+    for (std::string line; std::getline(file, line);)
+    {
+        if (!line.empty() && (line.back() == '\r')) line.pop_back();
+        if (line.empty()) continue;
+
+        std::vector<std::string> fields;
+        std::stringstream lineStream(line);
+        for (std::string field; std::getline(lineStream, field, '\t');) fields.push_back(field);
+
+        ResourceEntry entry;
+        if (fields.size() > 0) entry.name = fields[0];
+        if (fields.size() > 1) entry.inputPath = fields[1];
+        if (fields.size() > 2) entry.type = fields[2];
+        if (fields.size() > 3) entry.compression = fields[3];
+        p_Entries.push_back(entry);
+    }
+    return true;
+}
+
+static bool IsValid(const ResourceEntry& p_Entry)
+{
+    return !p_Entry.name.empty() && !p_Entry.inputPath.empty() &&
+        ((p_Entry.compression == "none") || (p_Entry.compression == "lz4")) &&
+        ((p_Entry.type == "binary") || (p_Entry.type == "spirv") || (p_Entry.type == "mesh")) &&
+        ((p_Entry.type != "spirv") || (p_Entry.compression == "none"));
+}
+
+int main(int argc, char* argv[])
+{
+    ResourceEntry singleEntry;
+    std::string manifestPath;
     std::string outputPath;
-    std::string resourceName;
+    std::string tablePath;
+    std::string tableName;
+    std::string cacheDir;
+    std::string format = "c";
+    unsigned jobCount = std::max(1u, std::thread::hardware_concurrency());
 
     for (int i = 1; (i < argc) && ((argc % 2) == 1); i += 2)
     {
         const std::string arg(argv[i]);
-        if (arg == "-input") inputPath = argv[i + 1];
+        if (arg == "-input") singleEntry.inputPath = argv[i + 1];
         if (arg == "-output") outputPath = argv[i + 1];
-        if (arg == "-name") resourceName = argv[i + 1];
+        if (arg == "-name") singleEntry.name = argv[i + 1];
+        if (arg == "-format") format = argv[i + 1];
+        if (arg == "-compression") singleEntry.compression = argv[i + 1];
+        if (arg == "-type") singleEntry.type = argv[i + 1];
+        if (arg == "-manifest") manifestPath = argv[i + 1];
+        if (arg == "-table") tablePath = argv[i + 1];
+        if (arg == "-table-name") tableName = argv[i + 1];
+        if (arg == "-cache") cacheDir = argv[i + 1];
+        if (arg == "-jobs") jobCount = static_cast<unsigned>(std::max(1, std::atoi(argv[i + 1])));
     }
 
-    if (inputPath.empty() || outputPath.empty() || resourceName.empty())
+    const bool isBatch = !manifestPath.empty();
+    std::vector<ResourceEntry> entries;
+    if (isBatch)
     {
-        std::cerr << "Invalid arguments." << std::endl;
-        std::cerr << "Usage: " << argv[0] << " -input file.ext -output source.c -name ResourceName" << std::endl;
-        return EXIT_FAILURE;
+        if (!ReadManifest(manifestPath, entries))
+        {
+            std::cerr << "Failed to read manifest \"" << manifestPath << "\"." << std::endl;
+            return EXIT_FAILURE;
+        }
     }
-
-    // Load input file to memory
-    std::ifstream inputFile(inputPath, std::ios::binary | std::ios::in | std::ios::ate);
-    if (!inputFile)
+    else
     {
-        std::cerr << "Failed to open input file \"" << inputPath << "\"." << std::endl;
-        return EXIT_FAILURE;
+        entries.push_back(singleEntry);
     }
 
-    std::vector<uint8_t> inputData(inputFile.tellg());
-    inputFile.seekg(0, std::ios::beg);
-    if (!inputFile.read(reinterpret_cast<char*>(inputData.data()), inputData.size()))
+    const bool areEntriesValid = std::all_of(entries.begin(), entries.end(), IsValid);
+    const bool isPack = (format == "pack");
+    const bool isBatchValid = !isBatch || ((isPack || (!tablePath.empty() && !tableName.empty())) && !cacheDir.empty());
+    std::vector<std::string> names;
+    for (const ResourceEntry& entry : entries) names.push_back(entry.name);
+    std::sort(names.begin(), names.end());
+    const bool areNamesUnique = std::adjacent_find(names.begin(), names.end()) == names.end();
+    if (outputPath.empty() || !areEntriesValid || !areNamesUnique || !isBatchValid || (isPack && !isBatch) || ((format != "c") && (format != "asm") && !isPack))
     {
-        std::cerr << "Failed to read input file \"" << inputPath << "\"." << std::endl;
+        std::cerr << "Invalid arguments." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " -input file.ext -output source.c|source.S -name ResourceName [-format c|asm] [-compression none|lz4]"
+            " [-type binary|spirv|mesh]" << std::endl;
+        std::cerr << "       " << argv[0] << " -manifest resources.txt -output source.c|source.S -table table.c -table-name TableName -cache dir"
+            " [-format c|asm] [-jobs count]" << std::endl;
+        std::cerr << "       " << argv[0] << " -manifest resources.txt -output resources.pak -format pack -cache dir [-jobs count]" << std::endl;
+        std::cerr << "Manifest lines are name<TAB>input path[<TAB>binary|spirv|mesh[<TAB>none|lz4]], with unique names. SPIR-V resources are used in place"
+            " and can't be compressed. Meshes are built from OBJ files." << std::endl;
         return EXIT_FAILURE;
     }
 
-    // Open output file and generate code
-    std::ofstream outputFile(outputPath, std::ios::out);
-    if (!outputFile)
+    // A single resource keeps its hash and compressed data next to the generated source
+    if (!isBatch) cacheDir = outputPath + ".cache";
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+    if (error)
     {
-        std::cerr << "Failed to open output file \"" << outputPath << "\"." << std::endl;
+        std::cerr << "Failed to create cache directory \"" << cacheDir << "\": " << error.message() << std::endl;
         return EXIT_FAILURE;
     }
 
-    outputFile << "#include <stddef.h> // size_t" << std::endl;
-    outputFile << "const unsigned char rc_data_" << resourceName << "[] = {";
-    for (size_t i = 0; i < inputData.size(); i++)
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // Resources are processed on a pool of threads pulling from a shared counter
+    std::vector<ProcessedResource> resources(entries.size());
+    std::atomic<size_t> nextEntry{ 0 };
+    std::atomic<bool> isSuccessful{ true };
+    auto processEntries = [&]() {
+        for (size_t i = nextEntry++; i < entries.size(); i = nextEntry++)
+        {
+            if (!ProcessResource(entries[i], format, cacheDir, resources[i])) isSuccessful = false;
+        }
+    };
+
+    const size_t threadCount = std::max<size_t>(1, std::min<size_t>(jobCount, entries.size()));
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threadCount; i++) workers.emplace_back(processEntries);
+    processEntries();
+    for (std::thread& worker : workers) worker.join();
+    if (!isSuccessful) return EXIT_FAILURE;
+
+    if (isPack)
     {
-        if ((i % 100) == 0) outputFile << std::endl;
-        outputFile << "0x" << std::hex << static_cast<uint32_t>(inputData[i]) << ",";
+        const std::vector<uint8_t> pack = GeneratePack(entries, resources);
+        if (!WriteFileIfDifferent(outputPath, pack.data(), pack.size()))
+        {
+            std::cerr << "Failed to write output file \"" << outputPath << "\"." << std::endl;
+            return EXIT_FAILURE;
+        }
     }
-    outputFile << "};" << std::endl << std::endl;
-    outputFile << "const size_t rc_size_" << resourceName << " = sizeof(rc_data_" << resourceName << ");";
-    outputFile.close();
-    if (!outputFile)
+    else
     {
-        std::cerr << "Failed to write output file \"" << outputPath << "\"." << std::endl;
-        return EXIT_FAILURE;
+        // Generate code
+        std::string output = (format == "asm") ? ASM_SOURCE_HEADER : C_SOURCE_HEADER;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const ProcessedResource& resource = resources[i];
+            if (format == "asm") AppendAsmSource(output, resource.dataPath, entries[i].name, resource.flags, resource.hash);
+            else if (resource.flags & RESOURCE_FLAG_SPIRV) AppendCWordSource(output, resource.data, entries[i].name, resource.flags);
+            else AppendCSource(output, resource.data, entries[i].name, resource.flags);
+        }
+        if (format == "asm") output += ASM_SOURCE_FOOTER;
+
+        if (!WriteFileIfDifferent(outputPath, output))
+        {
+            std::cerr << "Failed to write output file \"" << outputPath << "\"." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (isBatch && !WriteFileIfDifferent(tablePath, GenerateTableSource(entries, resources, tableName)))
+        {
+            std::cerr << "Failed to write output file \"" << tablePath << "\"." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (isBatch)
+    {
+        const size_t rebuiltCount = std::count_if(resources.begin(), resources.end(), [](const ProcessedResource& p_Resource) { return p_Resource.isRebuilt; });
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "ResourceCompiler: " << entries.size() << " resources, " << rebuiltCount << " changed, in " << milliseconds << " ms on "
+            << threadCount << " thread(s)" << std::endl;
     }
 
     return EXIT_SUCCESS;
@@ -0,0 +1,111 @@
+// Compares the build cost of the C array and .incbin output formats of the ResourceCompiler: time to generate
+// the source, time to compile it to an object, and size of the generated source.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static bool WriteInputFile(const std::string& p_Path, size_t p_Size)
+{
+    std::ofstream file(p_Path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file) return false;
+
+    // xorshift noise, so the data doesn't compress or deduplicate anywhere along the way
+    std::vector<uint64_t> block(1 << 17);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (size_t written = 0; written < p_Size;)
+    {
+        for (uint64_t& value : block)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            value = state;
+        }
+        const size_t count = std::min(p_Size - written, block.size() * sizeof(uint64_t));
+        file.write(reinterpret_cast<const char*>(block.data()), count);
+        written += count;
+    }
+    return static_cast<bool>(file);
+}
+
+// Runs a command and returns its wall-clock time in seconds, or a negative value if it failed
+static double TimeCommand(const std::string& p_Command)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    const int result = std::system(p_Command.c_str());
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return (result == 0) ? seconds : -1.0;
+}
+
+static size_t GetFileSize(const std::string& p_Path)
+{
+    std::ifstream file(p_Path, std::ios::binary | std::ios::in | std::ios::ate);
+    return file ? static_cast<size_t>(file.tellg()) : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string resourceCompilerPath;
+    std::string compilerPath;
+    std::string workDir;
+    std::string sizes = "1,64,512";
+
+    for (int i = 1; (i < argc) && ((argc % 2) == 1); i += 2)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "-rc") resourceCompilerPath = argv[i + 1];
+        if (arg == "-cc") compilerPath = argv[i + 1];
+        if (arg == "-workdir") workDir = argv[i + 1];
+        if (arg == "-sizes") sizes = argv[i + 1];
+    }
+
+    if (resourceCompilerPath.empty() || compilerPath.empty() || workDir.empty())
+    {
+        std::cerr << "Invalid arguments." << std::endl;
+        std::cerr << "Usage: " << argv[0] << " -rc ResourceCompiler -cc compiler -workdir dir [-sizes 1,64,512]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "size_mb,format,generate_s,compile_s,source_mb" << std::endl;
+
+    std::stringstream sizeList(sizes);
+    for (std::string sizeText; std::getline(sizeList, sizeText, ',');)
+    {
+        const size_t megabytes = std::stoul(sizeText);
+        const std::string inputPath = workDir + "/input_" + sizeText + "mb.bin";
+        if (!WriteInputFile(inputPath, megabytes << 20))
+        {
+            std::cerr << "Failed to write input file \"" << inputPath << "\"." << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for (const std::string format : { "asm", "c" })
+        {
+            const std::string sourcePath = workDir + "/resource_" + sizeText + "mb" + ((format == "asm") ? ".S" : ".c");
+            const std::string objectPath = sourcePath + ".o";
+
+            const double generateSeconds = TimeCommand("\"" + resourceCompilerPath + "\" -input \"" + inputPath + "\" -output \"" + sourcePath +
+                "\" -name benchmark -format " + format);
+            const double compileSeconds = (generateSeconds < 0.0) ? -1.0 :
+                TimeCommand("\"" + compilerPath + "\" -c \"" + sourcePath + "\" -o \"" + objectPath + "\"");
+
+            std::cout << megabytes << "," << format << "," << generateSeconds << "," << compileSeconds << ","
+                << (GetFileSize(sourcePath) / double(1 << 20)) << std::endl;
+
+            std::remove(sourcePath.c_str());
+            std::remove(objectPath.c_str());
+        }
+
+        std::remove(inputPath.c_str());
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,405 @@
+#pragma once
+
+// Data formats shared by the ResourceCompiler and the runtime that loads the resources it generates.
+// Everything is little-endian.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Value of the rc_flags_<name> symbol emitted next to rc_data_<name> and rc_size_<name>
+enum ResourceFlags : uint32_t
+{
+    RESOURCE_FLAG_COMPRESSED = 1 << 0, // rc_data is a compressed resource container, see below
+    RESOURCE_FLAG_SPIRV = 1 << 1,      // rc_data is a validated SPIR-V module, emitted as a uint32_t array
+    RESOURCE_FLAG_MESH = 1 << 2,       // rc_data (once decompressed) is a mesh, see MeshHeader
+};
+
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+constexpr size_t SPIRV_HEADER_WORDS = 5; // Magic, version, generator, bound, schema
+
+// Compressed resource container: header, chunkCount + 1 chunk offsets relative to the end of the offset table,
+// then the chunks. Every chunk holds chunkSize bytes of the original data (the last one may be shorter) and is
+// decoded independently, so chunks can be decompressed in parallel. A chunk whose stored size equals its
+// decompressed size is stored raw.
+struct CompressedResourceHeader
+{
+    static constexpr uint32_t MAGIC = 0x315A4352; // "RCZ1"
+
+    uint32_t magic;
+    uint32_t chunkSize;
+    uint64_t size; // Decompressed size
+    uint32_t chunkCount;
+    uint32_t reserved;
+};
+
+constexpr uint32_t RESOURCE_CHUNK_SIZE = 256 * 1024;
+
+// 64-bit non-cryptographic hash, used to detect content changes and to index resource names
+inline uint64_t HashBytes(const void* p_pData, size_t p_Size, uint64_t p_Seed = 0)
+{
+    const uint8_t* pBytes = static_cast<const uint8_t*>(p_pData);
+    auto mix = [](uint64_t p_Value) {
+        p_Value ^= p_Value >> 31;
+        p_Value *= 0x7fb5d329728ea185ull;
+        p_Value ^= p_Value >> 27;
+        p_Value *= 0x81dadef4bc2dd44dull;
+        return p_Value ^ (p_Value >> 33);
+    };
+
+    uint64_t hash = p_Seed ^ (p_Size * 0x9e3779b97f4a7c15ull);
+    size_t i = 0;
+    for (; i + 8 <= p_Size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, pBytes + i, sizeof(word));
+        hash = (hash ^ mix(word)) * 0x9e3779b97f4a7c15ull;
+        hash = (hash << 29) | (hash >> 35);
+    }
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < p_Size; i++, shift += 8) tail |= uint64_t(pBytes[i]) << shift;
+    return mix(hash ^ mix(tail + 1));
+}
+
+// LZ4 block format: sequences of [token][literal length][literals][offset][match length]
+constexpr size_t LZ4_MIN_MATCH = 4;
+constexpr size_t LZ4_LAST_LITERALS = 5; // The last 5 bytes are always literals
+constexpr size_t LZ4_MATCH_FIND_LIMIT = 12; // The last match starts at least 12 bytes before the end
+constexpr uint32_t LZ4_HASH_BITS = 14;
+
+inline size_t Lz4GetMaxCompressedSize(size_t p_Size)
+{
+    return p_Size + p_Size / 255 + 16;
+}
+
+inline uint32_t Lz4Read32(const uint8_t* p_pData)
+{
+    uint32_t value;
+    memcpy(&value, p_pData, sizeof(value));
+    return value;
+}
+
+inline uint8_t* Lz4WriteLength(uint8_t* p_pOutput, size_t p_Length)
+{
+    for (; p_Length >= 255; p_Length -= 255) *p_pOutput++ = 255;
+    *p_pOutput++ = static_cast<uint8_t>(p_Length);
+    return p_pOutput;
+}
+
+// Greedy single-pass compressor. p_pOutput must hold Lz4GetMaxCompressedSize(p_Size) bytes. Returns the compressed size.
+inline size_t Lz4CompressBlock(const uint8_t* p_pInput, size_t p_Size, uint8_t* p_pOutput)
+{
+    uint8_t* pOutput = p_pOutput;
+    size_t anchor = 0;
+
+    auto writeSequence = [&](size_t p_LiteralEnd, size_t p_MatchLength, size_t p_Offset) {
+        const size_t literalLength = p_LiteralEnd - anchor;
+        uint8_t* pToken = pOutput++;
+        *pToken = static_cast<uint8_t>(std::min<size_t>(literalLength, 15) << 4);
+        if (literalLength >= 15) pOutput = Lz4WriteLength(pOutput, literalLength - 15);
+        memcpy(pOutput, p_pInput + anchor, literalLength);
+        pOutput += literalLength;
+
+        if (p_MatchLength == 0) return; // Last literals
+        *pOutput++ = static_cast<uint8_t>(p_Offset & 0xff);
+        *pOutput++ = static_cast<uint8_t>(p_Offset >> 8);
+        const size_t matchCode = p_MatchLength - LZ4_MIN_MATCH;
+        *pToken |= static_cast<uint8_t>(std::min<size_t>(matchCode, 15));
+        if (matchCode >= 15) pOutput = Lz4WriteLength(pOutput, matchCode - 15);
+    };
+
+    if (p_Size > LZ4_MATCH_FIND_LIMIT)
+    {
+        std::vector<uint32_t> hashTable(size_t(1) << LZ4_HASH_BITS, UINT32_MAX);
+        const size_t matchFindEnd = p_Size - LZ4_MATCH_FIND_LIMIT;
+        const size_t matchEnd = p_Size - LZ4_LAST_LITERALS;
+
+        size_t position = 0;
+        while (position < matchFindEnd)
+        {
+            const uint32_t sequence = Lz4Read32(p_pInput + position);
+            const uint32_t hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            const uint32_t candidate = hashTable[hash];
+            hashTable[hash] = static_cast<uint32_t>(position);
+
+            if ((candidate == UINT32_MAX) || (position - candidate > 0xffff) || (Lz4Read32(p_pInput + candidate) != sequence))
+            {
+                position++;
+                continue;
+            }
+
+            size_t matchLength = LZ4_MIN_MATCH;
+            while ((position + matchLength < matchEnd) && (p_pInput[candidate + matchLength] == p_pInput[position + matchLength])) matchLength++;
+
+            writeSequence(position, matchLength, position - candidate);
+            position += matchLength;
+            anchor = position;
+        }
+    }
+
+    writeSequence(p_Size, 0, 0);
+    return static_cast<size_t>(pOutput - p_pOutput);
+}
+
+// Bounds-checked decoder. Returns false if the block is malformed or doesn't decode to exactly p_OutputSize bytes.
+inline bool Lz4DecompressBlock(const uint8_t* p_pInput, size_t p_InputSize, uint8_t* p_pOutput, size_t p_OutputSize)
+{
+    const uint8_t* pInput = p_pInput;
+    const uint8_t* const pInputEnd = p_pInput + p_InputSize;
+    uint8_t* pOutput = p_pOutput;
+    uint8_t* const pOutputEnd = p_pOutput + p_OutputSize;
+
+    auto readLength = [&](size_t& p_Length) {
+        uint8_t byte;
+        do
+        {
+            if (pInput >= pInputEnd) return false;
+            byte = *pInput++;
+            p_Length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (pInput < pInputEnd)
+    {
+        const uint8_t token = *pInput++;
+
+        size_t literalLength = token >> 4;
+        if ((literalLength == 15) && !readLength(literalLength)) return false;
+        if ((static_cast<size_t>(pInputEnd - pInput) < literalLength) || (static_cast<size_t>(pOutputEnd - pOutput) < literalLength)) return false;
+        memcpy(pOutput, pInput, literalLength);
+        pInput += literalLength;
+        pOutput += literalLength;
+
+        if (pInput == pInputEnd) break; // Last literals
+
+        if (pInputEnd - pInput < 2) return false;
+        const size_t offset = pInput[0] | (pInput[1] << 8);
+        pInput += 2;
+        if ((offset == 0) || (offset > static_cast<size_t>(pOutput - p_pOutput))) return false;
+
+        size_t matchLength = token & 15;
+        if ((matchLength == 15) && !readLength(matchLength)) return false;
+        matchLength += LZ4_MIN_MATCH;
+        if (static_cast<size_t>(pOutputEnd - pOutput) < matchLength) return false;
+
+        const uint8_t* pMatch = pOutput - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(pOutput, pMatch, matchLength);
+            pOutput += matchLength;
+        }
+        else
+        {
+            for (size_t i = 0; i < matchLength; i++) *pOutput++ = pMatch[i]; // Overlapping copy repeats the pattern
+        }
+    }
+
+    return pOutput == pOutputEnd;
+}
+
+inline std::vector<uint8_t> CompressResource(const uint8_t* p_pData, size_t p_Size, uint32_t p_ChunkSize = RESOURCE_CHUNK_SIZE)
+{
+    CompressedResourceHeader header;
+    header.magic = CompressedResourceHeader::MAGIC;
+    header.chunkSize = p_ChunkSize;
+    header.size = p_Size;
+    header.chunkCount = static_cast<uint32_t>((p_Size + p_ChunkSize - 1) / p_ChunkSize);
+    header.reserved = 0;
+
+    std::vector<uint32_t> offsets(header.chunkCount + 1, 0);
+    std::vector<uint8_t> chunks;
+    std::vector<uint8_t> compressed(Lz4GetMaxCompressedSize(p_ChunkSize));
+    for (uint32_t i = 0; i < header.chunkCount; i++)
+    {
+        const uint8_t* pChunk = p_pData + size_t(i) * p_ChunkSize;
+        const size_t chunkSize = std::min<size_t>(p_ChunkSize, p_Size - size_t(i) * p_ChunkSize);
+        const size_t compressedSize = Lz4CompressBlock(pChunk, chunkSize, compressed.data());
+
+        if (compressedSize < chunkSize) chunks.insert(chunks.end(), compressed.data(), compressed.data() + compressedSize);
+        else chunks.insert(chunks.end(), pChunk, pChunk + chunkSize);
+        offsets[i + 1] = static_cast<uint32_t>(chunks.size());
+    }
+
+    std::vector<uint8_t> output(sizeof(header) + offsets.size() * sizeof(uint32_t) + chunks.size());
+    memcpy(output.data(), &header, sizeof(header));
+    memcpy(output.data() + sizeof(header), offsets.data(), offsets.size() * sizeof(uint32_t));
+    if (!chunks.empty()) memcpy(output.data() + sizeof(header) + offsets.size() * sizeof(uint32_t), chunks.data(), chunks.size());
+    return output;
+}
+
+// Validates the container and returns its header
+inline bool ReadCompressedResourceHeader(const uint8_t* p_pData, size_t p_Size, CompressedResourceHeader& p_Header)
+{
+    if (p_Size < sizeof(p_Header)) return false;
+    memcpy(&p_Header, p_pData, sizeof(p_Header));
+    if ((p_Header.magic != CompressedResourceHeader::MAGIC) || (p_Header.chunkSize == 0)) return false;
+    if (p_Header.chunkCount != (p_Header.size + p_Header.chunkSize - 1) / p_Header.chunkSize) return false;
+    return p_Size >= sizeof(p_Header) + (size_t(p_Header.chunkCount) + 1) * sizeof(uint32_t);
+}
+
+// Decompresses one chunk into its place in p_pOutput, which holds the whole decompressed resource
+inline bool DecompressResourceChunk(const uint8_t* p_pData, size_t p_Size, const CompressedResourceHeader& p_Header, uint32_t p_ChunkIndex, uint8_t* p_pOutput)
+{
+    const size_t tableOffset = sizeof(p_Header);
+    const size_t chunksOffset = tableOffset + (size_t(p_Header.chunkCount) + 1) * sizeof(uint32_t);
+
+    uint32_t begin, end;
+    memcpy(&begin, p_pData + tableOffset + p_ChunkIndex * sizeof(uint32_t), sizeof(uint32_t));
+    memcpy(&end, p_pData + tableOffset + (p_ChunkIndex + 1) * sizeof(uint32_t), sizeof(uint32_t));
+    if ((begin > end) || (chunksOffset + end > p_Size)) return false;
+
+    const uint64_t outputOffset = uint64_t(p_ChunkIndex) * p_Header.chunkSize;
+    const size_t outputSize = static_cast<size_t>(std::min<uint64_t>(p_Header.chunkSize, p_Header.size - outputOffset));
+    const uint8_t* pChunk = p_pData + chunksOffset + begin;
+    const size_t chunkSize = end - begin;
+
+    if (chunkSize == outputSize)
+    {
+        memcpy(p_pOutput + outputOffset, pChunk, chunkSize);
+        return true;
+    }
+    return Lz4DecompressBlock(pChunk, chunkSize, p_pOutput + outputOffset, outputSize);
+}
+
+// Resource pack: header, bucketCount + 1 bucket offsets into the entries, entryCount entries sorted by bucket
+// (the low bits of the name hash), the names, then the payloads, each aligned to RESOURCE_PACK_ALIGNMENT so the
+// pack can be mapped and used in place. A payload is stored exactly like the embedded rc_data of the resource.
+struct ResourcePackHeader
+{
+    static constexpr uint32_t MAGIC = 0x31504352; // "RCP1"
+
+    uint32_t magic;
+    uint32_t entryCount;
+    uint32_t bucketCount; // Power of two
+    uint32_t namesSize;
+    uint64_t fileSize;
+};
+
+struct ResourcePackEntry
+{
+    uint64_t nameHash;
+    uint64_t offset; // From the start of the pack
+    uint64_t size;
+    uint32_t flags;
+    uint32_t nameOffset; // From the start of the names
+    uint32_t nameSize;
+    uint32_t reserved;
+};
+
+constexpr size_t RESOURCE_PACK_ALIGNMENT = 4096;
+
+inline uint32_t GetResourcePackBucket(uint64_t p_NameHash, uint32_t p_BucketCount)
+{
+    return static_cast<uint32_t>(p_NameHash & (p_BucketCount - 1));
+}
+
+// Checks that the header, index and names lie within the pack
+inline bool ReadResourcePackHeader(const uint8_t* p_pData, size_t p_Size, ResourcePackHeader& p_Header)
+{
+    if (p_Size < sizeof(ResourcePackHeader)) return false;
+    memcpy(&p_Header, p_pData, sizeof(p_Header));
+    if ((p_Header.magic != ResourcePackHeader::MAGIC) || (p_Header.fileSize != p_Size)) return false;
+    if ((p_Header.bucketCount == 0) || ((p_Header.bucketCount & (p_Header.bucketCount - 1)) != 0)) return false;
+
+    const uint64_t indexSize = uint64_t(p_Header.bucketCount + 1) * sizeof(uint32_t) + uint64_t(p_Header.entryCount) * sizeof(ResourcePackEntry);
+    return sizeof(ResourcePackHeader) + indexSize + p_Header.namesSize <= p_Size;
+}
+
+// Looks a resource up by name in a pack whose header was checked by ReadResourcePackHeader. Only the entries of
+// the name's bucket are compared, so this is O(1) for the bucket counts the ResourceCompiler picks. Returns false
+// if there is no such resource or its entry lies outside the pack.
+inline bool FindResourcePackEntry(const uint8_t* p_pData, const ResourcePackHeader& p_Header, const char* p_pName, size_t p_NameSize, ResourcePackEntry& p_Entry)
+{
+    const uint8_t* pBuckets = p_pData + sizeof(ResourcePackHeader);
+    const uint8_t* pEntries = pBuckets + (p_Header.bucketCount + 1) * sizeof(uint32_t);
+    const uint8_t* pNames = pEntries + p_Header.entryCount * sizeof(ResourcePackEntry);
+
+    const uint64_t nameHash = HashBytes(p_pName, p_NameSize);
+    const uint32_t bucket = GetResourcePackBucket(nameHash, p_Header.bucketCount);
+    uint32_t first, last;
+    memcpy(&first, pBuckets + bucket * sizeof(uint32_t), sizeof(first));
+    memcpy(&last, pBuckets + (bucket + 1) * sizeof(uint32_t), sizeof(last));
+
+    for (uint32_t i = first; (i < last) && (i < p_Header.entryCount); i++)
+    {
+        memcpy(&p_Entry, pEntries + i * sizeof(ResourcePackEntry), sizeof(p_Entry));
+        if ((p_Entry.nameHash != nameHash) || (p_Entry.nameSize != p_NameSize)) continue;
+        if (uint64_t(p_Entry.nameOffset) + p_Entry.nameSize > p_Header.namesSize) return false;
+        if (memcmp(pNames + p_Entry.nameOffset, p_pName, p_NameSize) != 0) continue;
+        return (p_Entry.offset <= p_Header.fileSize) && (p_Entry.size <= p_Header.fileSize - p_Entry.offset);
+    }
+    return false;
+}
+
+// Mesh built by the ResourceCompiler (-type mesh): header, vertexCount MeshVertex, then indexCount indices of
+// indexSize bytes, ready to be copied into vertex and index buffers. Triangles are ordered for the post-transform
+// vertex cache and vertices by first use. With R16G16B16A16_UNORM/R16G16_UNORM vertex attributes, which read as
+// [0, 1], a position is positionOffset + positionScale * attribute and a UV uvOffset + uvScale * attribute.
+struct MeshHeader
+{
+    static constexpr uint32_t MAGIC = 0x314D4352; // "RCM1"
+
+    uint32_t magic;
+    uint32_t vertexCount;
+    uint32_t indexCount; // Triangle list
+    uint32_t indexSize; // 2 or 4
+    float positionOffset[3];
+    float positionScale[3];
+    float uvOffset[2];
+    float uvScale[2];
+    uint32_t reserved[2];
+};
+
+struct MeshVertex
+{
+    uint16_t position[4]; // Unorm16 within the mesh bounds, w is 0
+    uint16_t uv[2]; // Unorm16 within the mesh UV bounds, v points down
+    int16_t normal[2]; // Snorm16 octahedral encoding, see DecodeOctahedralNormal
+};
+
+static_assert(sizeof(MeshHeader) == 64, "MeshHeader layout");
+static_assert(sizeof(MeshVertex) == 16, "MeshVertex layout");
+
+// Maps a unit vector to the octahedron |x| + |y| + |z| = 1 and unfolds its lower half over the square [-1, 1]^2
+inline void EncodeOctahedralNormal(const float p_Normal[3], int16_t p_Encoded[2])
+{
+    const float length = std::fabs(p_Normal[0]) + std::fabs(p_Normal[1]) + std::fabs(p_Normal[2]);
+    float x = (length > 0.0f) ? p_Normal[0] / length : 0.0f;
+    float y = (length > 0.0f) ? p_Normal[1] / length : 0.0f;
+    if ((length > 0.0f) && (p_Normal[2] < 0.0f))
+    {
+        const float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+    }
+    p_Encoded[0] = static_cast<int16_t>(std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+    p_Encoded[1] = static_cast<int16_t>(std::lround(std::clamp(y, -1.0f, 1.0f) * 32767.0f));
+}
+
+inline void DecodeOctahedralNormal(const int16_t p_Encoded[2], float p_Normal[3])
+{
+    const float x = std::max(p_Encoded[0] / 32767.0f, -1.0f);
+    const float y = std::max(p_Encoded[1] / 32767.0f, -1.0f);
+    const float z = 1.0f - std::fabs(x) - std::fabs(y);
+    const float t = std::max(-z, 0.0f);
+    p_Normal[0] = x + (x >= 0.0f ? -t : t);
+    p_Normal[1] = y + (y >= 0.0f ? -t : t);
+    p_Normal[2] = z;
+
+    const float length = std::sqrt(p_Normal[0] * p_Normal[0] + p_Normal[1] * p_Normal[1] + p_Normal[2] * p_Normal[2]);
+    for (int i = 0; i < 3; i++) p_Normal[i] /= length;
+}
+
+// Checks that the vertices and indices lie within the data. The vertices start right after the header, the
+// indices right after the vertices.
+inline bool ReadMeshHeader(const uint8_t* p_pData, size_t p_Size, MeshHeader& p_Header)
+{
+    if (p_Size < sizeof(MeshHeader)) return false;
+    memcpy(&p_Header, p_pData, sizeof(p_Header));
+    if ((p_Header.magic != MeshHeader::MAGIC) || ((p_Header.indexSize != 2) && (p_Header.indexSize != 4))) return false;
+    const uint64_t size = sizeof(MeshHeader) + uint64_t(p_Header.vertexCount) * sizeof(MeshVertex) + uint64_t(p_Header.indexCount) * p_Header.indexSize;
+    return size <= p_Size;
+}
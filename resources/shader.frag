@@ -1,10 +1,47 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Compile-time features, one SPIR-V variant per combination (target_shader_permutations)
+#ifndef GLOW
+#define GLOW 0
+#endif
+#ifndef DESATURATE
+#define DESATURATE 0
+#endif
+
+// Runtime toggles, folded by the driver when the pipeline is created (PipelineStateKey::specializationFlags)
+layout(constant_id = 0) const bool GRAYSCALE = false;
+
+// Bindless table (BindlessTable::BUFFER_BINDING), indexed with integers instead of binding sets per draw
+layout(set = 0, binding = 1) readonly buffer MaterialBuffer {
+    vec4 tints[];
+} buffers[];
+
+layout(set = 1, binding = 0) uniform FrameConstants {
+    float time;
+    uint materialBuffer;
+} frame;
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) flat in uint fragMaterial;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    // Same buffer for the whole draw, no nonuniformEXT needed
+    vec3 color = fragColor * buffers[frame.materialBuffer].tints[fragMaterial].rgb;
+    float luminance = dot(color, vec3(0.299, 0.587, 0.114));
+#if DESATURATE
+    color = mix(color, vec3(luminance), 0.6);
+#endif
+    if (GRAYSCALE) {
+        color = vec3(luminance);
+    }
+#if GLOW
+    // Blended additively, alpha scales the contribution
+    outColor = vec4(color, 0.5 + 0.25 * sin(frame.time * 4.0));
+#else
+    outColor = vec4(color, 1.0);
+#endif
 }
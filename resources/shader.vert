@@ -1,21 +1,56 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(location = 0) out vec3 fragColor;
+// Draws are indirect and read their parameters by instance index (PipelineStateKey::specializationFlags)
+layout(constant_id = 1) const bool INDIRECT_DRAWS = false;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+struct DrawData {
+    uint material;
+    uint instance;
+    uvec2 padding;
+};
+
+// World matrix of a scene node, 3 rows (Scene::WriteInstances())
+struct Instance {
+    vec4 rows[3];
+};
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// Bindless table (BindlessTable::BUFFER_BINDING), the parameters of every draw for indirect draws
+layout(set = 0, binding = 1) readonly buffer DrawBuffer {
+    DrawData draws[];
+} drawBuffers[];
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(set = 0, binding = 1) readonly buffer InstanceBuffer {
+    Instance instances[];
+} instanceBuffers[];
+
+layout(set = 1, binding = 0) uniform FrameConstants {
+    float time;
+    uint materialBuffer;
+    uint drawBuffer;
+    uint instanceBuffer;
+    vec4 view; // World-space center and zoom
+} frame;
+
+// Uniform ring, bound with the draw's dynamic offset
+layout(set = 1, binding = 1) uniform DrawParameters {
+    DrawData data;
+} draw;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) flat out uint fragMaterial;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    // The culling writes the object's index as the first instance
+    DrawData data = INDIRECT_DRAWS ? drawBuffers[frame.drawBuffer].draws[gl_InstanceIndex] : draw.data;
+    Instance instance = instanceBuffers[frame.instanceBuffer].instances[data.instance];
+    vec4 position = vec4(inPosition, 0.0, 1.0);
+    vec2 world = vec2(dot(instance.rows[0], position), dot(instance.rows[1], position));
+    gl_Position = vec4((world - frame.view.xy) * frame.view.z, 0.0, 1.0);
+    fragColor = inColor;
+    fragMaterial = data.material;
 }
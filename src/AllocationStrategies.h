@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+// Allocation strategies over a range of offsets. They don't touch Vulkan, so they can be tested on the CPU alone;
+// DeviceMemoryAllocator (MemoryAllocator.h) maps them onto vk::DeviceMemory blocks.
+
+inline uint64_t AlignUp(uint64_t p_Value, uint64_t p_Alignment)
+{
+    return (p_Value + p_Alignment - 1) / p_Alignment * p_Alignment;
+}
+
+inline uint32_t FindLastSetBit(uint64_t p_Value)
+{
+    uint32_t bit = 0;
+    while (p_Value >>= 1) bit++;
+    return bit;
+}
+
+inline uint32_t FindFirstSetBit(uint64_t p_Value)
+{
+    uint32_t bit = 0;
+    while ((p_Value & 1) == 0)
+    {
+        p_Value >>= 1;
+        bit++;
+    }
+    return bit;
+}
+
+// Two-level segregated fit allocator over a range of p_Size bytes. Free ranges are binned by the power of two of
+// their size (first level) and 32 linear subdivisions of it (second level), with a bitmap per level, so both
+// allocation and release are O(1). Adjacent free ranges are merged on release.
+class TlsfAllocator
+{
+public:
+    static constexpr uint32_t INVALID_HANDLE = UINT32_MAX;
+
+    struct Allocation
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t handle = INVALID_HANDLE;
+
+        bool IsValid() const { return handle != INVALID_HANDLE; }
+    };
+
+    struct Stats
+    {
+        uint64_t size = 0;
+        uint64_t usedBytes = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeRangeCount = 0;
+        uint64_t largestFreeRange = 0;
+    };
+
+    explicit TlsfAllocator(uint64_t p_Size = 0)
+    {
+        Reset(p_Size);
+    }
+
+    // Releases every allocation
+    void Reset(uint64_t p_Size)
+    {
+        m_Nodes.clear();
+        m_FreeNodes.clear();
+        m_FirstLevelBitmap = 0;
+        std::fill(std::begin(m_SecondLevelBitmaps), std::end(m_SecondLevelBitmaps), 0u);
+        for (auto& heads : m_FreeHeads) std::fill(std::begin(heads), std::end(heads), INVALID_HANDLE);
+
+        m_Size = p_Size;
+        m_UsedBytes = 0;
+        m_AllocationCount = 0;
+        m_FreeRangeCount = 0;
+        if (p_Size == 0) return;
+
+        const uint32_t node = CreateNode();
+        m_Nodes[node].offset = 0;
+        m_Nodes[node].size = p_Size;
+        InsertFree(node);
+    }
+
+    Allocation Allocate(uint64_t p_Size, uint64_t p_Alignment = 1)
+    {
+        if ((p_Size == 0) || (p_Size > m_Size)) return Allocation();
+        p_Alignment = std::max<uint64_t>(p_Alignment, 1);
+
+        // Good fit: any range of the first non-empty bin at or above the rounded up size fits, with the worst case
+        // alignment padding. Falls back to a scan of the bin of the exact size, which may hold a range that fits.
+        uint32_t node = FindFree(p_Size + p_Alignment - 1);
+        if ((node == INVALID_HANDLE) || !Fits(m_Nodes[node], p_Size, p_Alignment)) node = FindFreeInBin(p_Size, p_Alignment);
+        if (node == INVALID_HANDLE) return Allocation();
+
+        RemoveFree(node);
+
+        const uint64_t padding = AlignUp(m_Nodes[node].offset, p_Alignment) - m_Nodes[node].offset;
+        if (padding > 0)
+        {
+            // The range before is in use, otherwise it would have been merged with this one
+            const uint32_t paddingNode = SplitFront(node, padding);
+            InsertFree(paddingNode);
+        }
+        if (m_Nodes[node].size > p_Size)
+        {
+            const uint32_t allocatedNode = SplitFront(node, p_Size);
+            InsertFree(node); // The remainder
+            node = allocatedNode;
+        }
+
+        m_Nodes[node].isFree = false;
+        m_UsedBytes += m_Nodes[node].size;
+        m_AllocationCount++;
+
+        Allocation allocation;
+        allocation.offset = m_Nodes[node].offset;
+        allocation.size = m_Nodes[node].size;
+        allocation.handle = node;
+        return allocation;
+    }
+
+    void Free(uint32_t p_Handle)
+    {
+        if ((p_Handle >= m_Nodes.size()) || m_Nodes[p_Handle].isFree) throw std::logic_error("Invalid or double free of a sub-allocation.");
+
+        uint32_t node = p_Handle;
+        m_UsedBytes -= m_Nodes[node].size;
+        m_AllocationCount--;
+        m_Nodes[node].isFree = true;
+
+        const uint32_t next = m_Nodes[node].nextPhysical;
+        if ((next != INVALID_HANDLE) && m_Nodes[next].isFree)
+        {
+            RemoveFree(next);
+            MergeWithNext(node);
+        }
+        const uint32_t previous = m_Nodes[node].previousPhysical;
+        if ((previous != INVALID_HANDLE) && m_Nodes[previous].isFree)
+        {
+            RemoveFree(previous);
+            MergeWithNext(previous);
+            node = previous;
+        }
+        InsertFree(node);
+    }
+
+    bool IsEmpty() const { return m_AllocationCount == 0; }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.size = m_Size;
+        stats.usedBytes = m_UsedBytes;
+        stats.allocationCount = m_AllocationCount;
+        stats.freeRangeCount = m_FreeRangeCount;
+        if (m_FirstLevelBitmap != 0)
+        {
+            const uint32_t firstLevel = FindLastSetBit(m_FirstLevelBitmap);
+            const uint32_t secondLevel = FindLastSetBit(m_SecondLevelBitmaps[firstLevel]);
+            for (uint32_t node = m_FreeHeads[firstLevel][secondLevel]; node != INVALID_HANDLE; node = m_Nodes[node].nextFree)
+            {
+                stats.largestFreeRange = std::max(stats.largestFreeRange, m_Nodes[node].size);
+            }
+        }
+        return stats;
+    }
+
+private:
+    static constexpr uint32_t SECOND_LEVEL_LOG2 = 5;
+    static constexpr uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_LOG2;
+    static constexpr uint32_t SMALL_SIZE_LOG2 = 8; // Sizes below 256 bytes share the first bin, in 8-byte steps
+    static constexpr uint64_t SMALL_SIZE = uint64_t(1) << SMALL_SIZE_LOG2;
+    static constexpr uint32_t FIRST_LEVEL_COUNT = 64 - SMALL_SIZE_LOG2 + 1;
+
+    struct Node
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t previousPhysical = INVALID_HANDLE;
+        uint32_t nextPhysical = INVALID_HANDLE;
+        uint32_t previousFree = INVALID_HANDLE;
+        uint32_t nextFree = INVALID_HANDLE;
+        bool isFree = false;
+    };
+
+    uint64_t m_Size = 0;
+    uint64_t m_UsedBytes = 0;
+    uint32_t m_AllocationCount = 0;
+    uint32_t m_FreeRangeCount = 0;
+
+    std::vector<Node> m_Nodes;
+    std::vector<uint32_t> m_FreeNodes; // Unused entries of m_Nodes
+    uint64_t m_FirstLevelBitmap = 0;
+    uint32_t m_SecondLevelBitmaps[FIRST_LEVEL_COUNT] = {};
+    uint32_t m_FreeHeads[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT];
+
+    static void GetBin(uint64_t p_Size, uint32_t& p_FirstLevel, uint32_t& p_SecondLevel)
+    {
+        if (p_Size < SMALL_SIZE)
+        {
+            p_FirstLevel = 0;
+            p_SecondLevel = static_cast<uint32_t>(p_Size / (SMALL_SIZE / SECOND_LEVEL_COUNT));
+            return;
+        }
+        const uint32_t log2 = FindLastSetBit(p_Size);
+        p_FirstLevel = log2 - SMALL_SIZE_LOG2 + 1;
+        p_SecondLevel = static_cast<uint32_t>(p_Size >> (log2 - SECOND_LEVEL_LOG2)) ^ SECOND_LEVEL_COUNT;
+    }
+
+    static bool Fits(const Node& p_Node, uint64_t p_Size, uint64_t p_Alignment)
+    {
+        return AlignUp(p_Node.offset, p_Alignment) + p_Size <= p_Node.offset + p_Node.size;
+    }
+
+    uint32_t FindFree(uint64_t p_Size) const
+    {
+        // Round up to the next bin boundary, so that every range of the bin found is large enough
+        const uint64_t binWidth = (p_Size < SMALL_SIZE) ? (SMALL_SIZE / SECOND_LEVEL_COUNT) : (uint64_t(1) << (FindLastSetBit(p_Size) - SECOND_LEVEL_LOG2));
+        const uint64_t roundedSize = p_Size + binWidth - 1;
+        if (roundedSize < p_Size) return INVALID_HANDLE;
+
+        uint32_t firstLevel, secondLevel;
+        GetBin(roundedSize, firstLevel, secondLevel);
+        if (firstLevel >= FIRST_LEVEL_COUNT) return INVALID_HANDLE;
+
+        uint32_t secondLevelMap = m_SecondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+        if (secondLevelMap == 0)
+        {
+            const uint64_t firstLevelMap = (firstLevel + 1 < 64) ? (m_FirstLevelBitmap & (~uint64_t(0) << (firstLevel + 1))) : 0;
+            if (firstLevelMap == 0) return INVALID_HANDLE;
+            firstLevel = FindFirstSetBit(firstLevelMap);
+            secondLevelMap = m_SecondLevelBitmaps[firstLevel];
+        }
+        return m_FreeHeads[firstLevel][FindFirstSetBit(secondLevelMap)];
+    }
+
+    uint32_t FindFreeInBin(uint64_t p_Size, uint64_t p_Alignment) const
+    {
+        uint32_t firstLevel, secondLevel;
+        GetBin(p_Size, firstLevel, secondLevel);
+        for (uint32_t node = m_FreeHeads[firstLevel][secondLevel]; node != INVALID_HANDLE; node = m_Nodes[node].nextFree)
+        {
+            if (Fits(m_Nodes[node], p_Size, p_Alignment)) return node;
+        }
+        return INVALID_HANDLE;
+    }
+
+    uint32_t CreateNode()
+    {
+        if (!m_FreeNodes.empty())
+        {
+            const uint32_t node = m_FreeNodes.back();
+            m_FreeNodes.pop_back();
+            m_Nodes[node] = Node();
+            return node;
+        }
+        m_Nodes.emplace_back();
+        return static_cast<uint32_t>(m_Nodes.size() - 1);
+    }
+
+    void InsertFree(uint32_t p_Node)
+    {
+        Node& node = m_Nodes[p_Node];
+        uint32_t firstLevel, secondLevel;
+        GetBin(node.size, firstLevel, secondLevel);
+
+        node.isFree = true;
+        node.previousFree = INVALID_HANDLE;
+        node.nextFree = m_FreeHeads[firstLevel][secondLevel];
+        if (node.nextFree != INVALID_HANDLE) m_Nodes[node.nextFree].previousFree = p_Node;
+        m_FreeHeads[firstLevel][secondLevel] = p_Node;
+
+        m_FirstLevelBitmap |= uint64_t(1) << firstLevel;
+        m_SecondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+        m_FreeRangeCount++;
+    }
+
+    void RemoveFree(uint32_t p_Node)
+    {
+        Node& node = m_Nodes[p_Node];
+        uint32_t firstLevel, secondLevel;
+        GetBin(node.size, firstLevel, secondLevel);
+
+        if (node.previousFree != INVALID_HANDLE) m_Nodes[node.previousFree].nextFree = node.nextFree;
+        else m_FreeHeads[firstLevel][secondLevel] = node.nextFree;
+        if (node.nextFree != INVALID_HANDLE) m_Nodes[node.nextFree].previousFree = node.previousFree;
+
+        if (m_FreeHeads[firstLevel][secondLevel] == INVALID_HANDLE)
+        {
+            m_SecondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+            if (m_SecondLevelBitmaps[firstLevel] == 0) m_FirstLevelBitmap &= ~(uint64_t(1) << firstLevel);
+        }
+        node.previousFree = node.nextFree = INVALID_HANDLE;
+        m_FreeRangeCount--;
+    }
+
+    // Splits the first p_Size bytes of a node off into a new node, which is returned. Neither is in a free list.
+    uint32_t SplitFront(uint32_t p_Node, uint64_t p_Size)
+    {
+        const uint32_t front = CreateNode(); // May reallocate m_Nodes
+        Node& node = m_Nodes[p_Node];
+        m_Nodes[front].offset = node.offset;
+        m_Nodes[front].size = p_Size;
+        m_Nodes[front].isFree = true;
+        m_Nodes[front].previousPhysical = node.previousPhysical;
+        m_Nodes[front].nextPhysical = p_Node;
+        if (node.previousPhysical != INVALID_HANDLE) m_Nodes[node.previousPhysical].nextPhysical = front;
+
+        node.offset += p_Size;
+        node.size -= p_Size;
+        node.previousPhysical = front;
+        return front;
+    }
+
+    // Absorbs the next physical node, which must not be in a free list
+    void MergeWithNext(uint32_t p_Node)
+    {
+        Node& node = m_Nodes[p_Node];
+        const uint32_t next = node.nextPhysical;
+        node.size += m_Nodes[next].size;
+        node.nextPhysical = m_Nodes[next].nextPhysical;
+        if (node.nextPhysical != INVALID_HANDLE) m_Nodes[node.nextPhysical].previousPhysical = p_Node;
+        m_Nodes[next] = Node();
+        m_Nodes[next].isFree = true; // Until reused, so that a second Free() of its handle throws
+        m_FreeNodes.push_back(next);
+    }
+};
+
+// Bump allocator for transient and per-frame data, released all at once with Reset()
+class LinearAllocator
+{
+public:
+    static constexpr uint64_t INVALID_OFFSET = UINT64_MAX;
+
+    explicit LinearAllocator(uint64_t p_Size = 0) : m_Size(p_Size) {}
+
+    uint64_t Allocate(uint64_t p_Size, uint64_t p_Alignment = 1)
+    {
+        const uint64_t offset = AlignUp(m_Offset, std::max<uint64_t>(p_Alignment, 1));
+        if ((offset > m_Size) || (p_Size > m_Size - offset)) return INVALID_OFFSET;
+        m_Offset = offset + p_Size;
+        m_PeakOffset = std::max(m_PeakOffset, m_Offset);
+        return offset;
+    }
+
+    void Reset() { m_Offset = 0; }
+
+    uint64_t GetSize() const { return m_Size; }
+    uint64_t GetUsedBytes() const { return m_Offset; }
+    uint64_t GetPeakBytes() const { return m_PeakOffset; } // Highest use since creation, to size the arena
+
+private:
+    uint64_t m_Size;
+    uint64_t m_Offset = 0;
+    uint64_t m_PeakOffset = 0;
+};
+
+// Fixed-size slots, for many objects of the same size
+class PoolAllocator
+{
+public:
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+
+    explicit PoolAllocator(uint32_t p_SlotCount = 0)
+    {
+        m_FreeSlots.reserve(p_SlotCount);
+        for (uint32_t slot = p_SlotCount; slot > 0; slot--) m_FreeSlots.push_back(slot - 1); // Lowest slots first
+        m_IsUsed.assign(p_SlotCount, false);
+    }
+
+    uint32_t Allocate()
+    {
+        if (m_FreeSlots.empty()) return INVALID_SLOT;
+        const uint32_t slot = m_FreeSlots.back();
+        m_FreeSlots.pop_back();
+        m_IsUsed[slot] = true;
+        return slot;
+    }
+
+    void Free(uint32_t p_Slot)
+    {
+        if ((p_Slot >= m_IsUsed.size()) || !m_IsUsed[p_Slot]) throw std::logic_error("Invalid or double free of a pool slot.");
+        m_IsUsed[p_Slot] = false;
+        m_FreeSlots.push_back(p_Slot);
+    }
+
+    uint32_t GetSlotCount() const { return static_cast<uint32_t>(m_IsUsed.size()); }
+    uint32_t GetUsedSlotCount() const { return GetSlotCount() - static_cast<uint32_t>(m_FreeSlots.size()); }
+
+private:
+    std::vector<uint32_t> m_FreeSlots;
+    std::vector<bool> m_IsUsed;
+};
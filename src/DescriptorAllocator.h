@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+// Descriptor sets that live for one frame. Each frame in flight has its own pools that sets are allocated from
+// linearly, and BeginFrame() resets them in bulk once the frame slot is free again instead of freeing sets one by
+// one. When a pool runs out the next one is used, created the first time, so after a few frames allocation never
+// creates pools. Only the main thread allocates.
+class FrameDescriptorAllocator
+{
+public:
+    void Initialize(vk::Device p_Device, uint32_t p_FramesInFlight, const std::vector<vk::DescriptorPoolSize>& p_PoolSizes, uint32_t p_MaxSetsPerPool)
+    {
+        m_Device = p_Device;
+        m_PoolSizes = p_PoolSizes;
+        m_MaxSetsPerPool = p_MaxSetsPerPool;
+        m_FrameSlots.resize(p_FramesInFlight);
+    }
+
+    void Uninitialize()
+    {
+        for (FrameSlot& frameSlot : m_FrameSlots)
+        {
+            for (vk::DescriptorPool pool : frameSlot.pools) m_Device.destroyDescriptorPool(pool);
+        }
+        m_FrameSlots.clear();
+    }
+
+    // The previous frame of the slot must be complete
+    void BeginFrame(size_t p_FrameSlot)
+    {
+        m_pCurrent = &m_FrameSlots[p_FrameSlot];
+        for (size_t i = 0; i <= m_pCurrent->currentPool && i < m_pCurrent->pools.size(); i++)
+        {
+            m_Device.resetDescriptorPool(m_pCurrent->pools[i]);
+        }
+        m_pCurrent->currentPool = 0;
+        m_PoolAllocationCount = 0;
+        m_FrameAllocationCount = 0;
+    }
+
+    vk::DescriptorSet Allocate(vk::DescriptorSetLayout p_Layout)
+    {
+        vk::DescriptorSetAllocateInfo allocInfo;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &p_Layout;
+
+        while (true)
+        {
+            if (m_pCurrent->currentPool == m_pCurrent->pools.size()) m_pCurrent->pools.push_back(CreatePool());
+            allocInfo.descriptorPool = m_pCurrent->pools[m_pCurrent->currentPool];
+
+            vk::DescriptorSet set;
+            const vk::Result result = m_Device.allocateDescriptorSets(&allocInfo, &set);
+            if (result == vk::Result::eSuccess)
+            {
+                m_PoolAllocationCount++;
+                m_FrameAllocationCount++;
+                m_AllocationCount++;
+                return set;
+            }
+            if ((result != vk::Result::eErrorOutOfPoolMemory) && (result != vk::Result::eErrorFragmentedPool))
+            {
+                throw std::runtime_error("Failed to allocate a descriptor set: " + vk::to_string(result));
+            }
+
+            // An empty pool that can't hold the set never will
+            if (m_PoolAllocationCount == 0) throw std::runtime_error("Descriptor set layout doesn't fit in a frame descriptor pool.");
+            m_pCurrent->currentPool++;
+            m_PoolAllocationCount = 0;
+        }
+    }
+
+    // Sets allocated since BeginFrame()
+    uint32_t GetFrameAllocationCount() const { return m_FrameAllocationCount; }
+
+    void LogStats() const
+    {
+        size_t poolCount = 0;
+        for (const FrameSlot& frameSlot : m_FrameSlots) poolCount += frameSlot.pools.size();
+        std::cerr << "Frame descriptors: " << m_AllocationCount << " set(s) allocated, " << poolCount << " pool(s) of "
+            << m_MaxSetsPerPool << " sets over " << m_FrameSlots.size() << " frame(s) in flight" << std::endl;
+    }
+
+private:
+    struct FrameSlot
+    {
+        std::vector<vk::DescriptorPool> pools;
+        size_t currentPool = 0; // Pools before it are full
+    };
+
+    vk::Device m_Device;
+    std::vector<vk::DescriptorPoolSize> m_PoolSizes;
+    uint32_t m_MaxSetsPerPool = 0;
+    std::vector<FrameSlot> m_FrameSlots;
+    FrameSlot* m_pCurrent = nullptr;
+    uint32_t m_PoolAllocationCount = 0; // From the current pool
+    uint32_t m_FrameAllocationCount = 0;
+    uint64_t m_AllocationCount = 0;
+
+    vk::DescriptorPool CreatePool()
+    {
+        // No eFreeDescriptorSet, sets are only ever released by resetting the pool
+        vk::DescriptorPoolCreateInfo createInfo;
+        createInfo.maxSets = m_MaxSetsPerPool;
+        createInfo.poolSizeCount = static_cast<uint32_t>(m_PoolSizes.size());
+        createInfo.pPoolSizes = m_PoolSizes.data();
+        return m_Device.createDescriptorPool(createInfo);
+    }
+};
+
+// Global descriptor set with every texture and storage buffer, bound once per command buffer. Resources are added
+// once and shaders index them with the integer Add*() returned, so draws never rebind sets. The bindings are
+// partially bound and update-after-bind (Vulkan 1.2 descriptor indexing): adding a resource doesn't invalidate
+// command buffers that bound the set, as long as they don't use that slot. A removed slot is only reused by a later
+// Add*(), the caller must not remove a resource frames in flight still read.
+class BindlessTable
+{
+public:
+    static constexpr uint32_t TEXTURE_BINDING = 0; // Combined image samplers
+    static constexpr uint32_t BUFFER_BINDING = 1; // Storage buffers
+
+    void Initialize(vk::Device p_Device, uint32_t p_MaxTextures, uint32_t p_MaxBuffers)
+    {
+        m_Device = p_Device;
+        m_MaxTextures = p_MaxTextures;
+        m_MaxBuffers = p_MaxBuffers;
+
+        const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute;
+        const vk::DescriptorSetLayoutBinding bindings[] = {
+            vk::DescriptorSetLayoutBinding(TEXTURE_BINDING, vk::DescriptorType::eCombinedImageSampler, p_MaxTextures, stages),
+            vk::DescriptorSetLayoutBinding(BUFFER_BINDING, vk::DescriptorType::eStorageBuffer, p_MaxBuffers, stages),
+        };
+        const vk::DescriptorBindingFlags bindingFlags[] = {
+            vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
+            vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
+        };
+
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo;
+        bindingFlagsInfo.bindingCount = 2;
+        bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+        vk::DescriptorSetLayoutCreateInfo layoutInfo;
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+        layoutInfo.bindingCount = 2;
+        layoutInfo.pBindings = bindings;
+        m_Layout = m_Device.createDescriptorSetLayout(layoutInfo);
+
+        const vk::DescriptorPoolSize poolSizes[] = {
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, p_MaxTextures),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, p_MaxBuffers),
+        };
+        vk::DescriptorPoolCreateInfo poolInfo;
+        poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 2;
+        poolInfo.pPoolSizes = poolSizes;
+        m_Pool = m_Device.createDescriptorPool(poolInfo);
+
+        vk::DescriptorSetAllocateInfo allocInfo;
+        allocInfo.descriptorPool = m_Pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_Layout;
+        m_Set = m_Device.allocateDescriptorSets(allocInfo)[0];
+    }
+
+    void Uninitialize()
+    {
+        m_Device.destroyDescriptorPool(m_Pool);
+        m_Device.destroyDescriptorSetLayout(m_Layout);
+    }
+
+    uint32_t AddTexture(vk::ImageView p_ImageView, vk::Sampler p_Sampler, vk::ImageLayout p_Layout = vk::ImageLayout::eShaderReadOnlyOptimal)
+    {
+        const uint32_t index = AllocateSlot(m_FreeTextures, m_TextureCount, m_MaxTextures, "texture");
+        const vk::DescriptorImageInfo imageInfo(p_Sampler, p_ImageView, p_Layout);
+        vk::WriteDescriptorSet write(m_Set, TEXTURE_BINDING, index, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo);
+        m_Device.updateDescriptorSets({ write }, {});
+        return index;
+    }
+
+    uint32_t AddBuffer(vk::Buffer p_Buffer, vk::DeviceSize p_Offset = 0, vk::DeviceSize p_Range = VK_WHOLE_SIZE)
+    {
+        const uint32_t index = AllocateSlot(m_FreeBuffers, m_BufferCount, m_MaxBuffers, "buffer");
+        const vk::DescriptorBufferInfo bufferInfo(p_Buffer, p_Offset, p_Range);
+        vk::WriteDescriptorSet write(m_Set, BUFFER_BINDING, index, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfo);
+        m_Device.updateDescriptorSets({ write }, {});
+        return index;
+    }
+
+    void RemoveTexture(uint32_t p_Index) { m_FreeTextures.push_back(p_Index); }
+    void RemoveBuffer(uint32_t p_Index) { m_FreeBuffers.push_back(p_Index); }
+
+    vk::DescriptorSetLayout GetLayout() const { return m_Layout; }
+    vk::DescriptorSet GetSet() const { return m_Set; }
+
+private:
+    vk::Device m_Device;
+    vk::DescriptorSetLayout m_Layout;
+    vk::DescriptorPool m_Pool;
+    vk::DescriptorSet m_Set;
+
+    uint32_t m_MaxTextures = 0;
+    uint32_t m_MaxBuffers = 0;
+    uint32_t m_TextureCount = 0; // Slots ever used, the free lists hold the removed ones
+    uint32_t m_BufferCount = 0;
+    std::vector<uint32_t> m_FreeTextures;
+    std::vector<uint32_t> m_FreeBuffers;
+
+    static uint32_t AllocateSlot(std::vector<uint32_t>& p_FreeSlots, uint32_t& p_UsedCount, uint32_t p_MaxCount, const char* p_pKind)
+    {
+        if (!p_FreeSlots.empty())
+        {
+            const uint32_t index = p_FreeSlots.back();
+            p_FreeSlots.pop_back();
+            return index;
+        }
+        if (p_UsedCount == p_MaxCount) throw std::runtime_error(std::string("The bindless table is out of ") + p_pKind + " slots.");
+        return p_UsedCount++;
+    }
+};
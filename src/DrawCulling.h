@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "DescriptorAllocator.h"
+#include "MemoryAllocator.h"
+#include "RenderGraph.h"
+#include "Resource.h"
+#include "StagingRing.h"
+
+enum class CullingMode
+{
+    None, // Every draw is recorded on the CPU
+    Cpu,  // Culled on the CPU into indirect commands, for devices without indirect count and for validation
+    Gpu,  // Culled by a compute pass into indirect commands and counts
+};
+
+inline const char* GetCullingModeName(CullingMode p_Mode)
+{
+    switch (p_Mode)
+    {
+    case CullingMode::Cpu: return "cpu";
+    case CullingMode::Gpu: return "gpu";
+    default: return "none";
+    }
+}
+
+// One object of the scene, as read by resources/cull.comp (std430). Its indirect command draws one instance whose
+// gl_InstanceIndex is the object's index.
+struct CullObject
+{
+    float boundingSphere[4]; // World-space center and radius
+    uint32_t batch; // Objects of a batch share a pipeline, a range of the command buffer and a draw count
+    uint32_t firstCommand; // Of the batch's range
+    uint32_t indexCount;
+    uint32_t padding;
+};
+
+// World-space planes with inward normals: a point p is inside if dot(plane.xyz, p) + plane.w >= 0
+struct CullFrustum
+{
+    static constexpr uint32_t PLANE_COUNT = 4; // The scene is flat, only the side planes cull
+
+    float planes[PLANE_COUNT][4];
+};
+
+// Frustum culling of the scene's objects into compacted indirect draw commands, one range and one count per batch,
+// so that each batch is one drawIndexedIndirectCount(). With CullingMode::Gpu a compute pass of the render graph
+// tests every bounding sphere and appends the visible ones with an atomic counter; the counts are read back when
+// the frame slot comes around again. CullingMode::Cpu runs the same test with the same float operations on the
+// CPU and draws the commands with drawIndexedIndirect(), or one draw each without multiDrawIndirect, so the two
+// draw the same objects. Only the order within a batch differs, the GPU appends in any order. The shader computes
+// the plane distances with precise, unfused operations; a C++ compiler allowed to contract them into FMAs (such as
+// GCC with -mfma) may still disagree on spheres that just touch a plane.
+class DrawCuller
+{
+public:
+    struct Features
+    {
+        bool drawIndirectCount = false; // Vulkan 1.2 drawIndirectCount
+        bool multiDrawIndirect = false; // multiDrawIndirect and drawIndirectFirstInstance
+    };
+
+    // Falls back to CullingMode::Cpu if the device can't draw GPU-written counts. p_Objects must be grouped by
+    // batch, with firstCommand the index of the batch's first object. With p_Validate the GPU results are checked
+    // against the CPU ones.
+    void Initialize(vk::Device p_Device, DeviceMemoryAllocator& p_Allocator, StagingRing& p_StagingRing, BindlessTable& p_BindlessTable,
+        vk::PipelineCache p_PipelineCache, const Resource& p_Shader, CullingMode p_Mode, const Features& p_Features, uint32_t p_FramesInFlight,
+        const std::vector<CullObject>& p_Objects, bool p_Validate)
+    {
+        m_Device = p_Device;
+        m_pAllocator = &p_Allocator;
+        m_pBindlessTable = &p_BindlessTable;
+        m_Features = p_Features;
+        m_Mode = p_Mode;
+        m_Objects = p_Objects;
+        m_IsValidating = p_Validate && (p_Mode == CullingMode::Gpu);
+        if ((m_Mode == CullingMode::Gpu) && (!m_Features.drawIndirectCount || !m_Features.multiDrawIndirect))
+        {
+            std::cerr << "Draw culling: drawIndirectCount or multiDrawIndirect is unsupported, culling on the CPU" << std::endl;
+            m_Mode = CullingMode::Cpu;
+            m_IsValidating = false;
+        }
+
+        for (const CullObject& object : m_Objects)
+        {
+            if (object.batch >= m_Batches.size()) m_Batches.resize(object.batch + 1, { object.firstCommand, 0 });
+            m_Batches[object.batch].drawCount++;
+        }
+        m_Commands.resize(m_Objects.size());
+        m_Counts.assign(m_Batches.size(), 0);
+        m_FrameSlots.resize(p_FramesInFlight);
+
+        vk::BufferCreateInfo createInfo;
+        createInfo.sharingMode = vk::SharingMode::eExclusive;
+        const vk::DeviceSize commandsSize = std::max<vk::DeviceSize>(m_Objects.size(), 1) * sizeof(vk::DrawIndexedIndirectCommand);
+        const vk::DeviceSize countsSize = std::max<vk::DeviceSize>(m_Batches.size(), 1) * sizeof(uint32_t);
+        if (m_Mode == CullingMode::Cpu)
+        {
+            // A partition of commands per frame in flight, written by the CPU
+            createInfo.size = commandsSize * p_FramesInFlight;
+            createInfo.usage = vk::BufferUsageFlagBits::eIndirectBuffer;
+            m_CommandBuffer = m_pAllocator->CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, m_CommandAllocation);
+            m_PartitionSize = commandsSize;
+            return;
+        }
+
+        createInfo.size = std::max<vk::DeviceSize>(m_Objects.size(), 1) * sizeof(CullObject);
+        createInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+        m_ObjectBuffer = m_pAllocator->CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_ObjectAllocation);
+        if (!m_Objects.empty() && !p_StagingRing.Upload(m_ObjectBuffer, 0, m_Objects.data(), m_Objects.size() * sizeof(CullObject)))
+            throw std::runtime_error("The staging ring is too small for the culling objects.");
+
+        createInfo.size = commandsSize;
+        createInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer;
+        m_CommandBuffer = m_pAllocator->CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_CommandAllocation);
+        createInfo.size = countsSize;
+        createInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+            vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc;
+        m_CountBuffer = m_pAllocator->CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_CountAllocation);
+
+        // A partition of counts per frame in flight, copied back for the statistics and the validation
+        createInfo.size = countsSize * p_FramesInFlight;
+        createInfo.usage = vk::BufferUsageFlagBits::eTransferDst;
+        m_ReadbackBuffer = m_pAllocator->CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, m_ReadbackAllocation);
+        m_PartitionSize = countsSize;
+
+        m_ObjectBufferIndex = m_pBindlessTable->AddBuffer(m_ObjectBuffer);
+        m_CommandBufferIndex = m_pBindlessTable->AddBuffer(m_CommandBuffer);
+        m_CountBufferIndex = m_pBindlessTable->AddBuffer(m_CountBuffer);
+        CreatePipeline(p_PipelineCache, p_Shader);
+    }
+
+    void Uninitialize()
+    {
+        if (m_Pipeline) m_Device.destroyPipeline(m_Pipeline);
+        if (m_PipelineLayout) m_Device.destroyPipelineLayout(m_PipelineLayout);
+        if (m_ObjectBuffer)
+        {
+            m_pBindlessTable->RemoveBuffer(m_ObjectBufferIndex);
+            m_pBindlessTable->RemoveBuffer(m_CommandBufferIndex);
+            m_pBindlessTable->RemoveBuffer(m_CountBufferIndex);
+        }
+        m_pAllocator->DestroyBuffer(m_ObjectBuffer, m_ObjectAllocation);
+        m_pAllocator->DestroyBuffer(m_CommandBuffer, m_CommandAllocation);
+        m_pAllocator->DestroyBuffer(m_CountBuffer, m_CountAllocation);
+        m_pAllocator->DestroyBuffer(m_ReadbackBuffer, m_ReadbackAllocation);
+    }
+
+    bool IsEnabled() const { return m_Mode != CullingMode::None; }
+    CullingMode GetMode() const { return m_Mode; }
+    uint32_t GetBatchCount() const { return static_cast<uint32_t>(m_Batches.size()); }
+
+    // Visible objects of the latest frame whose result is known: this frame's on the CPU, the one that last used the
+    // frame slot on the GPU
+    uint32_t GetVisibleCount() const { return m_VisibleCount; }
+
+    // Must be called once per submitted frame, when the previous submission of the frame slot is complete
+    void BeginFrame(size_t p_FrameSlot, const CullFrustum& p_Frustum)
+    {
+        m_FrameSlot = p_FrameSlot;
+        FrameSlot& frameSlot = m_FrameSlots[p_FrameSlot];
+        if (m_Mode == CullingMode::Gpu)
+        {
+            if (frameSlot.isSubmitted) ReadBack(frameSlot);
+        }
+        else
+        {
+            m_VisibleCount = CullObjects(m_Objects, p_Frustum, m_Commands.data(), m_Counts.data(), GetBatchCount());
+            if (m_Features.multiDrawIndirect)
+            {
+                memcpy(m_CommandAllocation.pMapped + p_FrameSlot * m_PartitionSize, m_Commands.data(), m_Commands.size() * sizeof(vk::DrawIndexedIndirectCommand));
+            }
+        }
+        frameSlot.frustum = p_Frustum;
+        frameSlot.isSubmitted = true;
+        m_VisibleSum += m_VisibleCount;
+        m_FrameCount++;
+    }
+
+    // GPU culling: clears the counts, culls, and copies the counts to the frame slot's readback partition. The
+    // compute work runs on the graphics queue, in the frame's command buffer, so the graph orders it with the draws.
+    void AddPasses(RenderGraph& p_Graph)
+    {
+        if (m_Mode != CullingMode::Gpu) return;
+
+        m_CommandHandle = p_Graph.ImportBuffer("draw_commands", m_CommandBuffer);
+        m_CountHandle = p_Graph.ImportBuffer("draw_counts", m_CountBuffer);
+        const RenderGraph::BufferHandle counts = m_CountHandle;
+        const vk::PipelineStageFlags computeStage = vk::PipelineStageFlagBits::eComputeShader;
+
+        p_Graph.AddPass("clear_draw_counts")
+            .WriteBuffer(counts, RenderGraph::BufferUsage::TransferDst())
+            .SetExecute([this](const RenderGraph::PassContext& p_Context) {
+                p_Context.commandBuffer.fillBuffer(m_CountBuffer, 0, VK_WHOLE_SIZE, 0);
+            });
+
+        p_Graph.AddPass("cull_draws")
+            .WriteBuffer(m_CommandHandle, RenderGraph::BufferUsage::ShaderWrite(computeStage))
+            .WriteBuffer(counts, RenderGraph::BufferUsage::ShaderWrite(computeStage))
+            .SetExecute([this](const RenderGraph::PassContext& p_Context) { RecordCulling(p_Context.commandBuffer); });
+
+        p_Graph.AddPass("read_draw_counts")
+            .ReadBuffer(counts, RenderGraph::BufferUsage::TransferSrc())
+            .SetSideEffects()
+            .SetExecute([this](const RenderGraph::PassContext& p_Context) {
+                const vk::BufferCopy region(0, m_FrameSlot * m_PartitionSize, m_Batches.size() * sizeof(uint32_t));
+                p_Context.commandBuffer.copyBuffer(m_CountBuffer, m_ReadbackBuffer, { region });
+                // Made visible to the host, which reads them once the frame timeline shows the frame complete
+                vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+                p_Context.commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), { barrier }, nullptr, nullptr);
+            });
+    }
+
+    // Declares the indirect reads of the pass that calls RecordDraws()
+    void ReadDraws(RenderGraph::Pass& p_Pass) const
+    {
+        if (m_Mode != CullingMode::Gpu) return;
+        p_Pass.ReadBuffer(m_CommandHandle, RenderGraph::BufferUsage::IndirectRead());
+        p_Pass.ReadBuffer(m_CountHandle, RenderGraph::BufferUsage::IndirectRead());
+    }
+
+    // Draws the visible objects of p_Batch, with its pipeline bound
+    void RecordDraws(vk::CommandBuffer p_CommandBuffer, uint32_t p_Batch) const
+    {
+        const Batch& batch = m_Batches[p_Batch];
+        const vk::DeviceSize stride = sizeof(vk::DrawIndexedIndirectCommand);
+        if (m_Mode == CullingMode::Gpu)
+        {
+            p_CommandBuffer.drawIndexedIndirectCount(m_CommandBuffer, batch.firstCommand * stride, m_CountBuffer, p_Batch * sizeof(uint32_t),
+                batch.drawCount, static_cast<uint32_t>(stride));
+            return;
+        }
+
+        const uint32_t count = m_Counts[p_Batch];
+        if (count == 0) return;
+        if (m_Features.multiDrawIndirect)
+        {
+            p_CommandBuffer.drawIndexedIndirect(m_CommandBuffer, m_FrameSlot * m_PartitionSize + batch.firstCommand * stride, count, static_cast<uint32_t>(stride));
+            return;
+        }
+        for (uint32_t i = batch.firstCommand; i < batch.firstCommand + count; i++)
+        {
+            const vk::DrawIndexedIndirectCommand& command = m_Commands[i];
+            p_CommandBuffer.drawIndexed(command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+        }
+    }
+
+    // Same test as resources/cull.comp
+    static bool IsVisible(const CullObject& p_Object, const CullFrustum& p_Frustum)
+    {
+        const float* pSphere = p_Object.boundingSphere;
+        for (const float* pPlane : p_Frustum.planes)
+        {
+            if (pPlane[0] * pSphere[0] + pPlane[1] * pSphere[1] + pPlane[2] * pSphere[2] + pPlane[3] < -pSphere[3]) return false;
+        }
+        return true;
+    }
+
+    // Compacts the commands of the visible objects at the start of their batch's range, counted in p_pCounts.
+    // Returns the number of visible objects.
+    static uint32_t CullObjects(const std::vector<CullObject>& p_Objects, const CullFrustum& p_Frustum, vk::DrawIndexedIndirectCommand* p_pCommands,
+        uint32_t* p_pCounts, uint32_t p_BatchCount)
+    {
+        std::fill(p_pCounts, p_pCounts + p_BatchCount, 0u);
+        uint32_t visibleCount = 0;
+        for (size_t i = 0; i < p_Objects.size(); i++)
+        {
+            const CullObject& object = p_Objects[i];
+            if (!IsVisible(object, p_Frustum)) continue;
+            p_pCommands[object.firstCommand + p_pCounts[object.batch]++] = vk::DrawIndexedIndirectCommand(object.indexCount, 1, 0, 0, static_cast<uint32_t>(i));
+            visibleCount++;
+        }
+        return visibleCount;
+    }
+
+    void LogStats() const
+    {
+        if (!IsEnabled()) return;
+        std::cerr << "Draw culling: " << GetCullingModeName(m_Mode) << ", " << m_Objects.size() << " object(s) in " << m_Batches.size() << " batch(es), "
+            << (m_FrameCount ? m_VisibleSum / m_FrameCount : 0) << " visible per frame on average";
+        if (m_IsValidating) std::cerr << ", " << m_ValidatedCount << " frame(s) validated against the CPU, " << m_MismatchCount << " mismatch(es)";
+        std::cerr << std::endl;
+    }
+
+private:
+    // Push constants of resources/cull.comp
+    struct CullParameters
+    {
+        float frustumPlanes[CullFrustum::PLANE_COUNT][4];
+        uint32_t objectCount;
+        uint32_t objectBuffer; // Bindless table indices
+        uint32_t commandBuffer;
+        uint32_t countBuffer;
+    };
+
+    struct Batch
+    {
+        uint32_t firstCommand;
+        uint32_t drawCount; // Objects of the batch, the most it may draw
+    };
+
+    struct FrameSlot
+    {
+        CullFrustum frustum = {}; // Of the frame last submitted in the slot
+        bool isSubmitted = false;
+    };
+
+    static constexpr uint32_t WORKGROUP_SIZE = 64; // local_size_x of resources/cull.comp
+    static constexpr uint64_t MAX_LOGGED_MISMATCHES = 8;
+
+    vk::Device m_Device;
+    DeviceMemoryAllocator* m_pAllocator = nullptr;
+    BindlessTable* m_pBindlessTable = nullptr;
+    Features m_Features;
+    CullingMode m_Mode = CullingMode::None;
+    bool m_IsValidating = false;
+
+    std::vector<CullObject> m_Objects;
+    std::vector<Batch> m_Batches;
+    std::vector<vk::DrawIndexedIndirectCommand> m_Commands; // Of the CPU culling
+    std::vector<uint32_t> m_Counts; // Of the CPU culling, per batch
+    std::vector<FrameSlot> m_FrameSlots;
+    size_t m_FrameSlot = 0;
+
+    vk::Buffer m_ObjectBuffer;
+    MemoryAllocation m_ObjectAllocation;
+    vk::Buffer m_CommandBuffer; // Device-local on the GPU path, host-visible partitions on the CPU path
+    MemoryAllocation m_CommandAllocation;
+    vk::Buffer m_CountBuffer;
+    MemoryAllocation m_CountAllocation;
+    vk::Buffer m_ReadbackBuffer;
+    MemoryAllocation m_ReadbackAllocation;
+    vk::DeviceSize m_PartitionSize = 0; // Per frame in flight, of m_CommandBuffer on the CPU path and m_ReadbackBuffer on the GPU path
+    uint32_t m_ObjectBufferIndex = 0;
+    uint32_t m_CommandBufferIndex = 0;
+    uint32_t m_CountBufferIndex = 0;
+    RenderGraph::BufferHandle m_CommandHandle = 0;
+    RenderGraph::BufferHandle m_CountHandle = 0;
+
+    vk::PipelineLayout m_PipelineLayout;
+    vk::Pipeline m_Pipeline;
+
+    uint32_t m_VisibleCount = 0;
+    uint64_t m_VisibleSum = 0;
+    uint64_t m_FrameCount = 0;
+    uint64_t m_ValidatedCount = 0;
+    uint64_t m_MismatchCount = 0;
+
+    void CreatePipeline(vk::PipelineCache p_PipelineCache, const Resource& p_Shader)
+    {
+        const vk::DescriptorSetLayout setLayout = m_pBindlessTable->GetLayout();
+        const vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullParameters));
+        vk::PipelineLayoutCreateInfo layoutInfo;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &setLayout;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstantRange;
+        m_PipelineLayout = m_Device.createPipelineLayout(layoutInfo);
+
+        const ResourceView<uint32_t> code = p_Shader.As<uint32_t>();
+        vk::ShaderModuleCreateInfo moduleInfo;
+        moduleInfo.codeSize = code.SizeInBytes();
+        moduleInfo.pCode = code.Data();
+        const vk::ShaderModule module = m_Device.createShaderModule(moduleInfo);
+
+        vk::ComputePipelineCreateInfo pipelineInfo;
+        pipelineInfo.stage = vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eCompute, module, "main");
+        pipelineInfo.layout = m_PipelineLayout;
+        m_Pipeline = m_Device.createComputePipeline(p_PipelineCache, pipelineInfo);
+        m_Device.destroyShaderModule(module);
+    }
+
+    void RecordCulling(vk::CommandBuffer p_CommandBuffer) const
+    {
+        CullParameters parameters;
+        memcpy(parameters.frustumPlanes, m_FrameSlots[m_FrameSlot].frustum.planes, sizeof(parameters.frustumPlanes));
+        parameters.objectCount = static_cast<uint32_t>(m_Objects.size());
+        parameters.objectBuffer = m_ObjectBufferIndex;
+        parameters.commandBuffer = m_CommandBufferIndex;
+        parameters.countBuffer = m_CountBufferIndex;
+
+        p_CommandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_Pipeline);
+        p_CommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_PipelineLayout, 0, { m_pBindlessTable->GetSet() }, {});
+        p_CommandBuffer.pushConstants(m_PipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(parameters), &parameters);
+        p_CommandBuffer.dispatch((parameters.objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+    }
+
+    // The counts the GPU wrote for the frame last submitted in the slot, checked against the CPU with its frustum
+    void ReadBack(const FrameSlot& p_FrameSlot)
+    {
+        const uint8_t* pCounts = m_ReadbackAllocation.pMapped + m_FrameSlot * m_PartitionSize;
+        uint32_t visibleCount = 0;
+        for (size_t i = 0; i < m_Batches.size(); i++)
+        {
+            uint32_t count;
+            memcpy(&count, pCounts + i * sizeof(uint32_t), sizeof(count));
+            visibleCount += count;
+        }
+        m_VisibleCount = visibleCount;
+        if (!m_IsValidating) return;
+
+        CullObjects(m_Objects, p_FrameSlot.frustum, m_Commands.data(), m_Counts.data(), GetBatchCount());
+        m_ValidatedCount++;
+        for (uint32_t i = 0; i < GetBatchCount(); i++)
+        {
+            uint32_t count;
+            memcpy(&count, pCounts + i * sizeof(uint32_t), sizeof(count));
+            if (count == m_Counts[i]) continue;
+
+            if (m_MismatchCount < MAX_LOGGED_MISMATCHES)
+            {
+                std::cerr << "Draw culling: batch " << i << " has " << count << " visible object(s) on the GPU and " << m_Counts[i] << " on the CPU" << std::endl;
+            }
+            m_MismatchCount++;
+        }
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.hpp>
+
+// Paces frames with one timeline semaphore (Vulkan 1.2). Frame N signals the value N when its submission completes,
+// so the frame slot of frame N can be reused once the value N - framesInFlight has been reached. That replaces a
+// fence per frame slot, their resets and the per-image fences: BeginFrame() reads the counter once and only blocks
+// when the GPU is a whole frame slot behind. Other users of the queue (e.g. the staging ring) tag their work with
+// the value of the frame it was submitted with.
+class FramePacer
+{
+public:
+    void Initialize(vk::Device p_Device, uint32_t p_FramesInFlight)
+    {
+        m_Device = p_Device;
+        m_FramesInFlight = p_FramesInFlight;
+
+        vk::SemaphoreTypeCreateInfo typeInfo;
+        typeInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+        typeInfo.initialValue = 0;
+
+        vk::SemaphoreCreateInfo createInfo;
+        createInfo.pNext = &typeInfo;
+        m_Semaphore = m_Device.createSemaphore(createInfo);
+    }
+
+    void Uninitialize()
+    {
+        m_Device.destroySemaphore(m_Semaphore);
+    }
+
+    // Waits until the frame slot of the next frame is free. Returns the value of the last completed frame.
+    uint64_t BeginFrame()
+    {
+        const uint64_t frameValue = m_SubmittedValue + 1;
+        m_CompletedValue = m_Device.getSemaphoreCounterValue(m_Semaphore);
+        m_QueuedFrameSum += m_SubmittedValue - m_CompletedValue;
+        m_FrameCount++;
+
+        if ((frameValue > m_FramesInFlight) && (m_CompletedValue + m_FramesInFlight < frameValue))
+        {
+            Wait(frameValue - m_FramesInFlight);
+            m_BlockedFrameCount++;
+        }
+        return m_CompletedValue;
+    }
+
+    void Wait(uint64_t p_Value)
+    {
+        if (p_Value <= m_CompletedValue) return;
+
+        vk::SemaphoreWaitInfo waitInfo;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &m_Semaphore;
+        waitInfo.pValues = &p_Value;
+        if (m_Device.waitSemaphores(waitInfo, UINT64_MAX) != vk::Result::eSuccess) throw std::runtime_error("Failed to wait for the frame timeline.");
+        m_CompletedValue = p_Value;
+        m_WaitCount++;
+    }
+
+    // Value the submission of the current frame must signal
+    uint64_t GetFrameValue() const { return m_SubmittedValue + 1; }
+    size_t GetFrameSlot() const { return static_cast<size_t>(m_SubmittedValue % m_FramesInFlight); }
+    uint32_t GetFramesInFlight() const { return m_FramesInFlight; }
+    vk::Semaphore GetSemaphore() const { return m_Semaphore; }
+
+    // Called once the current frame has been submitted, signaling GetFrameValue()
+    void Submitted()
+    {
+        m_SubmittedValue++;
+    }
+
+    void LogStats() const
+    {
+        if (m_FrameCount == 0) return;
+        std::cerr << "Frame pacing: " << m_FramesInFlight << " frame(s) in flight, " << (double(m_QueuedFrameSum) / m_FrameCount)
+            << " frames queued on the GPU on average when a frame started, " << (100.0 * m_BlockedFrameCount / m_FrameCount)
+            << "% of frames waited for a frame slot, " << (double(m_WaitCount) / m_FrameCount) << " blocking waits per frame" << std::endl;
+    }
+
+private:
+    vk::Device m_Device;
+    vk::Semaphore m_Semaphore;
+    uint32_t m_FramesInFlight = 2;
+    uint64_t m_SubmittedValue = 0;
+    uint64_t m_CompletedValue = 0; // Last value known to be reached, may lag the counter
+
+    uint64_t m_FrameCount = 0;
+    uint64_t m_QueuedFrameSum = 0; // How far behind the GPU was, summed over frames, measures CPU-GPU overlap
+    uint64_t m_BlockedFrameCount = 0;
+    uint64_t m_WaitCount = 0;
+};
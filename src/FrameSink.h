@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+
+// Destination of the rendered frames. The render loop acquires an image from the sink, records into it and hands
+// it back with Present(). SwapChainFrameSink presents to a window surface, OffscreenFrameSink renders into a ring
+// of device-local images so the app can run on machines without a display.
+class FrameSink
+{
+public:
+    virtual ~FrameSink() = default;
+
+    virtual void Uninitialize(vk::Device p_Device) = 0;
+
+    // Sets p_ImageIndex to the next image to render into. If UsesSemaphores() is true the sink signals
+    // p_ImageAvailable once the image can be written, and Present() waits on p_RenderFinished. Both return false
+    // when the sink no longer matches its surface and must be recreated, Acquire() without acquiring an image.
+    virtual bool AcquireNextImage(vk::Semaphore p_ImageAvailable, uint32_t& p_ImageIndex) = 0;
+    virtual bool Present(uint32_t p_ImageIndex, vk::Semaphore p_RenderFinished) = 0;
+    virtual bool UsesSemaphores() const = 0;
+
+    // Replaces the images with ones of p_DesiredExtent. The previous ones may still be in use by submitted frames up
+    // to the frame timeline value p_RetireValue, DestroyRetired() destroys them once that value has been reached.
+    virtual void Recreate(vk::Extent2D /*p_DesiredExtent*/, uint64_t /*p_RetireValue*/) {}
+    virtual void DestroyRetired(uint64_t /*p_CompletedValue*/) {}
+
+    // Layout the frame leaves the image in
+    virtual vk::ImageLayout GetFinalLayout() const = 0;
+
+    vk::Format GetFormat() const { return m_Format; }
+    vk::Extent2D GetExtent() const { return m_Extent; }
+    vk::ImageUsageFlags GetImageUsage() const { return m_ImageUsage; }
+    const std::vector<vk::Image>& GetImages() const { return m_Images; }
+    const std::vector<vk::ImageView>& GetImageViews() const { return m_ImageViews; }
+
+protected:
+    vk::Format m_Format = vk::Format::eUndefined;
+    vk::Extent2D m_Extent;
+    vk::ImageUsageFlags m_ImageUsage;
+    std::vector<vk::Image> m_Images;
+    std::vector<vk::ImageView> m_ImageViews;
+
+    void CreateImageViews(vk::Device p_Device)
+    {
+        for (const vk::Image& image : m_Images)
+        {
+            vk::ImageViewCreateInfo createInfo;
+            createInfo.image = image;
+            createInfo.viewType = vk::ImageViewType::e2D;
+            createInfo.format = m_Format;
+            createInfo.components.r = vk::ComponentSwizzle::eIdentity;
+            createInfo.components.g = vk::ComponentSwizzle::eIdentity;
+            createInfo.components.b = vk::ComponentSwizzle::eIdentity;
+            createInfo.components.a = vk::ComponentSwizzle::eIdentity;
+            createInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+            createInfo.subresourceRange.baseMipLevel = 0;
+            createInfo.subresourceRange.levelCount = 1;
+            createInfo.subresourceRange.baseArrayLayer = 0;
+            createInfo.subresourceRange.layerCount = 1;
+
+            m_ImageViews.push_back(p_Device.createImageView(createInfo));
+        }
+    }
+
+    void DestroyImageViews(vk::Device p_Device)
+    {
+        for (auto& imageView : m_ImageViews) p_Device.destroyImageView(imageView);
+        m_ImageViews.clear();
+    }
+};
+
+inline const char* GetPresentModeName(vk::PresentModeKHR p_PresentMode)
+{
+    switch (p_PresentMode)
+    {
+    case vk::PresentModeKHR::eImmediate: return "immediate";
+    case vk::PresentModeKHR::eMailbox: return "mailbox";
+    case vk::PresentModeKHR::eFifo: return "fifo";
+    case vk::PresentModeKHR::eFifoRelaxed: return "fifo-relaxed";
+    default: return "other";
+    }
+}
+
+class SwapChainFrameSink : public FrameSink
+{
+public:
+    // p_PresentMode is used if the surface supports it, FIFO otherwise, which every surface supports
+    void Initialize(vk::PhysicalDevice p_PhysicalDevice, vk::Device p_Device, vk::SurfaceKHR p_Surface, vk::Queue p_PresentQueue,
+        uint32_t p_GraphicsFamily, uint32_t p_PresentFamily, vk::PresentModeKHR p_PresentMode, vk::Extent2D p_DesiredExtent)
+    {
+        m_PhysicalDevice = p_PhysicalDevice;
+        m_Device = p_Device;
+        m_Surface = p_Surface;
+        m_PresentQueue = p_PresentQueue;
+        m_GraphicsFamily = p_GraphicsFamily;
+        m_PresentFamily = p_PresentFamily;
+
+        // Surface format
+        std::optional<vk::SurfaceFormatKHR> surfaceFormat;
+        const std::vector<vk::SurfaceFormatKHR> formats = p_PhysicalDevice.getSurfaceFormatsKHR(p_Surface);
+        for (const auto& format : formats) {
+            if ((format.format == vk::Format::eB8G8R8A8Unorm) && (format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear)) {
+                surfaceFormat = format;
+            }
+        }
+        if (!surfaceFormat.has_value() && !formats.empty()) surfaceFormat = formats[0];
+        if (!surfaceFormat.has_value()) throw std::runtime_error("Failed to find suitable surface format.");
+        m_Format = surfaceFormat.value().format;
+        m_ColorSpace = surfaceFormat.value().colorSpace;
+
+        const std::vector<vk::PresentModeKHR> presentModes = p_PhysicalDevice.getSurfacePresentModesKHR(p_Surface);
+        const bool isSupported = std::find(presentModes.begin(), presentModes.end(), p_PresentMode) != presentModes.end();
+        m_PresentMode = isSupported ? p_PresentMode : vk::PresentModeKHR::eFifo;
+        if (!isSupported) std::cerr << "Present mode " << GetPresentModeName(p_PresentMode) << " isn't supported, using fifo." << std::endl;
+
+        CreateSwapChain(p_DesiredExtent);
+    }
+
+    void Uninitialize(vk::Device p_Device) override
+    {
+        DestroyRetired(UINT64_MAX);
+        DestroyImageViews(p_Device);
+        m_Images.clear(); // No need to destroy, we didn't create them
+
+        p_Device.destroySwapchainKHR(m_SwapChain);
+    }
+
+    bool AcquireNextImage(vk::Semaphore p_ImageAvailable, uint32_t& p_ImageIndex) override
+    {
+        try
+        {
+            const vk::ResultValue<uint32_t> result = m_Device.acquireNextImageKHR(m_SwapChain, UINT64_MAX, p_ImageAvailable, vk::Fence());
+            p_ImageIndex = result.value;
+            // A suboptimal image is still acquired and the semaphore signaled, Present() reports it
+            m_IsSuboptimal = (result.result == vk::Result::eSuboptimalKHR);
+            return true;
+        }
+        catch (const vk::OutOfDateKHRError&)
+        {
+            return false;
+        }
+    }
+
+    bool Present(uint32_t p_ImageIndex, vk::Semaphore p_RenderFinished) override
+    {
+        vk::PresentInfoKHR presentInfo;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &p_RenderFinished;
+
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &m_SwapChain;
+        presentInfo.pImageIndices = &p_ImageIndex;
+
+        try
+        {
+            return (m_PresentQueue.presentKHR(presentInfo) == vk::Result::eSuccess) && !m_IsSuboptimal;
+        }
+        catch (const vk::OutOfDateKHRError&)
+        {
+            return false;
+        }
+    }
+
+    // The new swapchain is created from the old one, which only retires it: images it already handed out stay
+    // valid and the device doesn't have to go idle
+    void Recreate(vk::Extent2D p_DesiredExtent, uint64_t p_RetireValue) override
+    {
+        RetiredSwapChain retired;
+        retired.swapChain = m_SwapChain;
+        retired.imageViews = std::move(m_ImageViews);
+        retired.retireValue = p_RetireValue;
+        m_Retired.push_back(std::move(retired));
+
+        m_Images.clear();
+        m_ImageViews.clear();
+        CreateSwapChain(p_DesiredExtent, m_Retired.back().swapChain);
+    }
+
+    void DestroyRetired(uint64_t p_CompletedValue) override
+    {
+        while (!m_Retired.empty() && (m_Retired.front().retireValue <= p_CompletedValue))
+        {
+            for (vk::ImageView imageView : m_Retired.front().imageViews) m_Device.destroyImageView(imageView);
+            m_Device.destroySwapchainKHR(m_Retired.front().swapChain);
+            m_Retired.pop_front();
+        }
+    }
+
+    bool UsesSemaphores() const override { return true; }
+    vk::ImageLayout GetFinalLayout() const override { return vk::ImageLayout::ePresentSrcKHR; }
+    vk::PresentModeKHR GetPresentMode() const { return m_PresentMode; }
+
+private:
+    struct RetiredSwapChain
+    {
+        vk::SwapchainKHR swapChain;
+        std::vector<vk::ImageView> imageViews;
+        uint64_t retireValue = 0;
+    };
+
+    vk::PhysicalDevice m_PhysicalDevice;
+    vk::Device m_Device;
+    vk::SurfaceKHR m_Surface;
+    vk::Queue m_PresentQueue;
+    uint32_t m_GraphicsFamily = 0;
+    uint32_t m_PresentFamily = 0;
+    vk::ColorSpaceKHR m_ColorSpace = vk::ColorSpaceKHR::eSrgbNonlinear;
+    vk::PresentModeKHR m_PresentMode = vk::PresentModeKHR::eFifo;
+    vk::SwapchainKHR m_SwapChain;
+    bool m_IsSuboptimal = false;
+    std::deque<RetiredSwapChain> m_Retired;
+
+    void CreateSwapChain(vk::Extent2D p_DesiredExtent, vk::SwapchainKHR p_OldSwapChain = vk::SwapchainKHR())
+    {
+        // ROI of the Window
+        const vk::SurfaceCapabilitiesKHR capabilities = m_PhysicalDevice.getSurfaceCapabilitiesKHR(m_Surface);
+        const vk::Extent2D extent = (capabilities.currentExtent.width != UINT32_MAX) ?
+            capabilities.currentExtent :
+            vk::Extent2D(std::clamp(p_DesiredExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
+                std::clamp(p_DesiredExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height));
+
+        // Chain length: FIFO queues every image, one more than the minimum lets the CPU run a frame ahead
+        uint32_t imageCount = capabilities.minImageCount + 1;
+        if (capabilities.maxImageCount > 0) imageCount = std::min(imageCount, capabilities.maxImageCount);
+
+        vk::SwapchainCreateInfoKHR createInfo;
+        createInfo.surface = m_Surface;
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = m_Format;
+        createInfo.imageColorSpace = m_ColorSpace;
+        createInfo.imageExtent = extent;
+        createInfo.imageArrayLayers = 1; // Mono, 2 for stereo
+        // Render graph passes may also blit to the image
+        createInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment | (capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst);
+        createInfo.preTransform = capabilities.currentTransform; // No transform
+        createInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque; // Ignore alpha when compositing window
+        createInfo.presentMode = m_PresentMode;
+        createInfo.clipped = VK_TRUE;
+        createInfo.oldSwapchain = p_OldSwapChain;
+
+        createInfo.imageSharingMode = vk::SharingMode::eExclusive;
+        uint32_t queueFamilyIndices[] = { m_GraphicsFamily, m_PresentFamily };
+        if (m_GraphicsFamily != m_PresentFamily) {
+            createInfo.imageSharingMode = vk::SharingMode::eConcurrent;
+            createInfo.queueFamilyIndexCount = 2;
+            createInfo.pQueueFamilyIndices = queueFamilyIndices;
+        }
+
+        m_SwapChain = m_Device.createSwapchainKHR(createInfo);
+        m_Extent = createInfo.imageExtent;
+        m_ImageUsage = createInfo.imageUsage;
+        m_IsSuboptimal = false;
+
+        // Get images and image views
+        for (const vk::Image& image : m_Device.getSwapchainImagesKHR(m_SwapChain)) m_Images.push_back(image);
+        CreateImageViews(m_Device);
+    }
+};
+
+// Renders into a ring of device-local color images that are never presented. Images are handed out round-robin
+// and the GPU writes them in submission order. The images end up in TransferSrcOptimal so they can be read back
+// for regression testing.
+class OffscreenFrameSink : public FrameSink
+{
+public:
+    void Initialize(DeviceMemoryAllocator& p_Allocator, vk::Format p_Format, vk::Extent2D p_Extent, uint32_t p_ImageCount)
+    {
+        m_pAllocator = &p_Allocator;
+        m_Format = p_Format;
+        m_Extent = p_Extent;
+        m_ImageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+
+        for (uint32_t i = 0; i < p_ImageCount; i++)
+        {
+            vk::ImageCreateInfo createInfo;
+            createInfo.imageType = vk::ImageType::e2D;
+            createInfo.format = m_Format;
+            createInfo.extent = vk::Extent3D(m_Extent.width, m_Extent.height, 1);
+            createInfo.mipLevels = 1;
+            createInfo.arrayLayers = 1;
+            createInfo.samples = vk::SampleCountFlagBits::e1;
+            createInfo.tiling = vk::ImageTiling::eOptimal;
+            createInfo.usage = m_ImageUsage;
+            createInfo.sharingMode = vk::SharingMode::eExclusive;
+            createInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+            MemoryAllocation allocation;
+            m_Images.push_back(p_Allocator.CreateImage(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, allocation));
+            m_Allocations.push_back(allocation);
+        }
+
+        CreateImageViews(p_Allocator.GetDevice());
+    }
+
+    void Uninitialize(vk::Device p_Device) override
+    {
+        DestroyImageViews(p_Device);
+        for (size_t i = 0; i < m_Images.size(); i++) m_pAllocator->DestroyImage(m_Images[i], m_Allocations[i]);
+        m_Images.clear();
+        m_Allocations.clear();
+    }
+
+    bool AcquireNextImage(vk::Semaphore, uint32_t& p_ImageIndex) override
+    {
+        p_ImageIndex = m_NextImage;
+        m_NextImage = (m_NextImage + 1) % static_cast<uint32_t>(m_Images.size());
+        return true;
+    }
+
+    bool Present(uint32_t, vk::Semaphore) override
+    {
+        m_PresentedFrames++;
+        return true;
+    }
+
+    bool UsesSemaphores() const override { return false; }
+    vk::ImageLayout GetFinalLayout() const override { return vk::ImageLayout::eTransferSrcOptimal; }
+
+    uint64_t GetPresentedFrames() const { return m_PresentedFrames; }
+
+private:
+    DeviceMemoryAllocator* m_pAllocator = nullptr;
+    std::vector<MemoryAllocation> m_Allocations;
+    uint32_t m_NextImage = 0;
+    uint64_t m_PresentedFrames = 0;
+};
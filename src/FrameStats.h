@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum class FramePhase : uint32_t
+{
+    Wait,    // Waiting on the frame timeline for a free frame slot
+    Acquire, // Acquiring the image from the frame sink
+    Submit,  // Queue submission of the frame, signaling its frame timeline value, and of its uploads on a transfer queue
+    Present, // Handing the image back to the frame sink
+    Upload,  // Staging this frame's uploads and recording their copies
+    UploadLatency, // From the submission of uploads to the frame that observes their completion
+    Record,  // Recording the frame's command buffers, draws on every recording thread
+    Limit,   // Frame limiter sleep before input sampling, outside of DrawFrame()
+    InputLatency, // From input sampling (after glfwPollEvents) to the return of the present call
+    Cpu,     // Whole DrawFrame() on the CPU
+    Gpu,     // Render pass on the GPU, from timestamp queries
+    Count
+};
+
+constexpr size_t FRAME_PHASE_COUNT = static_cast<size_t>(FramePhase::Count);
+
+inline const char* GetFramePhaseName(FramePhase p_Phase)
+{
+    static const char* names[FRAME_PHASE_COUNT] = { "wait", "acquire", "submit", "present", "upload", "upload_latency", "record", "limit", "input_latency", "cpu", "gpu" };
+    return names[static_cast<size_t>(p_Phase)];
+}
+
+// Per-frame event counts, summarized like the phases
+enum class FrameCounter : uint32_t
+{
+    DescriptorAllocations, // Descriptor sets allocated for the frame
+    DescriptorBinds,       // Descriptor set binds recorded for the frame
+    UniformBytes,          // Bytes written to the uniform ring for the frame
+    UniformOverflows,      // Uniform ring allocations that didn't fit
+    GraphBarriers,         // Image and buffer barriers recorded by the render graph
+    TransientKilobytes,    // Memory of the render graph's transient images, aliased
+    VisibleDraws,          // Draws that passed the culling, known a few frames late when culled on the GPU
+    SceneNodesUpdated,     // Scene nodes whose world transform changed
+    StagingOverflows,      // Stream upload chunks that didn't fit in the staging ring, left for the next frame
+    Count
+};
+
+constexpr size_t FRAME_COUNTER_COUNT = static_cast<size_t>(FrameCounter::Count);
+
+inline const char* GetFrameCounterName(FrameCounter p_Counter)
+{
+    static const char* names[FRAME_COUNTER_COUNT] = { "descriptor_allocations", "descriptor_binds", "uniform_bytes", "uniform_overflows", "graph_barriers",
+        "transient_kilobytes", "visible_draws", "scene_nodes_updated", "staging_overflows" };
+    return names[static_cast<size_t>(p_Counter)];
+}
+
+struct FrameSample
+{
+    uint64_t frameIndex = 0;
+    std::array<float, FRAME_PHASE_COUNT> milliseconds{}; // Negative if the phase wasn't measured
+    std::array<uint32_t, FRAME_COUNTER_COUNT> counts{};
+};
+
+// Fixed-size ring written by a single producer without locks. Readers may run on any thread: Snapshot() re-reads
+// the write counter after copying and drops the entries the producer may have overwritten meanwhile.
+template <typename T, size_t Capacity>
+class SampleRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    void Push(const T& p_Sample)
+    {
+        const uint64_t index = m_WriteCount.load(std::memory_order_relaxed);
+        m_Samples[index & (Capacity - 1)] = p_Sample;
+        m_WriteCount.store(index + 1, std::memory_order_release);
+    }
+
+    std::vector<T> Snapshot() const
+    {
+        const uint64_t end = m_WriteCount.load(std::memory_order_acquire);
+        const uint64_t begin = (end > Capacity) ? (end - Capacity) : 0;
+
+        std::vector<T> samples;
+        samples.reserve(static_cast<size_t>(end - begin));
+        for (uint64_t i = begin; i < end; i++) samples.push_back(m_Samples[i & (Capacity - 1)]);
+
+        // The producer may be writing index endAfterCopy, whose slot is that of endAfterCopy - Capacity
+        const uint64_t endAfterCopy = m_WriteCount.load(std::memory_order_acquire);
+        const uint64_t firstValid = (endAfterCopy >= Capacity) ? (endAfterCopy - Capacity + 1) : 0;
+        if (firstValid > begin) samples.erase(samples.begin(), samples.begin() + static_cast<ptrdiff_t>(std::min(firstValid - begin, end - begin)));
+
+        return samples;
+    }
+
+    uint64_t GetWriteCount() const { return m_WriteCount.load(std::memory_order_acquire); }
+
+private:
+    std::array<T, Capacity> m_Samples;
+    std::atomic<uint64_t> m_WriteCount{ 0 };
+};
+
+// Intervals between successive Tick() calls. Their standard deviation is the jitter: a steady 16 ms cadence has none,
+// alternating 8 and 24 ms frames have 8 ms of it for the same average. Always on, it costs a clock read per frame.
+class IntervalStats
+{
+public:
+    void Tick(std::chrono::steady_clock::time_point p_Time)
+    {
+        if (m_Count++ > 0)
+        {
+            const double milliseconds = std::chrono::duration<double, std::milli>(p_Time - m_Previous).count();
+            m_Sum += milliseconds;
+            m_SquareSum += milliseconds * milliseconds;
+            m_Max = std::max(m_Max, milliseconds);
+        }
+        m_Previous = p_Time;
+    }
+
+    void Log(const char* p_pName) const
+    {
+        if (m_Count < 2) return;
+        const double mean = m_Sum / (m_Count - 1);
+        const double deviation = std::sqrt(std::max(0.0, m_SquareSum / (m_Count - 1) - mean * mean));
+        std::cerr << p_pName << ": " << mean << " ms per frame on average, " << deviation << " ms jitter (standard deviation), " << m_Max << " ms max" << std::endl;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_Previous;
+    uint64_t m_Count = 0;
+    double m_Sum = 0.0;
+    double m_SquareSum = 0.0;
+    double m_Max = 0.0;
+};
+
+// Per-phase frame timings. When disabled every call returns after a single branch, so the instrumentation can
+// stay in the render loop. Statistics are written as JSON, or CSV if the output path ends in ".csv". Frames are
+// recorded by the render thread; Dump() and DumpIfDue() only read the sample ring and may run on another thread.
+class FrameStats
+{
+public:
+    static constexpr size_t RING_CAPACITY = 4096;
+
+    void Initialize(const std::string& p_OutputPath, uint32_t p_DumpInterval)
+    {
+        m_OutputPath = p_OutputPath;
+        m_DumpInterval = p_DumpInterval;
+        m_NextDumpFrameCount = p_DumpInterval;
+        m_Enabled = !m_OutputPath.empty();
+    }
+
+    bool IsEnabled() const { return m_Enabled; }
+
+    void BeginFrame(uint64_t p_FrameIndex)
+    {
+        if (!m_Enabled) return;
+        m_Current = FrameSample();
+        m_Current.milliseconds.fill(-1.0f);
+        m_Current.frameIndex = p_FrameIndex;
+        m_FrameStart = m_PhaseStart = Clock::now();
+    }
+
+    // Closes the phase that started at the previous mark. A phase marked several times in a frame accumulates.
+    void Mark(FramePhase p_Phase)
+    {
+        if (!m_Enabled) return;
+        const auto now = Clock::now();
+        float& milliseconds = m_Current.milliseconds[static_cast<size_t>(p_Phase)];
+        milliseconds = std::max(milliseconds, 0.0f) + std::chrono::duration<float, std::milli>(now - m_PhaseStart).count();
+        m_PhaseStart = now;
+    }
+
+    // Restarts the phase timer without attributing the elapsed time to any phase
+    void Skip()
+    {
+        if (!m_Enabled) return;
+        m_PhaseStart = Clock::now();
+    }
+
+    void SetMilliseconds(FramePhase p_Phase, float p_Milliseconds)
+    {
+        if (!m_Enabled) return;
+        m_Current.milliseconds[static_cast<size_t>(p_Phase)] = p_Milliseconds;
+    }
+
+    void Count(FrameCounter p_Counter, uint32_t p_Count)
+    {
+        if (!m_Enabled) return;
+        m_Current.counts[static_cast<size_t>(p_Counter)] += p_Count;
+    }
+
+    void EndFrame()
+    {
+        if (!m_Enabled) return;
+        m_Current.milliseconds[static_cast<size_t>(FramePhase::Cpu)] = std::chrono::duration<float, std::milli>(Clock::now() - m_FrameStart).count();
+        m_Samples.Push(m_Current);
+    }
+
+    // Dumps the statistics once another interval of frames has been recorded. Called from a single thread, which
+    // isn't the render thread so that sorting the samples and writing the file doesn't delay a frame.
+    void DumpIfDue()
+    {
+        if (!m_Enabled || (m_DumpInterval == 0)) return;
+        const uint64_t frameCount = m_Samples.GetWriteCount();
+        if (frameCount < m_NextDumpFrameCount) return;
+        Dump();
+        m_NextDumpFrameCount = (frameCount / m_DumpInterval + 1) * m_DumpInterval;
+    }
+
+    void Dump() const
+    {
+        if (!m_Enabled) return;
+
+        const std::vector<FrameSample> samples = m_Samples.Snapshot();
+        std::array<Summary, FRAME_PHASE_COUNT> summaries;
+        for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+        {
+            std::vector<float> values;
+            for (const FrameSample& sample : samples)
+            {
+                if (sample.milliseconds[phase] >= 0.0f) values.push_back(sample.milliseconds[phase]);
+            }
+            summaries[phase] = Summarize(values);
+        }
+        std::array<Summary, FRAME_COUNTER_COUNT> counterSummaries;
+        for (size_t counter = 0; counter < FRAME_COUNTER_COUNT; counter++)
+        {
+            std::vector<float> values;
+            for (const FrameSample& sample : samples) values.push_back(static_cast<float>(sample.counts[counter]));
+            counterSummaries[counter] = Summarize(values);
+        }
+
+        std::ofstream outputFile(m_OutputPath, std::ios::out | std::ios::trunc);
+        if (!outputFile)
+        {
+            std::cerr << "Failed to open stats file \"" << m_OutputPath << "\"." << std::endl;
+            return;
+        }
+        outputFile << std::fixed << std::setprecision(4);
+
+        const bool isCsv = (m_OutputPath.size() >= 4) && (m_OutputPath.compare(m_OutputPath.size() - 4, 4, ".csv") == 0);
+        if (isCsv)
+        {
+            outputFile << "phase,count,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,max_ms" << std::endl;
+            for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+            {
+                const Summary& s = summaries[phase];
+                outputFile << GetFramePhaseName(static_cast<FramePhase>(phase)) << "," << s.count << "," << s.min << "," << s.mean << ","
+                    << s.p50 << "," << s.p95 << "," << s.p99 << "," << s.max << std::endl;
+            }
+            outputFile << std::endl << "counter,count,min,mean,p50,p95,p99,max" << std::endl;
+            for (size_t counter = 0; counter < FRAME_COUNTER_COUNT; counter++)
+            {
+                const Summary& s = counterSummaries[counter];
+                outputFile << GetFrameCounterName(static_cast<FrameCounter>(counter)) << "," << s.count << "," << s.min << "," << s.mean << ","
+                    << s.p50 << "," << s.p95 << "," << s.p99 << "," << s.max << std::endl;
+            }
+        }
+        else
+        {
+            outputFile << "{" << std::endl;
+            outputFile << "  \"frames\": " << m_Samples.GetWriteCount() << "," << std::endl;
+            outputFile << "  \"samples\": " << samples.size() << "," << std::endl;
+            outputFile << "  \"phases\": {" << std::endl;
+            for (size_t phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+            {
+                const Summary& s = summaries[phase];
+                outputFile << "    \"" << GetFramePhaseName(static_cast<FramePhase>(phase)) << "\": { \"count\": " << s.count
+                    << ", \"min_ms\": " << s.min << ", \"mean_ms\": " << s.mean << ", \"p50_ms\": " << s.p50
+                    << ", \"p95_ms\": " << s.p95 << ", \"p99_ms\": " << s.p99 << ", \"max_ms\": " << s.max << " }"
+                    << ((phase + 1 < FRAME_PHASE_COUNT) ? "," : "") << std::endl;
+            }
+            outputFile << "  }," << std::endl;
+            outputFile << "  \"counters\": {" << std::endl;
+            for (size_t counter = 0; counter < FRAME_COUNTER_COUNT; counter++)
+            {
+                const Summary& s = counterSummaries[counter];
+                outputFile << "    \"" << GetFrameCounterName(static_cast<FrameCounter>(counter)) << "\": { \"count\": " << s.count
+                    << ", \"min\": " << s.min << ", \"mean\": " << s.mean << ", \"p50\": " << s.p50
+                    << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << " }"
+                    << ((counter + 1 < FRAME_COUNTER_COUNT) ? "," : "") << std::endl;
+            }
+            outputFile << "  }" << std::endl;
+            outputFile << "}" << std::endl;
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Summary
+    {
+        size_t count = 0;
+        float min = 0.0f, mean = 0.0f, p50 = 0.0f, p95 = 0.0f, p99 = 0.0f, max = 0.0f;
+    };
+
+    bool m_Enabled = false;
+    std::string m_OutputPath;
+    uint32_t m_DumpInterval = 0;
+    uint64_t m_NextDumpFrameCount = 0; // Only used by the thread calling DumpIfDue()
+
+    SampleRing<FrameSample, RING_CAPACITY> m_Samples;
+    FrameSample m_Current;
+    Clock::time_point m_FrameStart;
+    Clock::time_point m_PhaseStart;
+
+    // Sorts the values in place
+    static Summary Summarize(std::vector<float>& p_Values)
+    {
+        Summary summary;
+        if (p_Values.empty()) return summary;
+        std::sort(p_Values.begin(), p_Values.end());
+
+        // Nearest-rank percentile
+        auto percentile = [&](float p_Percent) {
+            const size_t rank = static_cast<size_t>(p_Percent / 100.0f * static_cast<float>(p_Values.size()) + 0.5f);
+            return p_Values[std::min(p_Values.size() - 1, rank > 0 ? rank - 1 : 0)];
+        };
+
+        double sum = 0.0;
+        for (float value : p_Values) sum += value;
+
+        summary.count = p_Values.size();
+        summary.min = p_Values.front();
+        summary.max = p_Values.back();
+        summary.mean = static_cast<float>(sum / static_cast<double>(p_Values.size()));
+        summary.p50 = percentile(50.0f);
+        summary.p95 = percentile(95.0f);
+        summary.p99 = percentile(99.0f);
+        return summary;
+    }
+};
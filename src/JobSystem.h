@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of worker threads with one job deque each. A thread pops its own jobs from the back and, once its deque is
+// empty, steals from the front of the others, so uneven jobs balance themselves. The thread that calls
+// ParallelFor() runs jobs too, with the last thread index. ParallelFor() must only be called from one thread.
+class JobSystem
+{
+public:
+    // Called with a range of indices and the index of the thread running it, in [0, GetThreadCount())
+    using RangeFunction = std::function<void(uint32_t p_Begin, uint32_t p_End, uint32_t p_ThreadIndex)>;
+
+    JobSystem() = default;
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem()
+    {
+        Uninitialize();
+    }
+
+    void Initialize(uint32_t p_ThreadCount)
+    {
+        const uint32_t threadCount = std::max(p_ThreadCount, 1u);
+        for (uint32_t i = 0; i < threadCount; i++) m_Queues.push_back(std::make_unique<WorkQueue>());
+        m_IsStopping = false;
+        for (uint32_t i = 0; i + 1 < threadCount; i++) m_Workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+
+    void Uninitialize()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_WakeMutex);
+            m_IsStopping = true;
+        }
+        m_WakeCondition.notify_all();
+        for (std::thread& worker : m_Workers) worker.join();
+        m_Workers.clear();
+        m_Queues.clear();
+    }
+
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Queues.size()); }
+
+    // Splits [0, p_Count) in ranges of p_Grain indices and returns once they have all run. If jobs throw, the first
+    // exception is rethrown once every job has finished.
+    void ParallelFor(uint32_t p_Count, uint32_t p_Grain, const RangeFunction& p_Function)
+    {
+        if (p_Count == 0) return;
+        p_Grain = std::max(p_Grain, 1u);
+
+        const uint32_t jobCount = (p_Count + p_Grain - 1) / p_Grain;
+        Batch batch;
+        batch.remainingJobs = jobCount;
+
+        // Counted before they are published, a worker that pops one right away must not take the count below zero
+        {
+            std::lock_guard<std::mutex> lock(m_WakeMutex);
+            m_QueuedJobCount += jobCount;
+        }
+        for (uint32_t job = 0; job < jobCount; job++)
+        {
+            WorkQueue& queue = *m_Queues[job % m_Queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back({ &p_Function, job * p_Grain, std::min(p_Count, (job + 1) * p_Grain), &batch });
+        }
+        m_WakeCondition.notify_all();
+
+        const uint32_t callerIndex = GetThreadCount() - 1;
+        while (batch.remainingJobs.load(std::memory_order_acquire) > 0)
+        {
+            if (!RunJob(callerIndex)) std::this_thread::yield(); // The last jobs are running on workers
+        }
+        if (batch.exception) std::rethrow_exception(batch.exception);
+    }
+
+private:
+    // The jobs of one ParallelFor() call
+    struct Batch
+    {
+        std::atomic<uint32_t> remainingJobs{ 0 };
+        std::mutex exceptionMutex;
+        std::exception_ptr exception; // First one thrown by a job, guarded by exceptionMutex
+    };
+
+    struct Job
+    {
+        const RangeFunction* pFunction;
+        uint32_t begin;
+        uint32_t end;
+        Batch* pBatch;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> m_Queues; // One per thread, the last one belongs to the caller
+    std::vector<std::thread> m_Workers;
+
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeCondition;
+    uint32_t m_QueuedJobCount = 0; // Guarded by m_WakeMutex
+    bool m_IsStopping = false;
+
+    bool PopJob(uint32_t p_ThreadIndex, Job& p_Job)
+    {
+        const uint32_t queueCount = static_cast<uint32_t>(m_Queues.size());
+        for (uint32_t i = 0; i < queueCount; i++)
+        {
+            WorkQueue& queue = *m_Queues[(p_ThreadIndex + i) % queueCount];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty()) continue;
+
+            // Own jobs from the back, stolen ones from the front
+            if (i == 0)
+            {
+                p_Job = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                p_Job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool RunJob(uint32_t p_ThreadIndex)
+    {
+        Job job;
+        if (!PopJob(p_ThreadIndex, job)) return false;
+        {
+            std::lock_guard<std::mutex> lock(m_WakeMutex);
+            m_QueuedJobCount--;
+        }
+
+        // An exception must neither escape a worker nor leave the batch short of a job
+        try
+        {
+            (*job.pFunction)(job.begin, job.end, p_ThreadIndex);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(job.pBatch->exceptionMutex);
+            if (!job.pBatch->exception) job.pBatch->exception = std::current_exception();
+        }
+        job.pBatch->remainingJobs.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    void WorkerLoop(uint32_t p_ThreadIndex)
+    {
+        while (true)
+        {
+            if (RunJob(p_ThreadIndex)) continue;
+
+            std::unique_lock<std::mutex> lock(m_WakeMutex);
+            m_WakeCondition.wait(lock, [this]() { return m_IsStopping || (m_QueuedJobCount > 0); });
+            if (m_IsStopping) return;
+        }
+    }
+};
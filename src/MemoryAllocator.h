@@ -0,0 +1,425 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "AllocationStrategies.h"
+
+// Sub-allocation of device memory: buffers and images are placed in vk::DeviceMemory blocks with the strategies of
+// AllocationStrategies.h.
+
+// Buffers and linear images must not share a bufferImageGranularity page with optimal images
+enum class ResourceTiling
+{
+    Linear,
+    Optimal,
+};
+
+struct MemoryAllocation
+{
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    uint8_t* pMapped = nullptr; // Persistently mapped pointer to offset, null unless the memory is host visible
+    uint32_t memoryType = 0;
+    uint32_t block = 0;
+    uint32_t handle = TlsfAllocator::INVALID_HANDLE;
+
+    bool IsValid() const { return handle != TlsfAllocator::INVALID_HANDLE; }
+};
+
+struct MemoryStats
+{
+    uint64_t blockBytes = 0; // Allocated from the device
+    uint64_t usedBytes = 0; // Handed out to resources
+    uint64_t largestFreeRange = 0;
+    uint64_t freeRangeBytes = 0;
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRangeCount = 0;
+
+    // 0 when the free memory is one range, close to 1 when it is scattered in many small ones
+    double GetFragmentation() const
+    {
+        return (freeRangeBytes > 0) ? 1.0 - double(largestFreeRange) / double(freeRangeBytes) : 0.0;
+    }
+};
+
+// Sub-allocates buffers and images out of large vk::DeviceMemory blocks, one list of blocks per memory type, so the
+// device allocation count stays far below maxMemoryAllocationCount. Requests larger than half a block get a block of
+// their own. Host-visible blocks are persistently mapped. Empty blocks are released, except the last one of a type.
+class DeviceMemoryAllocator
+{
+public:
+    void Initialize(vk::PhysicalDevice p_PhysicalDevice, vk::Device p_Device)
+    {
+        m_Device = p_Device;
+        m_MemoryProperties = p_PhysicalDevice.getMemoryProperties();
+
+        const vk::PhysicalDeviceLimits limits = p_PhysicalDevice.getProperties().limits;
+        m_BufferImageGranularity = limits.bufferImageGranularity;
+        m_MaxAllocationCount = limits.maxMemoryAllocationCount;
+
+        // Blocks of 256 MB, or an eighth of small heaps
+        for (uint32_t type = 0; type < m_MemoryProperties.memoryTypeCount; type++)
+        {
+            const vk::DeviceSize heapSize = m_MemoryProperties.memoryHeaps[m_MemoryProperties.memoryTypes[type].heapIndex].size;
+            m_BlockSizes[type] = std::min(DEFAULT_BLOCK_SIZE, AlignUp(std::max<vk::DeviceSize>(heapSize / 8, 1), MIN_BLOCK_ALIGNMENT));
+        }
+    }
+
+    void Uninitialize()
+    {
+        const MemoryStats stats = GetStats();
+        if (stats.allocationCount > 0) std::cerr << "DeviceMemoryAllocator: " << stats.allocationCount << " allocation(s) leaked." << std::endl;
+
+        for (auto& blocks : m_Blocks)
+        {
+            for (auto& pBlock : blocks)
+            {
+                if (pBlock) FreeBlock(*pBlock);
+            }
+            blocks.clear();
+        }
+    }
+
+    MemoryAllocation Allocate(const vk::MemoryRequirements& p_Requirements, vk::MemoryPropertyFlags p_RequiredFlags, ResourceTiling p_Tiling,
+        vk::MemoryPropertyFlags p_PreferredFlags = vk::MemoryPropertyFlags())
+    {
+        vk::DeviceSize size = p_Requirements.size;
+        vk::DeviceSize alignment = p_Requirements.alignment;
+        if (p_Tiling == ResourceTiling::Optimal)
+        {
+            // Whole granularity pages, so that no linear resource can share a page with the image
+            alignment = std::max(alignment, m_BufferImageGranularity);
+            size = AlignUp(size, m_BufferImageGranularity);
+        }
+
+        const uint32_t type = FindMemoryType(p_Requirements.memoryTypeBits, p_RequiredFlags, p_PreferredFlags);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::vector<std::unique_ptr<MemoryBlock>>& blocks = m_Blocks[type];
+
+        const bool isDedicated = size > m_BlockSizes[type] / 2;
+        if (!isDedicated)
+        {
+            for (uint32_t block = 0; block < blocks.size(); block++)
+            {
+                if (!blocks[block] || blocks[block]->isDedicated) continue;
+                const TlsfAllocator::Allocation allocation = blocks[block]->allocator.Allocate(size, alignment);
+                if (allocation.IsValid()) return MakeAllocation(type, block, allocation);
+            }
+        }
+
+        const uint32_t block = CreateBlock(type, isDedicated ? AlignUp(size, MIN_BLOCK_ALIGNMENT) : m_BlockSizes[type], isDedicated);
+        const TlsfAllocator::Allocation allocation = blocks[block]->allocator.Allocate(size, alignment);
+        if (!allocation.IsValid()) throw std::runtime_error("Failed to sub-allocate device memory.");
+        return MakeAllocation(type, block, allocation);
+    }
+
+    void Free(MemoryAllocation& p_Allocation)
+    {
+        if (!p_Allocation.IsValid()) return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::vector<std::unique_ptr<MemoryBlock>>& blocks = m_Blocks[p_Allocation.memoryType];
+        MemoryBlock& block = *blocks[p_Allocation.block];
+        block.allocator.Free(p_Allocation.handle);
+
+        if (block.allocator.IsEmpty())
+        {
+            const bool hasOtherBlock = std::any_of(blocks.begin(), blocks.end(),
+                [&](const std::unique_ptr<MemoryBlock>& p_pBlock) { return p_pBlock && (p_pBlock.get() != &block) && !p_pBlock->isDedicated; });
+            if (block.isDedicated || hasOtherBlock)
+            {
+                FreeBlock(block);
+                blocks[p_Allocation.block].reset();
+            }
+        }
+        p_Allocation = MemoryAllocation();
+    }
+
+    vk::Buffer CreateBuffer(const vk::BufferCreateInfo& p_CreateInfo, vk::MemoryPropertyFlags p_RequiredFlags, MemoryAllocation& p_Allocation,
+        vk::MemoryPropertyFlags p_PreferredFlags = vk::MemoryPropertyFlags())
+    {
+        const vk::Buffer buffer = m_Device.createBuffer(p_CreateInfo);
+        MemoryAllocation allocation;
+        try
+        {
+            allocation = Allocate(m_Device.getBufferMemoryRequirements(buffer), p_RequiredFlags, ResourceTiling::Linear, p_PreferredFlags);
+            m_Device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+        }
+        catch (...)
+        {
+            // Out of device memory or allocations, nothing is left behind
+            Free(allocation); // No-op if Allocate() threw
+            m_Device.destroyBuffer(buffer);
+            throw;
+        }
+        p_Allocation = allocation;
+        return buffer;
+    }
+
+    vk::Image CreateImage(const vk::ImageCreateInfo& p_CreateInfo, vk::MemoryPropertyFlags p_RequiredFlags, MemoryAllocation& p_Allocation)
+    {
+        const vk::Image image = m_Device.createImage(p_CreateInfo);
+        const ResourceTiling tiling = (p_CreateInfo.tiling == vk::ImageTiling::eLinear) ? ResourceTiling::Linear : ResourceTiling::Optimal;
+        MemoryAllocation allocation;
+        try
+        {
+            allocation = Allocate(m_Device.getImageMemoryRequirements(image), p_RequiredFlags, tiling);
+            m_Device.bindImageMemory(image, allocation.memory, allocation.offset);
+        }
+        catch (...)
+        {
+            Free(allocation); // No-op if Allocate() threw
+            m_Device.destroyImage(image);
+            throw;
+        }
+        p_Allocation = allocation;
+        return image;
+    }
+
+    void DestroyBuffer(vk::Buffer& p_Buffer, MemoryAllocation& p_Allocation)
+    {
+        if (p_Buffer) m_Device.destroyBuffer(p_Buffer);
+        p_Buffer = nullptr;
+        Free(p_Allocation);
+    }
+
+    void DestroyImage(vk::Image& p_Image, MemoryAllocation& p_Allocation)
+    {
+        if (p_Image) m_Device.destroyImage(p_Image);
+        p_Image = nullptr;
+        Free(p_Allocation);
+    }
+
+    // Prefers a type that also has p_PreferredFlags (e.g. device local for host-visible staging)
+    uint32_t FindMemoryType(uint32_t p_TypeBits, vk::MemoryPropertyFlags p_RequiredFlags, vk::MemoryPropertyFlags p_PreferredFlags = vk::MemoryPropertyFlags()) const
+    {
+        const vk::MemoryPropertyFlags preferredFlags = p_RequiredFlags | p_PreferredFlags;
+        for (vk::MemoryPropertyFlags flags : { preferredFlags, p_RequiredFlags })
+        {
+            for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+            {
+                if ((p_TypeBits & (1u << i)) && ((m_MemoryProperties.memoryTypes[i].propertyFlags & flags) == flags)) return i;
+            }
+        }
+        throw std::runtime_error("Failed to find a suitable memory type.");
+    }
+
+    bool IsHostCoherent(uint32_t p_MemoryType) const
+    {
+        return (m_MemoryProperties.memoryTypes[p_MemoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent) == vk::MemoryPropertyFlagBits::eHostCoherent;
+    }
+
+    vk::Device GetDevice() const { return m_Device; }
+
+    MemoryStats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        MemoryStats stats;
+        for (const auto& blocks : m_Blocks)
+        {
+            for (const auto& pBlock : blocks)
+            {
+                if (!pBlock) continue;
+                const TlsfAllocator::Stats blockStats = pBlock->allocator.GetStats();
+                stats.blockBytes += blockStats.size;
+                stats.usedBytes += blockStats.usedBytes;
+                stats.freeRangeBytes += blockStats.size - blockStats.usedBytes;
+                stats.largestFreeRange = std::max(stats.largestFreeRange, blockStats.largestFreeRange);
+                stats.blockCount++;
+                stats.allocationCount += blockStats.allocationCount;
+                stats.freeRangeCount += blockStats.freeRangeCount;
+            }
+        }
+        return stats;
+    }
+
+    void LogStats() const
+    {
+        const MemoryStats stats = GetStats();
+        std::cerr << "Device memory: " << stats.allocationCount << " allocation(s), " << (stats.usedBytes >> 10) << " KB used of "
+            << (stats.blockBytes >> 10) << " KB in " << stats.blockCount << " block(s) (limit " << m_MaxAllocationCount << "), "
+            << stats.freeRangeCount << " free range(s), largest " << (stats.largestFreeRange >> 10) << " KB, fragmentation "
+            << stats.GetFragmentation() << std::endl;
+    }
+
+private:
+    static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 256ull * 1024 * 1024;
+    static constexpr vk::DeviceSize MIN_BLOCK_ALIGNMENT = 64 * 1024;
+
+    struct MemoryBlock
+    {
+        vk::DeviceMemory memory;
+        TlsfAllocator allocator;
+        uint8_t* pMapped = nullptr;
+        bool isDedicated = false;
+    };
+
+    vk::Device m_Device;
+    vk::PhysicalDeviceMemoryProperties m_MemoryProperties;
+    vk::DeviceSize m_BufferImageGranularity = 1;
+    uint32_t m_MaxAllocationCount = 0;
+    uint32_t m_DeviceAllocationCount = 0;
+
+    mutable std::mutex m_Mutex;
+    vk::DeviceSize m_BlockSizes[VK_MAX_MEMORY_TYPES] = {};
+    std::vector<std::unique_ptr<MemoryBlock>> m_Blocks[VK_MAX_MEMORY_TYPES]; // Null entries are reused
+
+    uint32_t CreateBlock(uint32_t p_MemoryType, vk::DeviceSize p_Size, bool p_IsDedicated)
+    {
+        if (m_DeviceAllocationCount >= m_MaxAllocationCount) throw std::runtime_error("Reached maxMemoryAllocationCount.");
+
+        auto pBlock = std::make_unique<MemoryBlock>();
+        vk::MemoryAllocateInfo allocInfo;
+        allocInfo.allocationSize = p_Size;
+        allocInfo.memoryTypeIndex = p_MemoryType;
+        pBlock->memory = m_Device.allocateMemory(allocInfo);
+        pBlock->allocator.Reset(p_Size);
+        pBlock->isDedicated = p_IsDedicated;
+        m_DeviceAllocationCount++;
+
+        if (m_MemoryProperties.memoryTypes[p_MemoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        {
+            pBlock->pMapped = static_cast<uint8_t*>(m_Device.mapMemory(pBlock->memory, 0, VK_WHOLE_SIZE));
+        }
+
+        std::vector<std::unique_ptr<MemoryBlock>>& blocks = m_Blocks[p_MemoryType];
+        auto it = std::find(blocks.begin(), blocks.end(), nullptr);
+        if (it != blocks.end())
+        {
+            *it = std::move(pBlock);
+            return static_cast<uint32_t>(it - blocks.begin());
+        }
+        blocks.push_back(std::move(pBlock));
+        return static_cast<uint32_t>(blocks.size() - 1);
+    }
+
+    void FreeBlock(MemoryBlock& p_Block)
+    {
+        if (p_Block.pMapped) m_Device.unmapMemory(p_Block.memory);
+        m_Device.freeMemory(p_Block.memory);
+        m_DeviceAllocationCount--;
+    }
+
+    MemoryAllocation MakeAllocation(uint32_t p_MemoryType, uint32_t p_Block, const TlsfAllocator::Allocation& p_Allocation) const
+    {
+        const MemoryBlock& block = *m_Blocks[p_MemoryType][p_Block];
+        MemoryAllocation allocation;
+        allocation.memory = block.memory;
+        allocation.offset = p_Allocation.offset;
+        allocation.size = p_Allocation.size;
+        allocation.pMapped = block.pMapped ? block.pMapped + p_Allocation.offset : nullptr;
+        allocation.memoryType = p_MemoryType;
+        allocation.block = p_Block;
+        allocation.handle = p_Allocation.handle;
+        return allocation;
+    }
+};
+
+// Range of device memory handed out by the linear and pool strategies
+struct MemoryRange
+{
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    uint8_t* pMapped = nullptr;
+};
+
+// Linear strategy over one allocation, for transient and per-frame data: ranges are bumped out of it and all
+// released together by Reset(), typically once the frame that used them has completed
+class LinearMemoryArena
+{
+public:
+    void Initialize(DeviceMemoryAllocator& p_Allocator, vk::DeviceSize p_Size, uint32_t p_MemoryTypeBits, vk::MemoryPropertyFlags p_Flags)
+    {
+        vk::MemoryRequirements requirements;
+        requirements.size = p_Size;
+        requirements.alignment = 256; // Covers the offset alignment limits of every buffer usage
+        requirements.memoryTypeBits = p_MemoryTypeBits;
+        m_Allocation = p_Allocator.Allocate(requirements, p_Flags, ResourceTiling::Linear);
+        m_Allocator = LinearAllocator(p_Size);
+    }
+
+    void Uninitialize(DeviceMemoryAllocator& p_Allocator)
+    {
+        p_Allocator.Free(m_Allocation);
+    }
+
+    // Returns an empty range when the arena is full
+    MemoryRange Allocate(vk::DeviceSize p_Size, vk::DeviceSize p_Alignment)
+    {
+        MemoryRange range;
+        const uint64_t offset = m_Allocator.Allocate(p_Size, p_Alignment);
+        if (offset == LinearAllocator::INVALID_OFFSET) return range;
+
+        range.memory = m_Allocation.memory;
+        range.offset = m_Allocation.offset + offset;
+        range.size = p_Size;
+        range.pMapped = m_Allocation.pMapped ? m_Allocation.pMapped + offset : nullptr;
+        return range;
+    }
+
+    void Reset() { m_Allocator.Reset(); }
+
+    const LinearAllocator& GetAllocator() const { return m_Allocator; }
+
+private:
+    MemoryAllocation m_Allocation;
+    LinearAllocator m_Allocator;
+};
+
+// Pool strategy over one allocation: p_SlotCount slots of p_SlotSize bytes
+class MemoryPool
+{
+public:
+    void Initialize(DeviceMemoryAllocator& p_Allocator, vk::DeviceSize p_SlotSize, uint32_t p_SlotCount, uint32_t p_MemoryTypeBits,
+        vk::MemoryPropertyFlags p_Flags)
+    {
+        m_SlotSize = AlignUp(p_SlotSize, 256);
+
+        vk::MemoryRequirements requirements;
+        requirements.size = m_SlotSize * p_SlotCount;
+        requirements.alignment = 256;
+        requirements.memoryTypeBits = p_MemoryTypeBits;
+        m_Allocation = p_Allocator.Allocate(requirements, p_Flags, ResourceTiling::Linear);
+        m_Allocator = PoolAllocator(p_SlotCount);
+    }
+
+    void Uninitialize(DeviceMemoryAllocator& p_Allocator)
+    {
+        p_Allocator.Free(m_Allocation);
+    }
+
+    // Returns PoolAllocator::INVALID_SLOT when the pool is full
+    uint32_t Allocate() { return m_Allocator.Allocate(); }
+    void Free(uint32_t p_Slot) { m_Allocator.Free(p_Slot); }
+
+    MemoryRange GetRange(uint32_t p_Slot) const
+    {
+        MemoryRange range;
+        range.memory = m_Allocation.memory;
+        range.offset = m_Allocation.offset + p_Slot * m_SlotSize;
+        range.size = m_SlotSize;
+        range.pMapped = m_Allocation.pMapped ? m_Allocation.pMapped + p_Slot * m_SlotSize : nullptr;
+        return range;
+    }
+
+    const PoolAllocator& GetAllocator() const { return m_Allocator; }
+
+private:
+    MemoryAllocation m_Allocation;
+    PoolAllocator m_Allocator;
+    vk::DeviceSize m_SlotSize = 0;
+};
@@ -0,0 +1,240 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "AllocationStrategies.h"
+
+// Randomized allocate/free checks of AllocationStrategies.h: TlsfAllocator, LinearAllocator and PoolAllocator. Every
+// allocation must be aligned, inside the range and not overlap a live one, and freeing everything must leave the TLSF
+// range as a single free range again. Exits with a failure on the first broken check. Needs no Vulkan SDK.
+//
+// Usage: MemoryAllocatorTest [seed]
+
+namespace
+{
+    constexpr uint32_t OPERATION_COUNT = 200000;
+    constexpr uint64_t TLSF_SIZE = 64 * 1024 * 1024;
+
+    void Check(bool p_Condition, const std::string& p_Message)
+    {
+        if (!p_Condition) throw std::runtime_error(p_Message);
+    }
+
+    uint64_t RandomAlignment(std::mt19937& p_Random)
+    {
+        return uint64_t(1) << std::uniform_int_distribution<uint32_t>(0, 12)(p_Random);
+    }
+
+    // Mostly small sizes, as for buffers, with the occasional large one
+    uint64_t RandomSize(std::mt19937& p_Random)
+    {
+        const uint32_t maxLog2 = (std::uniform_int_distribution<uint32_t>(0, 15)(p_Random) == 0) ? 22 : 14;
+        return std::uniform_int_distribution<uint64_t>(1, uint64_t(1) << maxLog2)(p_Random);
+    }
+
+    // Live ranges by offset, to find the neighbours of a new one
+    class RangeSet
+    {
+    public:
+        void Insert(uint64_t p_Offset, uint64_t p_Size, uint64_t p_Limit, const char* p_pAllocator)
+        {
+            const std::string name = p_pAllocator;
+            Check(p_Offset + p_Size <= p_Limit, name + ": allocation past the end of the range");
+            const auto next = m_Ranges.lower_bound(p_Offset);
+            Check((next == m_Ranges.end()) || (p_Offset + p_Size <= next->first), name + ": allocation overlaps the next live one");
+            if (next != m_Ranges.begin()) Check(std::prev(next)->first + std::prev(next)->second <= p_Offset, name + ": allocation overlaps the previous live one");
+            m_Ranges[p_Offset] = p_Size;
+        }
+
+        void Erase(uint64_t p_Offset) { m_Ranges.erase(p_Offset); }
+        void Clear() { m_Ranges.clear(); }
+
+    private:
+        std::map<uint64_t, uint64_t> m_Ranges;
+    };
+
+    void TestTlsf(std::mt19937& p_Random)
+    {
+        TlsfAllocator allocator(TLSF_SIZE);
+        std::vector<TlsfAllocator::Allocation> live;
+        RangeSet ranges;
+        uint64_t usedBytes = 0;
+        uint32_t failedCount = 0;
+
+        for (uint32_t i = 0; i < OPERATION_COUNT; i++)
+        {
+            // Allocates more than it frees until half full, then as often as it frees
+            const bool isFull = usedBytes > TLSF_SIZE / 2;
+            if (!live.empty() && (std::uniform_int_distribution<uint32_t>(0, isFull ? 1 : 3)(p_Random) == 0))
+            {
+                const size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(p_Random);
+                allocator.Free(live[index].handle);
+                ranges.Erase(live[index].offset);
+                usedBytes -= live[index].size;
+                live[index] = live.back();
+                live.pop_back();
+                continue;
+            }
+
+            const uint64_t size = RandomSize(p_Random);
+            const uint64_t alignment = RandomAlignment(p_Random);
+            const TlsfAllocator::Allocation allocation = allocator.Allocate(size, alignment);
+            if (!allocation.IsValid())
+            {
+                failedCount++;
+                continue;
+            }
+            Check(allocation.offset % alignment == 0, "TLSF: misaligned allocation");
+            Check(allocation.size == size, "TLSF: allocation of the wrong size");
+            ranges.Insert(allocation.offset, allocation.size, TLSF_SIZE, "TLSF");
+            live.push_back(allocation);
+            usedBytes += allocation.size;
+            Check(allocator.GetStats().usedBytes == usedBytes, "TLSF: used bytes don't match the live allocations");
+        }
+
+        bool isDoubleFreeCaught = false;
+        if (!live.empty())
+        {
+            const uint32_t handle = live.back().handle;
+            allocator.Free(handle);
+            live.pop_back();
+            try
+            {
+                allocator.Free(handle);
+            }
+            catch (const std::logic_error&)
+            {
+                isDoubleFreeCaught = true;
+            }
+            Check(isDoubleFreeCaught, "TLSF: double free not detected");
+        }
+
+        for (const TlsfAllocator::Allocation& allocation : live) allocator.Free(allocation.handle);
+        const TlsfAllocator::Stats stats = allocator.GetStats();
+        Check(allocator.IsEmpty() && (stats.usedBytes == 0), "TLSF: allocations left after freeing all of them");
+        Check((stats.freeRangeCount == 1) && (stats.largestFreeRange == TLSF_SIZE), "TLSF: free ranges not merged back into one");
+
+        const TlsfAllocator::Allocation whole = allocator.Allocate(TLSF_SIZE);
+        Check(whole.IsValid() && (whole.offset == 0), "TLSF: the whole range can't be allocated once empty");
+        std::cerr << "TLSF: " << OPERATION_COUNT << " operations, " << failedCount << " allocation(s) didn't fit" << std::endl;
+    }
+
+    void TestLinear(std::mt19937& p_Random)
+    {
+        constexpr uint64_t size = 1024 * 1024;
+        LinearAllocator allocator(size);
+        RangeSet ranges;
+        uint64_t previousEnd = 0;
+        uint32_t resetCount = 0;
+
+        for (uint32_t i = 0; i < OPERATION_COUNT; i++)
+        {
+            const uint64_t allocationSize = std::uniform_int_distribution<uint64_t>(0, 4096)(p_Random);
+            const uint64_t alignment = RandomAlignment(p_Random);
+            const uint64_t offset = allocator.Allocate(allocationSize, alignment);
+            if (offset == LinearAllocator::INVALID_OFFSET)
+            {
+                Check(AlignUp(previousEnd, alignment) + allocationSize > size, "Linear: allocation failed with room left");
+                allocator.Reset();
+                Check(allocator.GetUsedBytes() == 0, "Linear: used bytes after a reset");
+                ranges.Clear();
+                previousEnd = 0;
+                resetCount++;
+                continue;
+            }
+            Check(offset % alignment == 0, "Linear: misaligned allocation");
+            Check(offset >= previousEnd, "Linear: allocation before the previous one");
+            if (allocationSize > 0) ranges.Insert(offset, allocationSize, size, "Linear");
+            previousEnd = offset + allocationSize;
+            Check(allocator.GetUsedBytes() == previousEnd, "Linear: used bytes don't end at the last allocation");
+        }
+        Check(allocator.GetPeakBytes() <= size, "Linear: peak past the end of the range");
+        std::cerr << "Linear: " << OPERATION_COUNT << " operations, " << resetCount << " reset(s)" << std::endl;
+    }
+
+    void TestPool(std::mt19937& p_Random)
+    {
+        constexpr uint32_t slotCount = 1024;
+        PoolAllocator allocator(slotCount);
+        std::vector<uint32_t> live;
+        std::vector<bool> isLive(slotCount, false);
+
+        for (uint32_t i = 0; i < OPERATION_COUNT; i++)
+        {
+            if (!live.empty() && (std::uniform_int_distribution<uint32_t>(0, 1)(p_Random) == 0))
+            {
+                const size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(p_Random);
+                allocator.Free(live[index]);
+                isLive[live[index]] = false;
+                live[index] = live.back();
+                live.pop_back();
+                continue;
+            }
+
+            const uint32_t slot = allocator.Allocate();
+            if (slot == PoolAllocator::INVALID_SLOT)
+            {
+                Check(live.size() == slotCount, "Pool: allocation failed with free slots");
+                continue;
+            }
+            Check(slot < slotCount, "Pool: slot out of range");
+            Check(!isLive[slot], "Pool: slot allocated twice");
+            isLive[slot] = true;
+            live.push_back(slot);
+            Check(allocator.GetUsedSlotCount() == live.size(), "Pool: used slot count doesn't match the live slots");
+        }
+
+        for (uint32_t slot : live) allocator.Free(slot);
+        Check(allocator.GetUsedSlotCount() == 0, "Pool: slots left after freeing all of them");
+
+        bool isDoubleFreeCaught = false;
+        try
+        {
+            allocator.Free(0);
+        }
+        catch (const std::logic_error&)
+        {
+            isDoubleFreeCaught = true;
+        }
+        Check(isDoubleFreeCaught, "Pool: free of a free slot not detected");
+
+        for (uint32_t i = 0; i < slotCount; i++) Check(allocator.Allocate() != PoolAllocator::INVALID_SLOT, "Pool: every slot can't be allocated once empty");
+        Check(allocator.Allocate() == PoolAllocator::INVALID_SLOT, "Pool: allocation past the slot count");
+        std::cerr << "Pool: " << OPERATION_COUNT << " operations" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t seed = 1;
+    if (argc > 1)
+    {
+        char* pEnd = nullptr;
+        seed = static_cast<uint32_t>(std::strtoul(argv[1], &pEnd, 10));
+        if ((argc > 2) || (*pEnd != '\0'))
+        {
+            std::cerr << "Usage: " << argv[0] << " [seed]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        std::mt19937 random(seed);
+        TestTlsf(random);
+        TestLinear(random);
+        TestPool(random);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Seed " << seed << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
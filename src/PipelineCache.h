@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+// vk::PipelineCache persisted to disk between runs. The file is only used if its header matches the current
+// device (vendor, device and pipeline cache UUID), otherwise the cache starts empty. On Uninitialize() the data is
+// written to a temporary file and renamed over the previous one, so a crash never leaves a truncated cache behind.
+class PipelineCache
+{
+public:
+    void Initialize(vk::PhysicalDevice p_PhysicalDevice, vk::Device p_Device, const std::string& p_Path)
+    {
+        m_Device = p_Device;
+        m_Path = p_Path;
+
+        std::vector<uint8_t> data;
+        if (!m_Path.empty())
+        {
+            data = ReadFile(m_Path);
+            if (data.empty())
+            {
+                std::cerr << "Pipeline cache: no cache at \"" << m_Path << "\", starting cold." << std::endl;
+            }
+            else if (!IsCompatible(data, p_PhysicalDevice.getProperties()))
+            {
+                std::cerr << "Pipeline cache: \"" << m_Path << "\" was created by a different device or driver, starting cold." << std::endl;
+                data.clear();
+            }
+            else
+            {
+                std::cerr << "Pipeline cache: loaded " << data.size() << " bytes from \"" << m_Path << "\"." << std::endl;
+            }
+        }
+
+        vk::PipelineCacheCreateInfo createInfo;
+        createInfo.initialDataSize = data.size();
+        createInfo.pInitialData = data.empty() ? nullptr : data.data();
+        m_PipelineCache = m_Device.createPipelineCache(createInfo);
+        m_LoadedSize = data.size();
+    }
+
+    void Uninitialize()
+    {
+        if (!m_PipelineCache) return;
+
+        if (!m_Path.empty())
+        {
+            const std::vector<uint8_t> data = m_Device.getPipelineCacheData(m_PipelineCache);
+            if (WriteFileAtomic(m_Path, data))
+            {
+                std::cerr << "Pipeline cache: saved " << data.size() << " bytes to \"" << m_Path << "\"." << std::endl;
+            }
+        }
+
+        m_Device.destroyPipelineCache(m_PipelineCache);
+        m_PipelineCache = vk::PipelineCache();
+    }
+
+    vk::PipelineCache Get() const { return m_PipelineCache; }
+
+    // True if the cache was seeded with data from a previous run
+    bool IsWarm() const { return m_LoadedSize > 0; }
+
+private:
+    vk::Device m_Device;
+    vk::PipelineCache m_PipelineCache;
+    std::string m_Path;
+    size_t m_LoadedSize = 0;
+
+    static bool IsCompatible(const std::vector<uint8_t>& p_Data, const vk::PhysicalDeviceProperties& p_Properties)
+    {
+        // Layout of the VK_PIPELINE_CACHE_HEADER_VERSION_ONE header
+        struct Header
+        {
+            uint32_t headerLength;
+            uint32_t headerVersion;
+            uint32_t vendorID;
+            uint32_t deviceID;
+            uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        };
+
+        Header header;
+        if (p_Data.size() < sizeof(header)) return false;
+        memcpy(&header, p_Data.data(), sizeof(header));
+
+        return (header.headerLength >= sizeof(header)) &&
+            (header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+            (header.vendorID == p_Properties.vendorID) &&
+            (header.deviceID == p_Properties.deviceID) &&
+            (memcmp(header.pipelineCacheUUID, &p_Properties.pipelineCacheUUID[0], VK_UUID_SIZE) == 0);
+    }
+
+    static std::vector<uint8_t> ReadFile(const std::string& p_Path)
+    {
+        std::ifstream file(p_Path, std::ios::binary | std::ios::in | std::ios::ate);
+        if (!file) return {};
+
+        std::vector<uint8_t> data(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(data.data()), data.size())) return {};
+        return data;
+    }
+
+    static bool WriteFileAtomic(const std::string& p_Path, const std::vector<uint8_t>& p_Data)
+    {
+        const std::string temporaryPath = p_Path + ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::out | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(p_Data.data()), p_Data.size());
+            file.close();
+            if (!file)
+            {
+                std::cerr << "Pipeline cache: failed to write \"" << temporaryPath << "\"." << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, p_Path, error);
+        if (error)
+        {
+            std::cerr << "Pipeline cache: failed to replace \"" << p_Path << "\": " << error.message() << std::endl;
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+// Builds pipelines on worker threads so the render loop can start before they are ready. Submit() queues a
+// function that creates the pipeline (and whatever it needs, e.g. shader modules) and returns a handle the render
+// loop polls with IsReady(). Pipeline creation and vk::PipelineCache are thread-safe, the build functions must only
+// touch state that stays constant while they run.
+class PipelineCompiler
+{
+public:
+    using BuildFunction = std::function<vk::Pipeline()>;
+
+    class Request
+    {
+    public:
+        bool IsReady() const { return m_IsReady.load(std::memory_order_acquire); }
+        const std::string& GetName() const { return m_Name; }
+        float GetMilliseconds() const { return m_Milliseconds; } // Build time, valid once ready
+
+    private:
+        friend class PipelineCompiler;
+
+        std::string m_Name;
+        BuildFunction m_Build;
+        std::atomic<bool> m_IsReady{ false };
+        vk::Pipeline m_Pipeline;
+        std::exception_ptr m_Error;
+        float m_Milliseconds = 0.0f;
+    };
+    using Handle = std::shared_ptr<Request>;
+
+    PipelineCompiler() = default;
+    PipelineCompiler(const PipelineCompiler&) = delete;
+    PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+    ~PipelineCompiler()
+    {
+        Uninitialize();
+    }
+
+    void Initialize(uint32_t p_ThreadCount)
+    {
+        m_IsStopping = false;
+        for (uint32_t i = 0; i < std::max(p_ThreadCount, 1u); i++) m_Workers.emplace_back([this]() { WorkerLoop(); });
+    }
+
+    // Builds the requests still queued, then stops the workers
+    void Uninitialize()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_IsStopping = true;
+        }
+        m_QueueCondition.notify_all();
+        for (std::thread& worker : m_Workers) worker.join();
+        m_Workers.clear();
+    }
+
+    Handle Submit(const std::string& p_Name, BuildFunction p_Build)
+    {
+        Handle request = std::make_shared<Request>();
+        request->m_Name = p_Name;
+        request->m_Build = std::move(p_Build);
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Queue.push_back(request);
+        }
+        m_QueueCondition.notify_one();
+        return request;
+    }
+
+    // Blocks until the request is built. Rethrows the exception of a failed build.
+    vk::Pipeline Wait(const Handle& p_Request)
+    {
+        if (!p_Request->IsReady())
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_ReadyCondition.wait(lock, [&]() { return p_Request->IsReady(); });
+        }
+        if (p_Request->m_Error) std::rethrow_exception(p_Request->m_Error);
+        return p_Request->m_Pipeline;
+    }
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_QueueCondition;
+    std::condition_variable m_ReadyCondition;
+    std::deque<Handle> m_Queue; // Guarded by m_Mutex, built in submission order
+    bool m_IsStopping = false;
+
+    void WorkerLoop()
+    {
+        while (true)
+        {
+            Handle request;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_QueueCondition.wait(lock, [this]() { return m_IsStopping || !m_Queue.empty(); });
+                if (m_Queue.empty()) return;
+                request = std::move(m_Queue.front());
+                m_Queue.pop_front();
+            }
+
+            const auto startTime = std::chrono::steady_clock::now();
+            try
+            {
+                request->m_Pipeline = request->m_Build();
+            }
+            catch (...)
+            {
+                request->m_Error = std::current_exception();
+            }
+            request->m_Milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            request->m_Build = nullptr; // Releases what the function captured
+
+            {
+                // Under the lock so that Wait() can't miss the notification
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                request->m_IsReady.store(true, std::memory_order_release);
+            }
+            m_ReadyCondition.notify_all();
+        }
+    }
+};
@@ -0,0 +1,523 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "Resource.h"
+#include "ResourceFormat.h"
+
+enum class BlendMode : uint8_t
+{
+    Opaque,
+    Alpha,    // src * a + dst * (1 - a)
+    Additive, // src * a + dst
+};
+
+// Everything a graphics pipeline depends on, except for viewport and scissor which are dynamic state. Programs,
+// vertex layouts and render passes are referred to by the ids they were registered with, and shader variants are
+// different programs. Keys are compared and hashed as raw bytes, so every field has a fixed size and there is no
+// implicit padding.
+struct PipelineStateKey
+{
+    uint16_t program = 0;
+    uint16_t vertexLayout = 0;
+    uint16_t renderPass = 0;
+    uint8_t subpass = 0;
+    uint8_t topology = static_cast<uint8_t>(vk::PrimitiveTopology::eTriangleList);
+    uint8_t polygonMode = static_cast<uint8_t>(vk::PolygonMode::eFill);
+    uint8_t cullMode = static_cast<uint8_t>(VK_CULL_MODE_BACK_BIT);
+    uint8_t frontFace = static_cast<uint8_t>(vk::FrontFace::eClockwise);
+    BlendMode blendMode = BlendMode::Opaque;
+    uint8_t colorWriteMask = 0xF;
+    uint8_t specializationFlags = 0; // Bit i is the bool specialization constant with constant_id i, in every stage
+    uint8_t reserved[2] = {};
+
+    bool operator==(const PipelineStateKey& p_Other) const { return memcmp(this, &p_Other, sizeof(*this)) == 0; }
+};
+static_assert(sizeof(PipelineStateKey) == 16, "PipelineStateKey must not contain padding");
+
+struct PipelineStateKeyHash
+{
+    size_t operator()(const PipelineStateKey& p_Key) const { return static_cast<size_t>(HashBytes(&p_Key, sizeof(p_Key))); }
+};
+
+// Deduplicates graphics pipelines by PipelineStateKey. Request() is called when a material is set up: it returns the
+// id of the pipeline with that state, submitting it to the PipelineCompiler the first time the state is seen. The
+// draw path only calls Get(id), an index into an array that is null until the pipeline is built. Update() publishes
+// the pipelines built since the last call. ReloadShader() rebuilds the pipelines of a shader with new code, the
+// current ones stay in use until Update() swaps them and are destroyed once the frames using them are complete.
+// Register*(), Request(), ReloadShader() and Update() must not run while other threads call Get(), in practice they
+// run between frames on the main thread.
+class PipelineStateCache
+{
+public:
+    using PipelineId = uint32_t;
+
+    void Initialize(vk::Device p_Device, PipelineCache& p_PipelineCache, PipelineCompiler& p_Compiler, bool p_IsCreationFeedbackSupported)
+    {
+        m_Device = p_Device;
+        m_pPipelineCache = &p_PipelineCache;
+        m_pCompiler = &p_Compiler;
+        m_IsCreationFeedbackSupported = p_IsCreationFeedbackSupported;
+    }
+
+    // The compiler must have been stopped, no build may be running
+    void Uninitialize()
+    {
+        for (Entry& entry : m_Entries)
+        {
+            m_Device.destroyPipeline(entry.request ? WaitForDestruction(entry.request) : entry.pipeline);
+            if (entry.reloadRequest) m_Device.destroyPipeline(WaitForReload(entry.reloadRequest));
+        }
+        for (const PipelineCompiler::Handle& request : m_SupersededRequests)
+        {
+            const vk::Pipeline pipeline = WaitForReload(request);
+            if (pipeline) m_Device.destroyPipeline(pipeline);
+        }
+        m_Entries.clear();
+        m_Lookup.clear();
+        m_SupersededRequests.clear();
+        DestroyRetired(UINT64_MAX);
+        for (std::unique_ptr<Program>& pProgram : m_Programs) DestroyProgram(*pProgram);
+        for (std::unique_ptr<Program>& pProgram : m_RetiredPrograms) DestroyProgram(*pProgram);
+        m_Programs.clear();
+        m_RetiredPrograms.clear();
+    }
+
+    // The shader modules are created by the first build that uses the program, on a compiler thread. Registering
+    // the same shaders and layout again returns the same id.
+    uint16_t RegisterProgram(const Resource& p_VertexShader, const Resource& p_FragmentShader, vk::PipelineLayout p_Layout)
+    {
+        for (size_t i = 0; i < m_Programs.size(); i++)
+        {
+            const Program& program = *m_Programs[i];
+            if ((program.pVertexShader == &p_VertexShader) && (program.pFragmentShader == &p_FragmentShader) && (program.layout == p_Layout))
+            {
+                return static_cast<uint16_t>(i);
+            }
+        }
+
+        auto pProgram = std::make_unique<Program>();
+        pProgram->pVertexShader = &p_VertexShader;
+        pProgram->pFragmentShader = &p_FragmentShader;
+        pProgram->layout = p_Layout;
+        m_Programs.push_back(std::move(pProgram));
+        return static_cast<uint16_t>(m_Programs.size() - 1);
+    }
+
+    uint16_t RegisterVertexLayout(const std::vector<vk::VertexInputBindingDescription>& p_Bindings, const std::vector<vk::VertexInputAttributeDescription>& p_Attributes)
+    {
+        m_VertexLayouts.push_back({ p_Bindings, p_Attributes });
+        return static_cast<uint16_t>(m_VertexLayouts.size() - 1);
+    }
+
+    uint16_t RegisterRenderPass(vk::RenderPass p_RenderPass)
+    {
+        m_RenderPasses.push_back(p_RenderPass);
+        return static_cast<uint16_t>(m_RenderPasses.size() - 1);
+    }
+
+    PipelineId Request(const PipelineStateKey& p_Key, const std::string& p_Name)
+    {
+        const auto found = m_Lookup.find(p_Key);
+        if (found != m_Lookup.end())
+        {
+            m_HitCount++;
+            return found->second;
+        }
+
+        const PipelineId id = static_cast<PipelineId>(m_Entries.size());
+        Entry entry;
+        entry.key = p_Key;
+        entry.name = p_Name;
+        entry.request = Submit(p_Key, p_Name);
+        m_Entries.push_back(entry);
+        m_Lookup.emplace(p_Key, id);
+        return id;
+    }
+
+    // Null while the pipeline is being built
+    vk::Pipeline Get(PipelineId p_Id) const { return m_Entries[p_Id].pipeline; }
+
+    // Replaces the code of the shader resource with this name in every program using it, and rebuilds their
+    // pipelines. p_ChangeTime is when the source changed, for the reload latency. Returns the number of pipelines
+    // submitted.
+    size_t ReloadShader(const std::string& p_ResourceName, const std::vector<uint32_t>& p_Code, std::chrono::steady_clock::time_point p_ChangeTime)
+    {
+        std::vector<bool> isReloaded(m_Programs.size(), false);
+        for (size_t i = 0; i < m_Programs.size(); i++)
+        {
+            const Program& program = *m_Programs[i];
+            const bool isVertexShader = (program.pVertexShader->GetName() == p_ResourceName);
+            const bool isFragmentShader = (program.pFragmentShader->GetName() == p_ResourceName);
+            if (!isVertexShader && !isFragmentShader) continue;
+
+            // Builds still running use the old program, it is kept until Uninitialize()
+            auto pProgram = std::make_unique<Program>();
+            pProgram->pVertexShader = program.pVertexShader;
+            pProgram->pFragmentShader = program.pFragmentShader;
+            pProgram->layout = program.layout;
+            pProgram->vertexCode = isVertexShader ? p_Code : program.vertexCode;
+            pProgram->fragmentCode = isFragmentShader ? p_Code : program.fragmentCode;
+            m_RetiredPrograms.push_back(std::move(m_Programs[i]));
+            m_Programs[i] = std::move(pProgram);
+            isReloaded[i] = true;
+        }
+
+        size_t submittedCount = 0;
+        for (Entry& entry : m_Entries)
+        {
+            if (!isReloaded[entry.key.program]) continue;
+
+            // A newer save supersedes a rebuild that hasn't been swapped in yet
+            if (entry.reloadRequest) m_SupersededRequests.push_back(entry.reloadRequest);
+            entry.reloadRequest = Submit(entry.key, entry.name);
+            entry.changeTime = p_ChangeTime;
+            submittedCount++;
+        }
+        return submittedCount;
+    }
+
+    // Publishes the pipelines built since the last call. Pipelines replaced by a reload are retired with
+    // p_RetireValue, the frame timeline value of the last frame that may use them. Returns the number of pipelines
+    // still being built.
+    size_t Update(uint64_t p_RetireValue)
+    {
+        size_t pendingCount = 0;
+        for (Entry& entry : m_Entries)
+        {
+            if (entry.request)
+            {
+                if (entry.request->IsReady()) Publish(entry);
+                else pendingCount++;
+            }
+
+            // Only after the first build, which could otherwise overwrite it
+            if (!entry.reloadRequest) continue;
+            if (entry.request || !entry.reloadRequest->IsReady())
+            {
+                pendingCount++;
+                continue;
+            }
+
+            const vk::Pipeline pipeline = WaitForReload(entry.reloadRequest);
+            entry.reloadRequest.reset();
+            if (!pipeline) continue; // The new code failed to build, the current pipeline stays
+
+            if (entry.pipeline) m_RetiredPipelines.push_back({ p_RetireValue, entry.pipeline });
+            entry.pipeline = pipeline;
+            m_ReloadCount++;
+            if (!m_HasReloadedPipelines || (entry.changeTime < m_ReloadChangeTime)) m_ReloadChangeTime = entry.changeTime;
+            m_HasReloadedPipelines = true;
+        }
+
+        // Nothing uses the pipelines of superseded reloads
+        for (auto it = m_SupersededRequests.begin(); it != m_SupersededRequests.end();)
+        {
+            if (!(*it)->IsReady())
+            {
+                ++it;
+                continue;
+            }
+            const vk::Pipeline pipeline = WaitForReload(*it);
+            if (pipeline) m_Device.destroyPipeline(pipeline);
+            it = m_SupersededRequests.erase(it);
+        }
+        return pendingCount + m_SupersededRequests.size();
+    }
+
+    void DestroyRetired(uint64_t p_CompletedValue)
+    {
+        while (!m_RetiredPipelines.empty() && (m_RetiredPipelines.front().first <= p_CompletedValue))
+        {
+            m_Device.destroyPipeline(m_RetiredPipelines.front().second);
+            m_RetiredPipelines.pop_front();
+        }
+    }
+
+    // True once per batch of reloaded pipelines published by Update(), with the earliest source change among them
+    bool TakeReloadChangeTime(std::chrono::steady_clock::time_point& p_ChangeTime)
+    {
+        if (!m_HasReloadedPipelines) return false;
+        p_ChangeTime = m_ReloadChangeTime;
+        m_HasReloadedPipelines = false;
+        return true;
+    }
+
+    void WaitAll()
+    {
+        for (Entry& entry : m_Entries)
+        {
+            if (entry.request) Publish(entry);
+        }
+    }
+
+    void LogStats() const
+    {
+        std::cerr << "Pipeline states: " << m_Entries.size() << " unique pipeline(s), " << m_HitCount << " hit(s), "
+            << m_CompileMilliseconds << " ms compiling";
+        if (m_ReloadCount > 0) std::cerr << ", " << m_ReloadCount << " reloaded";
+        std::cerr << std::endl;
+    }
+
+private:
+    static constexpr uint32_t SPECIALIZATION_FLAG_COUNT = 8;
+
+    struct Program
+    {
+        const Resource* pVertexShader = nullptr;
+        const Resource* pFragmentShader = nullptr;
+        std::vector<uint32_t> vertexCode; // Reloaded code, replaces the resource when not empty
+        std::vector<uint32_t> fragmentCode;
+        vk::PipelineLayout layout;
+        std::once_flag modulesCreated;
+        vk::ShaderModule vertexModule;
+        vk::ShaderModule fragmentModule;
+    };
+
+    struct VertexLayout
+    {
+        std::vector<vk::VertexInputBindingDescription> bindings;
+        std::vector<vk::VertexInputAttributeDescription> attributes;
+    };
+
+    struct Entry
+    {
+        PipelineStateKey key;
+        std::string name;
+        vk::Pipeline pipeline;
+        PipelineCompiler::Handle request; // Until the pipeline is published
+        PipelineCompiler::Handle reloadRequest; // Until the rebuilt pipeline replaces the current one
+        std::chrono::steady_clock::time_point changeTime; // Of the source of the pending reload
+    };
+
+    vk::Device m_Device;
+    PipelineCache* m_pPipelineCache = nullptr;
+    PipelineCompiler* m_pCompiler = nullptr;
+    bool m_IsCreationFeedbackSupported = false;
+
+    std::vector<std::unique_ptr<Program>> m_Programs; // Builds point to the programs, they never move
+    std::vector<VertexLayout> m_VertexLayouts;
+    std::vector<vk::RenderPass> m_RenderPasses;
+    std::vector<Entry> m_Entries; // Indexed by PipelineId
+    std::unordered_map<PipelineStateKey, PipelineId, PipelineStateKeyHash> m_Lookup;
+
+    std::vector<std::unique_ptr<Program>> m_RetiredPrograms; // Replaced by reloads
+    std::deque<std::pair<uint64_t, vk::Pipeline>> m_RetiredPipelines; // With the frame timeline value that retired them
+    std::vector<PipelineCompiler::Handle> m_SupersededRequests;
+    bool m_HasReloadedPipelines = false;
+    std::chrono::steady_clock::time_point m_ReloadChangeTime;
+
+    uint64_t m_HitCount = 0;
+    uint64_t m_ReloadCount = 0;
+    double m_CompileMilliseconds = 0.0;
+
+    PipelineCompiler::Handle Submit(const PipelineStateKey& p_Key, const std::string& p_Name)
+    {
+        // Registration and reloads may change the tables while the build runs, it gets what it needs up front
+        Program* pProgram = m_Programs[p_Key.program].get();
+        const VertexLayout vertexLayout = m_VertexLayouts[p_Key.vertexLayout];
+        const vk::RenderPass renderPass = m_RenderPasses[p_Key.renderPass];
+        return m_pCompiler->Submit(p_Name, [this, pProgram, vertexLayout, renderPass, p_Key, p_Name]() {
+            return Build(*pProgram, vertexLayout, renderPass, p_Key, p_Name);
+        });
+    }
+
+    // Edited shaders may not compile into a valid pipeline, which must not bring the application down
+    vk::Pipeline WaitForReload(const PipelineCompiler::Handle& p_Request)
+    {
+        try
+        {
+            return m_pCompiler->Wait(p_Request);
+        }
+        catch (const std::exception& exception)
+        {
+            std::cerr << "Failed to rebuild pipeline \"" << p_Request->GetName() << "\": " << exception.what() << std::endl;
+            return vk::Pipeline();
+        }
+    }
+
+    // Uninitialize() waits for builds nothing has used yet. One that failed leaves no pipeline, and must not keep the
+    // others from being destroyed.
+    vk::Pipeline WaitForDestruction(const PipelineCompiler::Handle& p_Request)
+    {
+        try
+        {
+            return m_pCompiler->Wait(p_Request);
+        }
+        catch (const std::exception& exception)
+        {
+            std::cerr << "Failed to build pipeline \"" << p_Request->GetName() << "\": " << exception.what() << std::endl;
+            return vk::Pipeline();
+        }
+    }
+
+    void DestroyProgram(Program& p_Program)
+    {
+        if (p_Program.vertexModule) m_Device.destroyShaderModule(p_Program.vertexModule);
+        if (p_Program.fragmentModule) m_Device.destroyShaderModule(p_Program.fragmentModule);
+    }
+
+    void Publish(Entry& p_Entry)
+    {
+        p_Entry.pipeline = m_pCompiler->Wait(p_Entry.request);
+        m_CompileMilliseconds += p_Entry.request->GetMilliseconds();
+        p_Entry.request.reset();
+    }
+
+    vk::ShaderModule CreateShaderModule(const Resource& p_Resource, const std::vector<uint32_t>& p_ReloadedCode) const
+    {
+        vk::ShaderModuleCreateInfo createInfo;
+        if (!p_ReloadedCode.empty())
+        {
+            createInfo.codeSize = p_ReloadedCode.size() * sizeof(uint32_t);
+            createInfo.pCode = p_ReloadedCode.data();
+            return m_Device.createShaderModule(createInfo);
+        }
+
+        // SPIR-V resources are aligned, the module is created straight from the read-only data
+        const ResourceView<uint32_t> code = p_Resource.As<uint32_t>();
+        createInfo.codeSize = code.SizeInBytes();
+        createInfo.pCode = code.Data();
+        return m_Device.createShaderModule(createInfo);
+    }
+
+    // Runs on a compiler thread
+    vk::Pipeline Build(Program& p_Program, const VertexLayout& p_VertexLayout, vk::RenderPass p_RenderPass, const PipelineStateKey& p_Key, const std::string& p_Name)
+    {
+        std::call_once(p_Program.modulesCreated, [&]() {
+            p_Program.vertexModule = CreateShaderModule(*p_Program.pVertexShader, p_Program.vertexCode);
+            p_Program.fragmentModule = CreateShaderModule(*p_Program.pFragmentShader, p_Program.fragmentCode);
+        });
+
+        // Every flag is given to both stages, entries for constant ids a stage doesn't declare are ignored
+        VkBool32 specializationData[SPECIALIZATION_FLAG_COUNT];
+        vk::SpecializationMapEntry specializationEntries[SPECIALIZATION_FLAG_COUNT];
+        for (uint32_t i = 0; i < SPECIALIZATION_FLAG_COUNT; i++)
+        {
+            specializationData[i] = ((p_Key.specializationFlags >> i) & 1) ? VK_TRUE : VK_FALSE;
+            specializationEntries[i].constantID = i;
+            specializationEntries[i].offset = i * sizeof(VkBool32);
+            specializationEntries[i].size = sizeof(VkBool32);
+        }
+
+        vk::SpecializationInfo specializationInfo;
+        specializationInfo.mapEntryCount = SPECIALIZATION_FLAG_COUNT;
+        specializationInfo.pMapEntries = specializationEntries;
+        specializationInfo.dataSize = sizeof(specializationData);
+        specializationInfo.pData = specializationData;
+
+        vk::PipelineShaderStageCreateInfo vertexShaderStageInfo;
+        vertexShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
+        vertexShaderStageInfo.module = p_Program.vertexModule;
+        vertexShaderStageInfo.pName = "main";
+        vertexShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+        vk::PipelineShaderStageCreateInfo fragmentShaderStageInfo;
+        fragmentShaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
+        fragmentShaderStageInfo.module = p_Program.fragmentModule;
+        fragmentShaderStageInfo.pName = "main";
+        fragmentShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+        vk::PipelineShaderStageCreateInfo shaderStageInfos[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
+
+        vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(p_VertexLayout.bindings.size());
+        vertexInputInfo.pVertexBindingDescriptions = p_VertexLayout.bindings.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(p_VertexLayout.attributes.size());
+        vertexInputInfo.pVertexAttributeDescriptions = p_VertexLayout.attributes.data();
+
+        vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+        inputAssembly.topology = static_cast<vk::PrimitiveTopology>(p_Key.topology);
+
+        // Viewport and scissor are dynamic, one pipeline serves every framebuffer size
+        vk::PipelineViewportStateCreateInfo viewportState;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        const vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+        vk::PipelineDynamicStateCreateInfo dynamicState;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        vk::PipelineRasterizationStateCreateInfo rasterizer;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = static_cast<vk::PolygonMode>(p_Key.polygonMode);
+        rasterizer.cullMode = static_cast<vk::CullModeFlagBits>(p_Key.cullMode);
+        rasterizer.frontFace = static_cast<vk::FrontFace>(p_Key.frontFace);
+        rasterizer.lineWidth = 1.0f;
+
+        vk::PipelineMultisampleStateCreateInfo multisampling;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = vk::SampleCountFlagBits::e1;
+
+        vk::PipelineColorBlendAttachmentState colorBlendAttachment;
+        colorBlendAttachment.colorWriteMask = vk::ColorComponentFlags(static_cast<vk::ColorComponentFlagBits>(p_Key.colorWriteMask));
+        colorBlendAttachment.blendEnable = (p_Key.blendMode != BlendMode::Opaque) ? VK_TRUE : VK_FALSE;
+        colorBlendAttachment.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+        colorBlendAttachment.dstColorBlendFactor = (p_Key.blendMode == BlendMode::Additive) ? vk::BlendFactor::eOne : vk::BlendFactor::eOneMinusSrcAlpha;
+        colorBlendAttachment.colorBlendOp = vk::BlendOp::eAdd;
+        colorBlendAttachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+        colorBlendAttachment.dstAlphaBlendFactor = vk::BlendFactor::eZero;
+        colorBlendAttachment.alphaBlendOp = vk::BlendOp::eAdd;
+
+        vk::PipelineColorBlendStateCreateInfo colorBlending;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
+        pipelineCreateInfo.stageCount = 2;
+        pipelineCreateInfo.pStages = shaderStageInfos;
+        pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
+        pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+        pipelineCreateInfo.pViewportState = &viewportState;
+        pipelineCreateInfo.pRasterizationState = &rasterizer;
+        pipelineCreateInfo.pMultisampleState = &multisampling;
+        pipelineCreateInfo.pDepthStencilState = nullptr;
+        pipelineCreateInfo.pColorBlendState = &colorBlending;
+        pipelineCreateInfo.pDynamicState = &dynamicState;
+        pipelineCreateInfo.layout = p_Program.layout;
+        pipelineCreateInfo.renderPass = p_RenderPass;
+        pipelineCreateInfo.subpass = p_Key.subpass;
+
+        vk::PipelineCreationFeedbackEXT pipelineFeedback;
+        vk::PipelineCreationFeedbackEXT stageFeedbacks[2];
+        vk::PipelineCreationFeedbackCreateInfoEXT feedbackInfo;
+        feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+        feedbackInfo.pipelineStageCreationFeedbackCount = pipelineCreateInfo.stageCount;
+        feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks;
+        if (m_IsCreationFeedbackSupported) pipelineCreateInfo.pNext = &feedbackInfo;
+
+        const auto startTime = std::chrono::steady_clock::now();
+        const vk::Pipeline pipeline = m_Device.createGraphicsPipeline(m_pPipelineCache->Get(), pipelineCreateInfo);
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+        // Written at once, other threads log too
+        std::ostringstream message;
+        message << "Pipeline \"" << p_Name << "\" created in " << milliseconds << " ms (pipeline cache " << (m_pPipelineCache->IsWarm() ? "warm" : "cold");
+        if (pipelineFeedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid)
+        {
+            const bool isHit = static_cast<bool>(pipelineFeedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit);
+            message << ", " << (isHit ? "hit" : "miss");
+        }
+        message << ")\n";
+        std::cerr << message.str();
+        return pipeline;
+    }
+};
@@ -0,0 +1,889 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+
+// Frame graph. Passes are declared in execution order with the images and buffers they read and write, and
+// Compile() works out everything between them:
+// - passes whose results nothing reads are culled, starting from the exported images and the passes with side effects
+// - transient images are created for the usages the live passes declared, and images whose lifetimes don't overlap
+//   share memory
+// - the barriers and layout transitions between passes are derived once, for the steady state where the previous
+//   frame ran the same graph, and batched in one vkCmdPipelineBarrier per pass
+// - graphics passes get a render pass and framebuffers built from their color attachments
+// Execute() then only records. The graph is declared again when its inputs change, e.g. the swapchain is recreated;
+// Reset() retires the images and framebuffers compiled before, which are destroyed once the frames using them are
+// complete. Only color images are supported, and every pass runs on one queue.
+class RenderGraph
+{
+public:
+    using ImageHandle = uint32_t;
+    using BufferHandle = uint32_t;
+    using PassHandle = uint32_t;
+
+    // How a pass uses an image
+    struct ImageUsage
+    {
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        vk::ImageUsageFlags usage; // Transient images are created with the usages of every pass
+
+        static ImageUsage ColorAttachment()
+        {
+            return { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                vk::ImageLayout::eColorAttachmentOptimal, vk::ImageUsageFlagBits::eColorAttachment };
+        }
+        static ImageUsage Sampled(vk::PipelineStageFlags p_Stages)
+        {
+            return { p_Stages, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageUsageFlagBits::eSampled };
+        }
+        static ImageUsage Storage(vk::PipelineStageFlags p_Stages)
+        {
+            return { p_Stages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral, vk::ImageUsageFlagBits::eStorage };
+        }
+        static ImageUsage TransferSrc()
+        {
+            return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal, vk::ImageUsageFlagBits::eTransferSrc };
+        }
+        static ImageUsage TransferDst()
+        {
+            return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal, vk::ImageUsageFlagBits::eTransferDst };
+        }
+    };
+
+    // How a pass uses a buffer
+    struct BufferUsage
+    {
+        vk::PipelineStageFlags stages;
+        vk::AccessFlags access;
+
+        static BufferUsage ShaderRead(vk::PipelineStageFlags p_Stages) { return { p_Stages, vk::AccessFlagBits::eShaderRead }; }
+        static BufferUsage ShaderWrite(vk::PipelineStageFlags p_Stages) { return { p_Stages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite }; }
+        static BufferUsage IndirectRead() { return { vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead }; }
+        static BufferUsage TransferSrc() { return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead }; }
+        static BufferUsage TransferDst() { return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite }; }
+    };
+
+    // What a pass records with. For graphics passes the render pass has begun on framebuffer.
+    struct PassContext
+    {
+        vk::CommandBuffer commandBuffer;
+        vk::RenderPass renderPass;
+        vk::Framebuffer framebuffer;
+        vk::Extent2D extent; // Of the framebuffer
+        uint32_t importIndex = 0; // Image of the multi-image imports, e.g. the swapchain image index
+        const RenderGraph* pGraph = nullptr;
+
+        vk::Image GetImage(ImageHandle p_Image) const { return pGraph->GetImage(p_Image, importIndex); }
+        vk::Extent2D GetExtent(ImageHandle p_Image) const { return pGraph->GetExtent(p_Image); }
+    };
+
+    class Pass
+    {
+    public:
+        // Rendered to by the pass, which makes it a graphics pass. Attachments that are cleared or not loaded
+        // replace the whole image, and the passes that wrote it before are culled unless something else reads it.
+        Pass& WriteColor(ImageHandle p_Image, vk::AttachmentLoadOp p_LoadOp = vk::AttachmentLoadOp::eClear,
+            const std::array<float, 4>& p_ClearColor = { 0.0f, 0.0f, 0.0f, 1.0f })
+        {
+            m_ImageAccesses.push_back({ p_Image, ImageUsage::ColorAttachment(), p_LoadOp == vk::AttachmentLoadOp::eLoad, true });
+            m_ColorAttachments.push_back({ p_Image, p_LoadOp, vk::ClearColorValue(p_ClearColor) });
+            return *this;
+        }
+
+        Pass& ReadImage(ImageHandle p_Image, const ImageUsage& p_Usage)
+        {
+            m_ImageAccesses.push_back({ p_Image, p_Usage, true, false });
+            return *this;
+        }
+
+        // Whether the previous content is read too is up to the pass, it is kept
+        Pass& WriteImage(ImageHandle p_Image, const ImageUsage& p_Usage)
+        {
+            m_ImageAccesses.push_back({ p_Image, p_Usage, false, true });
+            return *this;
+        }
+
+        Pass& ReadBuffer(BufferHandle p_Buffer, const BufferUsage& p_Usage)
+        {
+            m_BufferAccesses.push_back({ p_Buffer, p_Usage, true, false });
+            return *this;
+        }
+
+        Pass& WriteBuffer(BufferHandle p_Buffer, const BufferUsage& p_Usage)
+        {
+            m_BufferAccesses.push_back({ p_Buffer, p_Usage, false, true });
+            return *this;
+        }
+
+        // The render pass is begun for secondary command buffers
+        Pass& UseSecondaryCommandBuffers()
+        {
+            m_UsesSecondaries = true;
+            return *this;
+        }
+
+        // Never culled, e.g. it writes something outside of the graph
+        Pass& SetSideEffects()
+        {
+            m_HasSideEffects = true;
+            return *this;
+        }
+
+        Pass& SetExecute(std::function<void(const PassContext&)> p_Execute)
+        {
+            m_Execute = std::move(p_Execute);
+            return *this;
+        }
+
+        PassHandle GetHandle() const { return m_Handle; }
+
+    private:
+        friend class RenderGraph;
+
+        struct ImageAccess
+        {
+            ImageHandle image;
+            ImageUsage usage;
+            bool isRead;
+            bool isWrite;
+        };
+
+        struct BufferAccess
+        {
+            BufferHandle buffer;
+            BufferUsage usage;
+            bool isRead;
+            bool isWrite;
+        };
+
+        struct ColorAttachment
+        {
+            ImageHandle image;
+            vk::AttachmentLoadOp loadOp;
+            vk::ClearColorValue clearValue;
+        };
+
+        std::string m_Name;
+        PassHandle m_Handle = 0;
+        std::vector<ImageAccess> m_ImageAccesses;
+        std::vector<BufferAccess> m_BufferAccesses;
+        std::vector<ColorAttachment> m_ColorAttachments;
+        bool m_UsesSecondaries = false;
+        bool m_HasSideEffects = false;
+        std::function<void(const PassContext&)> m_Execute;
+
+        // Compiled
+        bool m_IsLive = false;
+        vk::RenderPass m_RenderPass;
+        std::vector<vk::Framebuffer> m_Framebuffers; // One per import index when an attachment is a multi-image import
+        vk::Extent2D m_Extent;
+        std::vector<vk::ClearValue> m_ClearValues;
+        size_t m_FirstBarrier = 0; // Barriers recorded before the pass, in m_Barriers
+        size_t m_BarrierCount = 0;
+    };
+
+    void Initialize(vk::Device p_Device, DeviceMemoryAllocator& p_Allocator)
+    {
+        m_Device = p_Device;
+        m_pAllocator = &p_Allocator;
+    }
+
+    void Uninitialize()
+    {
+        Reset(0);
+        DestroyRetired(UINT64_MAX);
+        for (const CachedRenderPass& cached : m_RenderPasses) m_Device.destroyRenderPass(cached.renderPass);
+        m_RenderPasses.clear();
+    }
+
+    // Drops the declared passes and resources. What was compiled from them may still be used by the frames up to the
+    // frame timeline value p_RetireValue, DestroyRetired() destroys it once that value has been reached. Render
+    // passes are kept, so pipelines created for a pass stay compatible with the same pass declared again.
+    void Reset(uint64_t p_RetireValue)
+    {
+        Retired retired;
+        retired.retireValue = p_RetireValue;
+        for (ImageResource& image : m_Images)
+        {
+            if (image.isImported) continue;
+            if (image.view) retired.imageViews.push_back(image.view);
+            if (image.image) retired.images.push_back(image.image);
+        }
+        for (Pass& pass : m_Passes) retired.framebuffers.insert(retired.framebuffers.end(), pass.m_Framebuffers.begin(), pass.m_Framebuffers.end());
+        retired.memory = m_Memory;
+        m_Retired.push_back(std::move(retired));
+
+        m_Memory = MemoryAllocation();
+        m_Images.clear();
+        m_Buffers.clear();
+        m_Passes.clear();
+        m_Barriers.clear();
+        m_FinalBarrierCount = 0;
+        m_IsCompiled = false;
+    }
+
+    void DestroyRetired(uint64_t p_CompletedValue)
+    {
+        while (!m_Retired.empty() && (m_Retired.front().retireValue <= p_CompletedValue))
+        {
+            Retired& retired = m_Retired.front();
+            for (vk::Framebuffer framebuffer : retired.framebuffers) m_Device.destroyFramebuffer(framebuffer);
+            for (vk::ImageView view : retired.imageViews) m_Device.destroyImageView(view);
+            for (vk::Image image : retired.images) m_Device.destroyImage(image);
+            m_pAllocator->Free(retired.memory);
+            m_Retired.pop_front();
+        }
+    }
+
+    // Images created by the graph. Their content doesn't outlive the frame.
+    ImageHandle CreateImage(const std::string& p_Name, vk::Format p_Format, vk::Extent2D p_Extent)
+    {
+        ImageResource image;
+        image.name = p_Name;
+        image.format = p_Format;
+        image.extent = p_Extent;
+        m_Images.push_back(image);
+        return static_cast<ImageHandle>(m_Images.size() - 1);
+    }
+
+    // Images owned by the caller. Several images make one resource that alternates between frames, e.g. the
+    // swapchain images, Execute() selects one. Every frame the image starts in p_InitialLayout, and its previous
+    // content is available to the stages after p_InitialStages (e.g. the wait stage of the acquire semaphore).
+    ImageHandle ImportImage(const std::string& p_Name, const std::vector<vk::Image>& p_Images, const std::vector<vk::ImageView>& p_Views,
+        vk::Format p_Format, vk::Extent2D p_Extent, vk::ImageLayout p_InitialLayout, vk::PipelineStageFlags p_InitialStages)
+    {
+        ImageResource image;
+        image.name = p_Name;
+        image.format = p_Format;
+        image.extent = p_Extent;
+        image.isImported = true;
+        image.importedImages = p_Images;
+        image.importedViews = p_Views;
+        image.initialLayout = p_InitialLayout;
+        image.initialStages = p_InitialStages;
+        m_Images.push_back(image);
+        return static_cast<ImageHandle>(m_Images.size() - 1);
+    }
+
+    // The graph's result: the passes that write it are live, and it ends the frame in p_FinalLayout
+    void ExportImage(ImageHandle p_Image, vk::ImageLayout p_FinalLayout)
+    {
+        m_Images[p_Image].isExported = true;
+        m_Images[p_Image].finalLayout = p_FinalLayout;
+    }
+
+    // Buffers owned by the caller. Their accesses carry over from one frame to the next.
+    BufferHandle ImportBuffer(const std::string& p_Name, vk::Buffer p_Buffer)
+    {
+        m_Buffers.push_back({ p_Name, p_Buffer });
+        return static_cast<BufferHandle>(m_Buffers.size() - 1);
+    }
+
+    // Passes execute in the order they are added. The reference stays valid until Reset().
+    Pass& AddPass(const std::string& p_Name)
+    {
+        m_Passes.emplace_back();
+        Pass& pass = m_Passes.back();
+        pass.m_Name = p_Name;
+        pass.m_Handle = static_cast<PassHandle>(m_Passes.size() - 1);
+        return pass;
+    }
+
+    void Compile()
+    {
+        CullPasses();
+        ComputeLifetimes();
+        CreateTransientImages();
+        CreateRenderPasses();
+        DeriveBarriers();
+        m_IsCompiled = true;
+        LogStats();
+    }
+
+    void Execute(vk::CommandBuffer p_CommandBuffer, uint32_t p_ImportIndex)
+    {
+        if (!m_IsCompiled) throw std::runtime_error("The render graph isn't compiled.");
+
+        PassContext context;
+        context.commandBuffer = p_CommandBuffer;
+        context.importIndex = p_ImportIndex;
+        context.pGraph = this;
+
+        for (Pass& pass : m_Passes)
+        {
+            if (!pass.m_IsLive) continue;
+            RecordBarriers(p_CommandBuffer, pass.m_FirstBarrier, pass.m_BarrierCount, p_ImportIndex);
+
+            context.renderPass = pass.m_RenderPass;
+            context.framebuffer = pass.m_RenderPass ? pass.m_Framebuffers[p_ImportIndex % pass.m_Framebuffers.size()] : vk::Framebuffer();
+            context.extent = pass.m_Extent;
+            if (pass.m_RenderPass)
+            {
+                vk::RenderPassBeginInfo beginInfo;
+                beginInfo.renderPass = pass.m_RenderPass;
+                beginInfo.framebuffer = context.framebuffer;
+                beginInfo.renderArea = vk::Rect2D(vk::Offset2D(0, 0), pass.m_Extent);
+                beginInfo.clearValueCount = static_cast<uint32_t>(pass.m_ClearValues.size());
+                beginInfo.pClearValues = pass.m_ClearValues.data();
+                p_CommandBuffer.beginRenderPass(beginInfo, pass.m_UsesSecondaries ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
+            }
+            if (pass.m_Execute) pass.m_Execute(context);
+            if (pass.m_RenderPass) p_CommandBuffer.endRenderPass();
+        }
+
+        RecordBarriers(p_CommandBuffer, m_Barriers.size() - m_FinalBarrierCount, m_FinalBarrierCount, p_ImportIndex);
+    }
+
+    vk::Image GetImage(ImageHandle p_Image, uint32_t p_ImportIndex) const
+    {
+        const ImageResource& image = m_Images[p_Image];
+        return image.isImported ? image.importedImages[p_ImportIndex % image.importedImages.size()] : image.image;
+    }
+
+    vk::Extent2D GetExtent(ImageHandle p_Image) const { return m_Images[p_Image].extent; }
+
+    // Valid once compiled, and stable across Reset() for passes declared with the same attachment formats and ops
+    vk::RenderPass GetRenderPass(PassHandle p_Pass) const { return m_Passes[p_Pass].m_RenderPass; }
+    vk::Framebuffer GetFramebuffer(PassHandle p_Pass, uint32_t p_ImportIndex) const
+    {
+        const std::vector<vk::Framebuffer>& framebuffers = m_Passes[p_Pass].m_Framebuffers;
+        return framebuffers[p_ImportIndex % framebuffers.size()];
+    }
+
+    // Barriers recorded by every Execute(), counting each image and buffer barrier
+    uint32_t GetBarrierCount() const { return static_cast<uint32_t>(m_Barriers.size()); }
+
+    // Memory of the transient images, with aliasing (the peak of the frame) and without
+    vk::DeviceSize GetTransientMemorySize() const { return m_TransientMemorySize; }
+    vk::DeviceSize GetUnaliasedMemorySize() const { return m_UnaliasedMemorySize; }
+
+private:
+    struct ImageResource
+    {
+        std::string name;
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        bool isImported = false;
+        std::vector<vk::Image> importedImages;
+        std::vector<vk::ImageView> importedViews;
+        vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags initialStages;
+        bool isExported = false;
+        vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+
+        // Compiled
+        vk::ImageUsageFlags usage; // Of the live passes
+        size_t firstPass = SIZE_MAX; // Lifetime, in live passes
+        size_t lastPass = 0;
+        vk::Image image; // Transient images
+        vk::ImageView view;
+        vk::MemoryRequirements requirements;
+        vk::DeviceSize memoryOffset = 0; // In m_Memory
+    };
+
+    struct BufferResource
+    {
+        std::string name;
+        vk::Buffer buffer;
+    };
+
+    // Synchronization state of a resource while the passes are walked
+    struct AccessState
+    {
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags writeStages; // Of the last write
+        vk::AccessFlags writeAccess;
+        vk::PipelineStageFlags readStages; // Reads since the last write
+        vk::PipelineStageFlags visibleStages; // The last write is visible to these stages and accesses
+        vk::AccessFlags visibleAccess;
+    };
+
+    struct Barrier
+    {
+        bool isImage = true;
+        uint32_t resource = 0;
+        vk::PipelineStageFlags srcStages;
+        vk::AccessFlags srcAccess;
+        vk::PipelineStageFlags dstStages;
+        vk::AccessFlags dstAccess;
+        vk::ImageLayout oldLayout = vk::ImageLayout::eUndefined;
+        vk::ImageLayout newLayout = vk::ImageLayout::eUndefined;
+    };
+
+    struct CachedRenderPass
+    {
+        std::vector<vk::Format> formats;
+        std::vector<vk::AttachmentLoadOp> loadOps;
+        std::vector<vk::AttachmentStoreOp> storeOps;
+        vk::RenderPass renderPass;
+    };
+
+    struct Retired
+    {
+        uint64_t retireValue = 0;
+        std::vector<vk::Image> images;
+        std::vector<vk::ImageView> imageViews;
+        std::vector<vk::Framebuffer> framebuffers;
+        MemoryAllocation memory;
+    };
+
+    static constexpr vk::AccessFlags WRITE_ACCESS = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eColorAttachmentWrite |
+        vk::AccessFlagBits::eDepthStencilAttachmentWrite | vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eHostWrite |
+        vk::AccessFlagBits::eMemoryWrite;
+
+    vk::Device m_Device;
+    DeviceMemoryAllocator* m_pAllocator = nullptr;
+    std::vector<ImageResource> m_Images;
+    std::vector<BufferResource> m_Buffers;
+    std::deque<Pass> m_Passes; // Deque so AddPass() references stay valid
+    std::vector<CachedRenderPass> m_RenderPasses;
+    std::deque<Retired> m_Retired;
+    bool m_IsCompiled = false;
+
+    MemoryAllocation m_Memory; // Of every transient image
+    vk::DeviceSize m_TransientMemorySize = 0;
+    vk::DeviceSize m_UnaliasedMemorySize = 0;
+    std::vector<Barrier> m_Barriers; // Of every pass in order, then the final transitions of the exported images
+    size_t m_FinalBarrierCount = 0;
+    size_t m_CulledPassCount = 0;
+
+    // Walks the passes backwards from the exported images, a pass is live if it writes something a later live pass
+    // reads. An attachment that isn't loaded replaces the content the passes before it wrote.
+    void CullPasses()
+    {
+        std::vector<bool> imageNeeded(m_Images.size(), false);
+        std::vector<bool> bufferNeeded(m_Buffers.size(), false);
+        for (size_t i = 0; i < m_Images.size(); i++) imageNeeded[i] = m_Images[i].isExported;
+
+        m_CulledPassCount = 0;
+        for (auto pass = m_Passes.rbegin(); pass != m_Passes.rend(); ++pass)
+        {
+            pass->m_IsLive = pass->m_HasSideEffects;
+            for (const Pass::ImageAccess& access : pass->m_ImageAccesses) pass->m_IsLive |= access.isWrite && imageNeeded[access.image];
+            for (const Pass::BufferAccess& access : pass->m_BufferAccesses) pass->m_IsLive |= access.isWrite && bufferNeeded[access.buffer];
+            if (!pass->m_IsLive)
+            {
+                m_CulledPassCount++;
+                continue;
+            }
+
+            for (const Pass::ColorAttachment& attachment : pass->m_ColorAttachments)
+            {
+                if (attachment.loadOp != vk::AttachmentLoadOp::eLoad) imageNeeded[attachment.image] = false;
+            }
+            for (const Pass::ImageAccess& access : pass->m_ImageAccesses) imageNeeded[access.image] = imageNeeded[access.image] || access.isRead;
+            for (const Pass::BufferAccess& access : pass->m_BufferAccesses) bufferNeeded[access.buffer] = bufferNeeded[access.buffer] || access.isRead;
+        }
+    }
+
+    void ComputeLifetimes()
+    {
+        size_t liveIndex = 0;
+        for (const Pass& pass : m_Passes)
+        {
+            if (!pass.m_IsLive) continue;
+            for (const Pass::ImageAccess& access : pass.m_ImageAccesses)
+            {
+                ImageResource& image = m_Images[access.image];
+                image.usage |= access.usage.usage;
+                image.firstPass = std::min(image.firstPass, liveIndex);
+                image.lastPass = std::max(image.lastPass, liveIndex);
+            }
+            liveIndex++;
+        }
+    }
+
+    static bool LifetimesOverlap(const ImageResource& p_A, const ImageResource& p_B)
+    {
+        return (p_A.firstPass <= p_B.lastPass) && (p_B.firstPass <= p_A.lastPass);
+    }
+
+    static bool MemoryOverlaps(const ImageResource& p_A, const ImageResource& p_B)
+    {
+        return (p_A.memoryOffset < p_B.memoryOffset + p_B.requirements.size) && (p_B.memoryOffset < p_A.memoryOffset + p_A.requirements.size);
+    }
+
+    // The transient images of the live passes share one allocation. Largest first, each image goes at the lowest
+    // offset that doesn't overlap an image placed before it whose lifetime overlaps its own.
+    void CreateTransientImages()
+    {
+        std::vector<ImageHandle> transients;
+        for (ImageHandle handle = 0; handle < m_Images.size(); handle++)
+        {
+            ImageResource& image = m_Images[handle];
+            if (image.isImported || (image.firstPass == SIZE_MAX)) continue;
+
+            vk::ImageCreateInfo createInfo;
+            createInfo.imageType = vk::ImageType::e2D;
+            createInfo.format = image.format;
+            createInfo.extent = vk::Extent3D(image.extent.width, image.extent.height, 1);
+            createInfo.mipLevels = 1;
+            createInfo.arrayLayers = 1;
+            createInfo.samples = vk::SampleCountFlagBits::e1;
+            createInfo.tiling = vk::ImageTiling::eOptimal;
+            createInfo.usage = image.usage;
+            createInfo.sharingMode = vk::SharingMode::eExclusive;
+            createInfo.initialLayout = vk::ImageLayout::eUndefined;
+            image.image = m_Device.createImage(createInfo);
+            image.requirements = m_Device.getImageMemoryRequirements(image.image);
+            transients.push_back(handle);
+        }
+
+        m_TransientMemorySize = 0;
+        m_UnaliasedMemorySize = 0;
+        if (transients.empty()) return;
+
+        std::sort(transients.begin(), transients.end(),
+            [&](ImageHandle p_A, ImageHandle p_B) { return m_Images[p_A].requirements.size > m_Images[p_B].requirements.size; });
+
+        vk::MemoryRequirements heapRequirements(0, 1, ~0u);
+        for (size_t i = 0; i < transients.size(); i++)
+        {
+            ImageResource& image = m_Images[transients[i]];
+            heapRequirements.alignment = std::max(heapRequirements.alignment, image.requirements.alignment);
+            heapRequirements.memoryTypeBits &= image.requirements.memoryTypeBits;
+            m_UnaliasedMemorySize += image.requirements.size;
+
+            // Candidate offsets are the start of the heap and the ends of the conflicting images, lowest first
+            std::vector<vk::DeviceSize> candidates = { 0 };
+            for (size_t j = 0; j < i; j++)
+            {
+                const ImageResource& placed = m_Images[transients[j]];
+                if (LifetimesOverlap(image, placed)) candidates.push_back(placed.memoryOffset + placed.requirements.size);
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            for (vk::DeviceSize candidate : candidates)
+            {
+                image.memoryOffset = AlignUp(candidate, image.requirements.alignment);
+                bool fits = true;
+                for (size_t j = 0; (j < i) && fits; j++)
+                {
+                    const ImageResource& placed = m_Images[transients[j]];
+                    fits = !LifetimesOverlap(image, placed) || !MemoryOverlaps(image, placed);
+                }
+                if (fits) break;
+            }
+            heapRequirements.size = std::max(heapRequirements.size, image.memoryOffset + image.requirements.size);
+        }
+        if (heapRequirements.memoryTypeBits == 0) throw std::runtime_error("The transient images of the render graph have no memory type in common.");
+
+        m_TransientMemorySize = heapRequirements.size;
+        m_Memory = m_pAllocator->Allocate(heapRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal, ResourceTiling::Optimal);
+        for (ImageHandle handle : transients)
+        {
+            ImageResource& image = m_Images[handle];
+            m_Device.bindImageMemory(image.image, m_Memory.memory, m_Memory.offset + image.memoryOffset);
+
+            vk::ImageViewCreateInfo viewInfo;
+            viewInfo.image = image.image;
+            viewInfo.viewType = vk::ImageViewType::e2D;
+            viewInfo.format = image.format;
+            viewInfo.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+            image.view = m_Device.createImageView(viewInfo);
+        }
+    }
+
+    // Attachments stay in ColorAttachmentOptimal inside the render pass, the barriers before it transition them. An
+    // attachment is only stored if something reads it afterwards.
+    void CreateRenderPasses()
+    {
+        size_t liveIndex = 0;
+        for (Pass& pass : m_Passes)
+        {
+            if (!pass.m_IsLive) continue;
+            liveIndex++;
+            if (pass.m_ColorAttachments.empty()) continue;
+
+            CachedRenderPass key;
+            std::vector<vk::ImageView> views;
+            size_t framebufferCount = 1;
+            pass.m_Extent = m_Images[pass.m_ColorAttachments[0].image].extent;
+            for (const Pass::ColorAttachment& attachment : pass.m_ColorAttachments)
+            {
+                const ImageResource& image = m_Images[attachment.image];
+                if ((image.extent.width != pass.m_Extent.width) || (image.extent.height != pass.m_Extent.height))
+                {
+                    throw std::runtime_error("The attachments of render graph pass \"" + pass.m_Name + "\" have different sizes.");
+                }
+                const bool isStored = image.isImported || (image.lastPass >= liveIndex);
+                key.formats.push_back(image.format);
+                key.loadOps.push_back(attachment.loadOp);
+                key.storeOps.push_back(isStored ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare);
+                if (image.isImported) framebufferCount = std::max(framebufferCount, image.importedViews.size());
+                pass.m_ClearValues.push_back(vk::ClearValue(attachment.clearValue));
+            }
+            pass.m_RenderPass = GetOrCreateRenderPass(key);
+
+            for (size_t i = 0; i < framebufferCount; i++)
+            {
+                views.clear();
+                for (const Pass::ColorAttachment& attachment : pass.m_ColorAttachments)
+                {
+                    const ImageResource& image = m_Images[attachment.image];
+                    views.push_back(image.isImported ? image.importedViews[i % image.importedViews.size()] : image.view);
+                }
+
+                vk::FramebufferCreateInfo createInfo;
+                createInfo.renderPass = pass.m_RenderPass;
+                createInfo.attachmentCount = static_cast<uint32_t>(views.size());
+                createInfo.pAttachments = views.data();
+                createInfo.width = pass.m_Extent.width;
+                createInfo.height = pass.m_Extent.height;
+                createInfo.layers = 1;
+                pass.m_Framebuffers.push_back(m_Device.createFramebuffer(createInfo));
+            }
+        }
+    }
+
+    vk::RenderPass GetOrCreateRenderPass(CachedRenderPass& p_Key)
+    {
+        for (const CachedRenderPass& cached : m_RenderPasses)
+        {
+            if ((cached.formats == p_Key.formats) && (cached.loadOps == p_Key.loadOps) && (cached.storeOps == p_Key.storeOps)) return cached.renderPass;
+        }
+
+        std::vector<vk::AttachmentDescription> attachments;
+        std::vector<vk::AttachmentReference> references;
+        for (size_t i = 0; i < p_Key.formats.size(); i++)
+        {
+            vk::AttachmentDescription attachment;
+            attachment.format = p_Key.formats[i];
+            attachment.samples = vk::SampleCountFlagBits::e1;
+            attachment.loadOp = p_Key.loadOps[i];
+            attachment.storeOp = p_Key.storeOps[i];
+            attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+            attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+            attachment.initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
+            attachment.finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+            attachments.push_back(attachment);
+            references.push_back(vk::AttachmentReference(static_cast<uint32_t>(i), vk::ImageLayout::eColorAttachmentOptimal));
+        }
+
+        vk::SubpassDescription subpass;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(references.size());
+        subpass.pColorAttachments = references.data();
+
+        vk::RenderPassCreateInfo createInfo;
+        createInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        createInfo.pAttachments = attachments.data();
+        createInfo.subpassCount = 1;
+        createInfo.pSubpasses = &subpass;
+        p_Key.renderPass = m_Device.createRenderPass(createInfo);
+        m_RenderPasses.push_back(p_Key);
+        return p_Key.renderPass;
+    }
+
+    // Adds the barrier an access needs after the state of the resource, if any, and applies the access.
+    // Read after read in the same layout needs nothing once the write before is visible to the reading stages.
+    static bool Access(AccessState& p_State, vk::PipelineStageFlags p_Stages, vk::AccessFlags p_Access, vk::ImageLayout p_Layout, bool p_IsImage,
+        bool p_IsWrite, Barrier& p_Barrier)
+    {
+        const bool isLayoutChange = p_IsImage && (p_Layout != p_State.layout);
+        bool isNeeded = isLayoutChange;
+        if (p_IsWrite || isLayoutChange)
+        {
+            // Write after write and write after read. A layout transition is a write.
+            p_Barrier.srcStages = p_State.writeStages | p_State.readStages;
+            p_Barrier.srcAccess = p_State.writeAccess;
+            isNeeded |= bool(p_Barrier.srcStages);
+        }
+        else if (p_State.writeStages && (((p_Stages & ~p_State.visibleStages) != vk::PipelineStageFlags()) || ((p_Access & ~p_State.visibleAccess) != vk::AccessFlags())))
+        {
+            // Read after write
+            p_Barrier.srcStages = p_State.writeStages;
+            p_Barrier.srcAccess = p_State.writeAccess;
+            isNeeded = true;
+        }
+
+        if (isNeeded)
+        {
+            if (!p_Barrier.srcStages) p_Barrier.srcStages = vk::PipelineStageFlagBits::eTopOfPipe;
+            p_Barrier.dstStages = p_Stages;
+            p_Barrier.dstAccess = p_Access;
+            p_Barrier.oldLayout = p_State.layout;
+            p_Barrier.newLayout = p_Layout;
+        }
+
+        if (p_IsWrite)
+        {
+            p_State = AccessState();
+            p_State.writeStages = p_Stages;
+            p_State.writeAccess = p_Access & WRITE_ACCESS;
+        }
+        else
+        {
+            p_State.readStages |= p_Stages;
+            if (isNeeded)
+            {
+                p_State.visibleStages |= p_Stages;
+                p_State.visibleAccess |= p_Access;
+            }
+        }
+        p_State.layout = p_Layout;
+        return isNeeded;
+    }
+
+    // Walks the live passes twice. The first walk starts from nothing and ends in the state a frame leaves the
+    // resources in; the second starts from that state, so its barriers also order each frame after the previous
+    // one, and it is the one recorded. A transient image starts undefined, and its first barrier also waits for the
+    // images that share its memory.
+    void DeriveBarriers()
+    {
+        std::vector<AccessState> imageStates(m_Images.size());
+        std::vector<AccessState> bufferStates(m_Buffers.size());
+        std::vector<AccessState> aliasStates(m_Images.size()); // Accesses of the images sharing its memory, transient images only
+
+        for (int walk = 0; walk < 2; walk++)
+        {
+            if (walk == 1)
+            {
+                // Every image's final accesses, as the next frame sees them
+                for (ImageHandle handle = 0; handle < m_Images.size(); handle++)
+                {
+                    const ImageResource& image = m_Images[handle];
+                    if (image.isImported || !image.image) continue;
+                    for (ImageHandle other = 0; other < m_Images.size(); other++)
+                    {
+                        const ImageResource& otherImage = m_Images[other];
+                        if (otherImage.isImported || !otherImage.image || !MemoryOverlaps(image, otherImage)) continue;
+                        aliasStates[handle].writeStages |= imageStates[other].writeStages;
+                        aliasStates[handle].writeAccess |= imageStates[other].writeAccess;
+                        aliasStates[handle].readStages |= imageStates[other].readStages;
+                    }
+                }
+            }
+            for (ImageHandle handle = 0; handle < m_Images.size(); handle++)
+            {
+                const ImageResource& image = m_Images[handle];
+                imageStates[handle] = AccessState();
+                imageStates[handle].layout = image.initialLayout;
+                if (image.isImported) imageStates[handle].writeStages = image.initialStages;
+            }
+            m_Barriers.clear();
+
+            size_t liveIndex = 0;
+            for (Pass& pass : m_Passes)
+            {
+                if (!pass.m_IsLive) continue;
+                pass.m_FirstBarrier = m_Barriers.size();
+
+                for (const Pass::ImageAccess& access : pass.m_ImageAccesses)
+                {
+                    AccessState& state = imageStates[access.image];
+                    if ((walk == 1) && (m_Images[access.image].firstPass == liveIndex) && !m_Images[access.image].isImported)
+                    {
+                        const AccessState& alias = aliasStates[access.image];
+                        state.writeStages |= alias.writeStages;
+                        state.writeAccess |= alias.writeAccess;
+                        state.readStages |= alias.readStages;
+                    }
+
+                    Barrier barrier;
+                    barrier.resource = access.image;
+                    if (Access(state, access.usage.stages, access.usage.access, access.usage.layout, true, access.isWrite, barrier)) AddBarrier(pass, barrier);
+                }
+                for (const Pass::BufferAccess& access : pass.m_BufferAccesses)
+                {
+                    Barrier barrier;
+                    barrier.isImage = false;
+                    barrier.resource = access.buffer;
+                    if (Access(bufferStates[access.buffer], access.usage.stages, access.usage.access, vk::ImageLayout::eUndefined, false, access.isWrite, barrier))
+                    {
+                        AddBarrier(pass, barrier);
+                    }
+                }
+                pass.m_BarrierCount = m_Barriers.size() - pass.m_FirstBarrier;
+                liveIndex++;
+            }
+
+            // The exported images are left in their final layout for whatever uses them after the frame
+            const size_t finalBarrier = m_Barriers.size();
+            for (ImageHandle handle = 0; handle < m_Images.size(); handle++)
+            {
+                const ImageResource& image = m_Images[handle];
+                if (!image.isExported || (imageStates[handle].layout == image.finalLayout)) continue;
+
+                Barrier barrier;
+                barrier.resource = handle;
+                barrier.srcStages = imageStates[handle].writeStages | imageStates[handle].readStages;
+                barrier.srcAccess = imageStates[handle].writeAccess;
+                if (!barrier.srcStages) barrier.srcStages = vk::PipelineStageFlagBits::eTopOfPipe;
+                barrier.dstStages = vk::PipelineStageFlagBits::eBottomOfPipe;
+                barrier.oldLayout = imageStates[handle].layout;
+                barrier.newLayout = image.finalLayout;
+                m_Barriers.push_back(barrier);
+                imageStates[handle].layout = image.finalLayout;
+            }
+            m_FinalBarrierCount = m_Barriers.size() - finalBarrier;
+        }
+    }
+
+    // A resource accessed twice by a pass gets one barrier
+    void AddBarrier(const Pass& p_Pass, const Barrier& p_Barrier)
+    {
+        for (size_t i = p_Pass.m_FirstBarrier; i < m_Barriers.size(); i++)
+        {
+            Barrier& barrier = m_Barriers[i];
+            if ((barrier.isImage != p_Barrier.isImage) || (barrier.resource != p_Barrier.resource)) continue;
+            barrier.srcStages |= p_Barrier.srcStages;
+            barrier.srcAccess |= p_Barrier.srcAccess;
+            barrier.dstStages |= p_Barrier.dstStages;
+            barrier.dstAccess |= p_Barrier.dstAccess;
+            barrier.newLayout = p_Barrier.newLayout;
+            return;
+        }
+        m_Barriers.push_back(p_Barrier);
+    }
+
+    void RecordBarriers(vk::CommandBuffer p_CommandBuffer, size_t p_First, size_t p_Count, uint32_t p_ImportIndex) const
+    {
+        if (p_Count == 0) return;
+
+        vk::PipelineStageFlags srcStages;
+        vk::PipelineStageFlags dstStages;
+        std::vector<vk::ImageMemoryBarrier> imageBarriers;
+        std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+        for (size_t i = p_First; i < p_First + p_Count; i++)
+        {
+            const Barrier& barrier = m_Barriers[i];
+            srcStages |= barrier.srcStages;
+            dstStages |= barrier.dstStages;
+            if (barrier.isImage)
+            {
+                vk::ImageMemoryBarrier imageBarrier(barrier.srcAccess, barrier.dstAccess, barrier.oldLayout, barrier.newLayout, VK_QUEUE_FAMILY_IGNORED,
+                    VK_QUEUE_FAMILY_IGNORED, GetImage(barrier.resource, p_ImportIndex), vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+                imageBarriers.push_back(imageBarrier);
+            }
+            else
+            {
+                bufferBarriers.push_back(vk::BufferMemoryBarrier(barrier.srcAccess, barrier.dstAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                    m_Buffers[barrier.resource].buffer, 0, VK_WHOLE_SIZE));
+            }
+        }
+        p_CommandBuffer.pipelineBarrier(srcStages, dstStages, vk::DependencyFlags(), {}, bufferBarriers, imageBarriers);
+    }
+
+    void LogStats() const
+    {
+        size_t transientCount = 0;
+        for (const ImageResource& image : m_Images) transientCount += image.image ? 1 : 0;
+        std::cerr << "Render graph: " << (m_Passes.size() - m_CulledPassCount) << " pass(es), " << m_CulledPassCount << " culled, "
+            << transientCount << " transient image(s) in " << (m_TransientMemorySize >> 10) << " KB instead of " << (m_UnaliasedMemorySize >> 10)
+            << " KB, " << m_Barriers.size() << " barrier(s) per frame" << std::endl;
+    }
+};
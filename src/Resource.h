@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ResourceFormat.h"
+#include "ResourcePack.h"
+
+// Bump allocator for decompressed resources. They live until the process exits, so memory is only ever released
+// as a whole.
+class ResourceArena
+{
+public:
+    static ResourceArena& Get()
+    {
+        static ResourceArena arena;
+        return arena;
+    }
+
+    uint8_t* Allocate(size_t p_Size, size_t p_Alignment = 16)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (!m_Blocks.empty())
+        {
+            const uintptr_t base = reinterpret_cast<uintptr_t>(m_Blocks.back().get());
+            const uintptr_t address = AlignUp(base + m_Used, p_Alignment);
+            if (address + p_Size <= base + m_BlockSize)
+            {
+                m_Used = address + p_Size - base;
+                return reinterpret_cast<uint8_t*>(address);
+            }
+        }
+
+        m_BlockSize = std::max(BLOCK_SIZE, p_Size + p_Alignment);
+        m_Blocks.emplace_back(new uint8_t[m_BlockSize]); // Not value-initialized, unlike make_unique
+        const uintptr_t base = reinterpret_cast<uintptr_t>(m_Blocks.back().get());
+        const uintptr_t address = AlignUp(base, p_Alignment);
+        m_Used = address + p_Size - base;
+        return reinterpret_cast<uint8_t*>(address);
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 4 * 1024 * 1024;
+
+    std::mutex m_Mutex;
+    std::vector<std::unique_ptr<uint8_t[]>> m_Blocks;
+    size_t m_BlockSize = 0;
+    size_t m_Used = 0;
+
+    static uintptr_t AlignUp(uintptr_t p_Value, size_t p_Alignment)
+    {
+        return (p_Value + p_Alignment - 1) & ~uintptr_t(p_Alignment - 1);
+    }
+};
+
+// Typed read-only view of a resource's bytes
+template <typename T>
+class ResourceView
+{
+public:
+    ResourceView(const T* p_pData, size_t p_Count) : m_pData(p_pData), m_Count(p_Count) {}
+
+    const T* Data() const { return m_pData; }
+    size_t Count() const { return m_Count; }
+    size_t SizeInBytes() const { return m_Count * sizeof(T); }
+
+    const T* begin() const { return m_pData; }
+    const T* end() const { return m_pData + m_Count; }
+
+private:
+    const T* m_pData;
+    size_t m_Count;
+};
+
+// Resource embedded by the ResourceCompiler or stored in a mounted ResourcePack, which takes precedence. The
+// source is picked on first access, so packs have to be mounted before. Compressed resources are decompressed on
+// first access into the ResourceArena, with the chunks spread over worker threads. First-use latency is logged so
+// it can be weighed against the binary size saved.
+class Resource
+{
+public:
+    Resource(const char* p_Name, const unsigned char* p_pData, size_t p_Size, uint32_t p_Flags) :
+        m_Name(p_Name), m_pStoredData(p_pData), m_StoredSize(p_Size), m_Flags(p_Flags)
+    {
+    }
+
+    Resource(const Resource&) = delete;
+    Resource& operator=(const Resource&) = delete;
+
+    const uint8_t* Data() const
+    {
+        Load();
+        return m_pData;
+    }
+
+    size_t Size() const
+    {
+        Load();
+        return m_Size;
+    }
+
+    // Views the data in place as an array of T. Throws if the data isn't aligned for T or isn't a whole number of T.
+    template <typename T>
+    ResourceView<T> As() const
+    {
+        const uint8_t* pData = Data();
+        if ((reinterpret_cast<uintptr_t>(pData) % alignof(T) != 0) || (m_Size % sizeof(T) != 0))
+        {
+            throw std::runtime_error("Resource \"" + m_Name + "\" can't be viewed as an array of " + std::to_string(sizeof(T)) + "-byte elements.");
+        }
+        return ResourceView<T>(reinterpret_cast<const T*>(pData), m_Size / sizeof(T));
+    }
+
+    const std::string& GetName() const { return m_Name; }
+
+    size_t GetStoredSize() const
+    {
+        Load();
+        return m_StoredSize;
+    }
+
+    bool IsCompressed() const
+    {
+        Load();
+        return (m_Flags & RESOURCE_FLAG_COMPRESSED) != 0;
+    }
+
+    bool IsSpirv() const
+    {
+        Load();
+        return (m_Flags & RESOURCE_FLAG_SPIRV) != 0;
+    }
+
+    // The data starts with a MeshHeader, see ReadMeshHeader()
+    bool IsMesh() const
+    {
+        Load();
+        return (m_Flags & RESOURCE_FLAG_MESH) != 0;
+    }
+
+    bool IsPacked() const
+    {
+        Load();
+        return m_IsPacked;
+    }
+
+private:
+    std::string m_Name;
+    mutable const uint8_t* m_pStoredData;
+    mutable size_t m_StoredSize;
+    mutable uint32_t m_Flags;
+    mutable bool m_IsPacked = false;
+
+    mutable std::once_flag m_LoadFlag;
+    mutable const uint8_t* m_pData = nullptr;
+    mutable size_t m_Size = 0;
+
+    void Load() const
+    {
+        std::call_once(m_LoadFlag, [this]() {
+            m_IsPacked = ResourcePacks::Get().Find(m_Name, m_pStoredData, m_StoredSize, m_Flags);
+            if (!m_IsPacked && !m_pStoredData)
+            {
+                throw std::runtime_error("Resource \"" + m_Name + "\" is neither embedded nor in a mounted resource pack.");
+            }
+
+            if (m_Flags & RESOURCE_FLAG_COMPRESSED)
+            {
+                Decompress();
+            }
+            else
+            {
+                m_pData = m_pStoredData;
+                m_Size = m_StoredSize;
+            }
+        });
+    }
+
+    void Decompress() const
+    {
+        const auto startTime = std::chrono::steady_clock::now();
+
+        CompressedResourceHeader header;
+        if (!ReadCompressedResourceHeader(m_pStoredData, m_StoredSize, header))
+        {
+            throw std::runtime_error("Invalid compressed resource \"" + m_Name + "\".");
+        }
+
+        uint8_t* pOutput = ResourceArena::Get().Allocate(static_cast<size_t>(header.size));
+
+        // The calling thread decodes chunks too
+        const uint32_t threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), header.chunkCount));
+        std::atomic<uint32_t> nextChunk{ 0 };
+        std::atomic<bool> isValid{ true };
+        auto decodeChunks = [&]() {
+            for (uint32_t chunk = nextChunk++; chunk < header.chunkCount; chunk = nextChunk++)
+            {
+                if (!DecompressResourceChunk(m_pStoredData, m_StoredSize, header, chunk, pOutput)) isValid = false;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (uint32_t i = 1; i < threadCount; i++) workers.emplace_back(decodeChunks);
+        decodeChunks();
+        for (std::thread& worker : workers) worker.join();
+
+        if (!isValid) throw std::runtime_error("Failed to decompress resource \"" + m_Name + "\".");
+
+        m_pData = pOutput;
+        m_Size = static_cast<size_t>(header.size);
+
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::cerr << "Resource \"" << m_Name << "\": decompressed " << m_StoredSize << " -> " << m_Size << " bytes in "
+            << milliseconds << " ms on " << threadCount << " thread(s)" << std::endl;
+    }
+};
+
+// Layout of the entries of the table generated for a target in batch mode (struct rc_table_entry)
+struct ResourceTableEntry
+{
+    const char* name;
+    const void* data;
+    const size_t* size;
+    uint32_t flags;
+};
+
+// Every resource of a target, looked up by name
+class ResourceTable
+{
+public:
+    ResourceTable(const ResourceTableEntry* p_pEntries, size_t p_Count)
+    {
+        m_Resources.reserve(p_Count);
+        for (size_t i = 0; i < p_Count; i++)
+        {
+            const ResourceTableEntry& entry = p_pEntries[i];
+            m_Resources.emplace_back(std::make_unique<Resource>(entry.name, static_cast<const unsigned char*>(entry.data), *entry.size, entry.flags));
+        }
+    }
+
+    // Returns nullptr if there is no resource with this name
+    const Resource* Find(const std::string& p_Name) const
+    {
+        for (const std::unique_ptr<Resource>& pResource : m_Resources)
+        {
+            if (pResource->GetName() == p_Name) return pResource.get();
+        }
+        return nullptr;
+    }
+
+    size_t Count() const { return m_Resources.size(); }
+    const Resource& operator[](size_t p_Index) const { return *m_Resources[p_Index]; }
+
+private:
+    std::vector<std::unique_ptr<Resource>> m_Resources;
+};
+
+#define LOAD_RESOURCE_TABLE(VAR_NAME, TARGET_NAME) \
+    extern "C" const ResourceTableEntry rc_table_##TARGET_NAME[]; \
+    extern "C" const size_t rc_table_count_##TARGET_NAME; \
+    const ResourceTable VAR_NAME(rc_table_##TARGET_NAME, rc_table_count_##TARGET_NAME);
+
+// The embedded symbols are weak where the toolchain allows it, so a resource that only ships in a pack links with
+// null data. MSVC has no weak references, every resource loaded there has to be embedded.
+#if defined(__GNUC__) || defined(__clang__)
+#define RC_WEAK __attribute__((weak))
+#else
+#define RC_WEAK
+#endif
+
+#define LOAD_RESOURCE(VAR_NAME, RESOURCE_NAME) \
+    extern "C" RC_WEAK const size_t rc_size_##RESOURCE_NAME; \
+    extern "C" RC_WEAK const unsigned char rc_data_##RESOURCE_NAME[]; \
+    extern "C" RC_WEAK const uint32_t rc_flags_##RESOURCE_NAME; \
+    const Resource VAR_NAME(#RESOURCE_NAME, rc_data_##RESOURCE_NAME, rc_data_##RESOURCE_NAME ? rc_size_##RESOURCE_NAME : 0, \
+        rc_data_##RESOURCE_NAME ? rc_flags_##RESOURCE_NAME : 0);
+
+// SPIR-V resources (target_shader) are emitted as 4-byte aligned uint32_t arrays
+#define LOAD_SHADER(VAR_NAME, RESOURCE_NAME) \
+    extern "C" RC_WEAK const size_t rc_size_##RESOURCE_NAME; \
+    extern "C" RC_WEAK const uint32_t rc_data_##RESOURCE_NAME[]; \
+    extern "C" RC_WEAK const uint32_t rc_flags_##RESOURCE_NAME; \
+    const Resource VAR_NAME(#RESOURCE_NAME, reinterpret_cast<const unsigned char*>(rc_data_##RESOURCE_NAME), \
+        rc_data_##RESOURCE_NAME ? rc_size_##RESOURCE_NAME : 0, rc_data_##RESOURCE_NAME ? rc_flags_##RESOURCE_NAME : 0);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ResourceFormat.h"
+
+// Pack file built by the ResourceCompiler (-format pack). Lookups hash the name and compare the entries of one
+// bucket, and return the payload in place in the mapping.
+class ResourcePack
+{
+public:
+    bool Open(const std::string& p_Path)
+    {
+        if (!m_File.Open(p_Path) || !ReadResourcePackHeader(m_File.Data(), m_File.Size(), m_Header))
+        {
+            std::cerr << "Invalid resource pack \"" << p_Path << "\"." << std::endl;
+            return false;
+        }
+        m_Path = p_Path;
+        return true;
+    }
+
+    bool Find(const std::string& p_Name, const uint8_t*& p_pData, size_t& p_Size, uint32_t& p_Flags) const
+    {
+        ResourcePackEntry entry;
+        if (!FindResourcePackEntry(m_File.Data(), m_Header, p_Name.data(), p_Name.size(), entry)) return false;
+
+        p_pData = m_File.Data() + entry.offset;
+        p_Size = static_cast<size_t>(entry.size);
+        p_Flags = entry.flags;
+        return true;
+    }
+
+    const std::string& GetPath() const { return m_Path; }
+    uint32_t GetResourceCount() const { return m_Header.entryCount; }
+
+private:
+    MappedFile m_File;
+    ResourcePackHeader m_Header = {};
+    std::string m_Path;
+};
+
+// Packs mounted by the application. A resource found in a pack takes precedence over the embedded one, so assets
+// can be shipped or updated without relinking. Packs stay mapped until the process exits.
+class ResourcePacks
+{
+public:
+    static ResourcePacks& Get()
+    {
+        static ResourcePacks packs;
+        return packs;
+    }
+
+    // Packs mounted later take precedence over earlier ones
+    bool Mount(const std::string& p_Path)
+    {
+        auto pPack = std::make_unique<ResourcePack>();
+        if (!pPack->Open(p_Path)) return false;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::cerr << "Mounted resource pack \"" << p_Path << "\" (" << pPack->GetResourceCount() << " resources)" << std::endl;
+        m_Packs.insert(m_Packs.begin(), std::move(pPack));
+        return true;
+    }
+
+    bool Find(const std::string& p_Name, const uint8_t*& p_pData, size_t& p_Size, uint32_t& p_Flags) const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (const std::unique_ptr<ResourcePack>& pPack : m_Packs)
+        {
+            if (pPack->Find(p_Name, p_pData, p_Size, p_Flags)) return true;
+        }
+        return false;
+    }
+
+private:
+    mutable std::mutex m_Mutex;
+    std::vector<std::unique_ptr<ResourcePack>> m_Packs;
+};
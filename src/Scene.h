@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Widest instruction set the build targets, SceneBenchmark compares it with the scalar path
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SCENE_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SCENE_SIMD_WIDTH 4
+#else
+#define SCENE_SIMD_WIDTH 1
+#endif
+
+// Node transforms in structure-of-arrays form: one array per component of the local and world translation, rotation
+// and uniform scale, and of the world matrices. Nodes are stored sorted by depth, so a level only reads the world
+// transforms of levels already updated and its nodes are updated SCENE_SIMD_WIDTH at a time. Setting a local
+// transform marks the node dirty, and Update() only recomputes the blocks of nodes with a dirty node or ancestor.
+// WriteInstances() streams the world matrices to instance data, typically persistently mapped GPU memory.
+class Scene
+{
+public:
+    using NodeId = uint32_t;
+    static constexpr NodeId NO_PARENT = UINT32_MAX;
+    static constexpr uint32_t INSTANCE_SIZE = 12 * sizeof(float); // World matrix, 3 rows of 4 floats
+
+    void Reserve(uint32_t p_NodeCount)
+    {
+        for (std::vector<float>& component : m_Locals) component.reserve(p_NodeCount);
+        for (std::vector<float>& component : m_Worlds) component.reserve(p_NodeCount);
+        for (std::vector<float>& component : m_Matrices) component.reserve(p_NodeCount);
+        m_Parents.reserve(p_NodeCount);
+        m_Depths.reserve(p_NodeCount);
+        m_IsDirty.reserve(p_NodeCount);
+        m_IsChanged.reserve(p_NodeCount);
+        m_NodeIds.reserve(p_NodeCount);
+        m_Indices.reserve(p_NodeCount);
+    }
+
+    // p_Parent must have been added before. p_Rotation must be normalized.
+    NodeId AddNode(NodeId p_Parent, const glm::vec3& p_Translation, const glm::quat& p_Rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), float p_Scale = 1.0f)
+    {
+        const NodeId node = static_cast<NodeId>(m_Indices.size());
+        const uint32_t index = GetNodeCount();
+        const uint32_t parent = (p_Parent == NO_PARENT) ? NO_PARENT : m_Indices[p_Parent];
+        const uint32_t depth = (p_Parent == NO_PARENT) ? 0 : m_Depths[parent] + 1;
+
+        for (std::vector<float>& component : m_Locals) component.push_back(0.0f);
+        for (std::vector<float>& component : m_Worlds) component.push_back(0.0f);
+        for (std::vector<float>& component : m_Matrices) component.push_back(0.0f);
+        m_Parents.push_back(parent);
+        m_Depths.push_back(depth);
+        m_IsDirty.push_back(1);
+        m_IsChanged.push_back(0);
+        m_NodeIds.push_back(node);
+        m_Indices.push_back(index);
+        m_IsStructureChanged = true;
+
+        SetTranslation(node, p_Translation);
+        SetRotation(node, p_Rotation);
+        SetScale(node, p_Scale);
+        return node;
+    }
+
+    void SetTranslation(NodeId p_Node, const glm::vec3& p_Translation)
+    {
+        const uint32_t index = m_Indices[p_Node];
+        m_Locals[TX][index] = p_Translation.x;
+        m_Locals[TY][index] = p_Translation.y;
+        m_Locals[TZ][index] = p_Translation.z;
+        m_IsDirty[index] = 1;
+    }
+
+    void SetRotation(NodeId p_Node, const glm::quat& p_Rotation)
+    {
+        const uint32_t index = m_Indices[p_Node];
+        m_Locals[QX][index] = p_Rotation.x;
+        m_Locals[QY][index] = p_Rotation.y;
+        m_Locals[QZ][index] = p_Rotation.z;
+        m_Locals[QW][index] = p_Rotation.w;
+        m_IsDirty[index] = 1;
+    }
+
+    void SetScale(NodeId p_Node, float p_Scale)
+    {
+        const uint32_t index = m_Indices[p_Node];
+        m_Locals[SCALE][index] = p_Scale;
+        m_IsDirty[index] = 1;
+    }
+
+    // Recomputes the world transforms of the dirty nodes and their descendants. Returns the number of nodes that
+    // changed.
+    uint32_t Update() { return UpdateNodes<SimdLanes>(); }
+
+    // Same results as Update(), one node at a time
+    uint32_t UpdateScalar() { return UpdateNodes<ScalarLanes>(); }
+
+    static uint32_t GetSimdWidth() { return SCENE_SIMD_WIDTH; }
+    uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_Parents.size()); }
+
+    // Valid until nodes are added. Must be called after Update().
+    uint32_t GetInstanceIndex(NodeId p_Node) const { return m_Indices[p_Node]; }
+    glm::vec3 GetWorldTranslation(NodeId p_Node) const
+    {
+        const uint32_t index = m_Indices[p_Node];
+        return glm::vec3(m_Worlds[TX][index], m_Worlds[TY][index], m_Worlds[TZ][index]);
+    }
+    float GetWorldScale(NodeId p_Node) const { return m_Worlds[SCALE][m_Indices[p_Node]]; }
+
+    // Writes the world matrix of every node, in instance index order, as INSTANCE_SIZE bytes each. The writes are
+    // sequential, for write-combined memory.
+    void WriteInstances(void* p_pDestination) const
+    {
+        float* pDestination = static_cast<float*>(p_pDestination);
+        const uint32_t count = GetNodeCount();
+        uint32_t i = 0;
+#if SCENE_SIMD_WIDTH > 1
+        // Transposes 4 nodes' rows out of the component arrays
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 rows[3][4];
+            for (uint32_t row = 0; row < 3; row++)
+            {
+                for (uint32_t column = 0; column < 4; column++) rows[row][column] = _mm_loadu_ps(&m_Matrices[row * 4 + column][i]);
+                _MM_TRANSPOSE4_PS(rows[row][0], rows[row][1], rows[row][2], rows[row][3]);
+            }
+            for (uint32_t node = 0; node < 4; node++)
+            {
+                for (uint32_t row = 0; row < 3; row++) _mm_storeu_ps(pDestination + (i + node) * 12 + row * 4, rows[row][node]);
+            }
+        }
+#endif
+        for (; i < count; i++)
+        {
+            for (uint32_t component = 0; component < MATRIX_COMPONENT_COUNT; component++) pDestination[i * 12 + component] = m_Matrices[component][i];
+        }
+    }
+
+private:
+    enum Component : uint32_t { TX, TY, TZ, QX, QY, QZ, QW, SCALE, COMPONENT_COUNT };
+    static constexpr uint32_t MATRIX_COMPONENT_COUNT = 12;
+
+    // Lanes of the update, the math is written once for all widths
+    struct ScalarLanes
+    {
+        static constexpr uint32_t WIDTH = 1;
+        float value;
+
+        static ScalarLanes Set(float p_Value) { return { p_Value }; }
+        static ScalarLanes Load(const float* p_pData) { return { *p_pData }; }
+        static ScalarLanes Gather(const float* p_pData, const uint32_t* p_pIndices) { return { p_pData[p_pIndices[0]] }; }
+        void Store(float* p_pData) const { *p_pData = value; }
+
+        friend ScalarLanes operator+(ScalarLanes p_A, ScalarLanes p_B) { return { p_A.value + p_B.value }; }
+        friend ScalarLanes operator-(ScalarLanes p_A, ScalarLanes p_B) { return { p_A.value - p_B.value }; }
+        friend ScalarLanes operator*(ScalarLanes p_A, ScalarLanes p_B) { return { p_A.value * p_B.value }; }
+    };
+
+#if SCENE_SIMD_WIDTH == 8
+    struct AvxLanes
+    {
+        static constexpr uint32_t WIDTH = 8;
+        __m256 value;
+
+        static AvxLanes Set(float p_Value) { return { _mm256_set1_ps(p_Value) }; }
+        static AvxLanes Load(const float* p_pData) { return { _mm256_loadu_ps(p_pData) }; }
+        static AvxLanes Gather(const float* p_pData, const uint32_t* p_pIndices)
+        {
+            return { _mm256_setr_ps(p_pData[p_pIndices[0]], p_pData[p_pIndices[1]], p_pData[p_pIndices[2]], p_pData[p_pIndices[3]],
+                p_pData[p_pIndices[4]], p_pData[p_pIndices[5]], p_pData[p_pIndices[6]], p_pData[p_pIndices[7]]) };
+        }
+        void Store(float* p_pData) const { _mm256_storeu_ps(p_pData, value); }
+
+        friend AvxLanes operator+(AvxLanes p_A, AvxLanes p_B) { return { _mm256_add_ps(p_A.value, p_B.value) }; }
+        friend AvxLanes operator-(AvxLanes p_A, AvxLanes p_B) { return { _mm256_sub_ps(p_A.value, p_B.value) }; }
+        friend AvxLanes operator*(AvxLanes p_A, AvxLanes p_B) { return { _mm256_mul_ps(p_A.value, p_B.value) }; }
+    };
+    using SimdLanes = AvxLanes;
+#elif SCENE_SIMD_WIDTH == 4
+    struct SseLanes
+    {
+        static constexpr uint32_t WIDTH = 4;
+        __m128 value;
+
+        static SseLanes Set(float p_Value) { return { _mm_set1_ps(p_Value) }; }
+        static SseLanes Load(const float* p_pData) { return { _mm_loadu_ps(p_pData) }; }
+        static SseLanes Gather(const float* p_pData, const uint32_t* p_pIndices)
+        {
+            return { _mm_setr_ps(p_pData[p_pIndices[0]], p_pData[p_pIndices[1]], p_pData[p_pIndices[2]], p_pData[p_pIndices[3]]) };
+        }
+        void Store(float* p_pData) const { _mm_storeu_ps(p_pData, value); }
+
+        friend SseLanes operator+(SseLanes p_A, SseLanes p_B) { return { _mm_add_ps(p_A.value, p_B.value) }; }
+        friend SseLanes operator-(SseLanes p_A, SseLanes p_B) { return { _mm_sub_ps(p_A.value, p_B.value) }; }
+        friend SseLanes operator*(SseLanes p_A, SseLanes p_B) { return { _mm_mul_ps(p_A.value, p_B.value) }; }
+    };
+    using SimdLanes = SseLanes;
+#else
+    using SimdLanes = ScalarLanes;
+#endif
+
+    std::vector<float> m_Locals[COMPONENT_COUNT];
+    std::vector<float> m_Worlds[COMPONENT_COUNT];
+    std::vector<float> m_Matrices[MATRIX_COMPONENT_COUNT]; // Row-major
+    std::vector<uint32_t> m_Parents; // Index, or NO_PARENT for roots
+    std::vector<uint32_t> m_Depths;
+    std::vector<uint8_t> m_IsDirty; // Local transform set since the last update
+    std::vector<uint8_t> m_IsChanged; // Dirty or below a dirty node, in the last update
+    std::vector<NodeId> m_NodeIds; // Of each index
+    std::vector<uint32_t> m_Indices; // Of each node
+    std::vector<uint32_t> m_LevelEnds; // End index of each depth
+    bool m_IsStructureChanged = false;
+
+    template <typename Lanes>
+    uint32_t UpdateNodes()
+    {
+        SortNodes();
+
+        uint32_t changedCount = 0;
+        uint32_t levelBegin = 0;
+        for (uint32_t levelEnd : m_LevelEnds)
+        {
+            // Propagated from the parents, whose level was just updated
+            for (uint32_t i = levelBegin; i < levelEnd; i++)
+            {
+                const uint32_t parent = m_Parents[i];
+                m_IsChanged[i] = m_IsDirty[i] | ((parent != NO_PARENT) ? m_IsChanged[parent] : 0);
+                m_IsDirty[i] = 0;
+                changedCount += m_IsChanged[i];
+            }
+
+            // A block is recomputed whole if any of its nodes changed, which gives the others the same results
+            const bool isRootLevel = (levelBegin == 0);
+            uint32_t i = levelBegin;
+            for (; i + Lanes::WIDTH <= levelEnd; i += Lanes::WIDTH)
+            {
+                if (std::any_of(&m_IsChanged[i], &m_IsChanged[i] + Lanes::WIDTH, [](uint8_t p_IsChanged) { return p_IsChanged != 0; }))
+                {
+                    UpdateBlock<Lanes>(i, isRootLevel);
+                }
+            }
+            for (; i < levelEnd; i++)
+            {
+                if (m_IsChanged[i]) UpdateBlock<ScalarLanes>(i, isRootLevel);
+            }
+            levelBegin = levelEnd;
+        }
+        return changedCount;
+    }
+
+    // World transform and matrix of Lanes::WIDTH nodes from p_Begin, of the same depth
+    template <typename Lanes>
+    void UpdateBlock(uint32_t p_Begin, bool p_IsRootLevel)
+    {
+        Lanes parent[COMPONENT_COUNT];
+        Lanes local[COMPONENT_COUNT];
+        for (uint32_t component = 0; component < COMPONENT_COUNT; component++)
+        {
+            const float identity = ((component == QW) || (component == SCALE)) ? 1.0f : 0.0f;
+            parent[component] = p_IsRootLevel ? Lanes::Set(identity) : Lanes::Gather(m_Worlds[component].data(), &m_Parents[p_Begin]);
+            local[component] = Lanes::Load(&m_Locals[component][p_Begin]);
+        }
+
+        const Lanes one = Lanes::Set(1.0f);
+        const Lanes two = Lanes::Set(2.0f);
+        const Lanes& px = parent[QX];
+        const Lanes& py = parent[QY];
+        const Lanes& pz = parent[QZ];
+        const Lanes& pw = parent[QW];
+
+        // The local translation, scaled and rotated by the parent: v + w * t + cross(q, t), with t = 2 * cross(q, v)
+        Lanes world[COMPONENT_COUNT];
+        const Lanes vx = local[TX] * parent[SCALE];
+        const Lanes vy = local[TY] * parent[SCALE];
+        const Lanes vz = local[TZ] * parent[SCALE];
+        const Lanes tx = two * (py * vz - pz * vy);
+        const Lanes ty = two * (pz * vx - px * vz);
+        const Lanes tz = two * (px * vy - py * vx);
+        world[TX] = parent[TX] + vx + pw * tx + (py * tz - pz * ty);
+        world[TY] = parent[TY] + vy + pw * ty + (pz * tx - px * tz);
+        world[TZ] = parent[TZ] + vz + pw * tz + (px * ty - py * tx);
+
+        const Lanes& lx = local[QX];
+        const Lanes& ly = local[QY];
+        const Lanes& lz = local[QZ];
+        const Lanes& lw = local[QW];
+        world[QX] = pw * lx + px * lw + py * lz - pz * ly;
+        world[QY] = pw * ly - px * lz + py * lw + pz * lx;
+        world[QZ] = pw * lz + px * ly - py * lx + pz * lw;
+        world[QW] = pw * lw - px * lx - py * ly - pz * lz;
+        world[SCALE] = parent[SCALE] * local[SCALE];
+        for (uint32_t component = 0; component < COMPONENT_COUNT; component++) world[component].Store(&m_Worlds[component][p_Begin]);
+
+        const Lanes& x = world[QX];
+        const Lanes& y = world[QY];
+        const Lanes& z = world[QZ];
+        const Lanes& w = world[QW];
+        const Lanes& scale = world[SCALE];
+        const Lanes xx = x * x, yy = y * y, zz = z * z;
+        const Lanes xy = x * y, xz = x * z, yz = y * z;
+        const Lanes wx = w * x, wy = w * y, wz = w * z;
+        const Lanes matrix[MATRIX_COMPONENT_COUNT] = {
+            (one - two * (yy + zz)) * scale, two * (xy - wz) * scale, two * (xz + wy) * scale, world[TX],
+            two * (xy + wz) * scale, (one - two * (xx + zz)) * scale, two * (yz - wx) * scale, world[TY],
+            two * (xz - wy) * scale, two * (yz + wx) * scale, (one - two * (xx + yy)) * scale, world[TZ],
+        };
+        for (uint32_t component = 0; component < MATRIX_COMPONENT_COUNT; component++) matrix[component].Store(&m_Matrices[component][p_Begin]);
+    }
+
+    // Stable sort by depth after nodes were added, the world transforms computed so far move with their nodes
+    void SortNodes()
+    {
+        if (!m_IsStructureChanged) return;
+        m_IsStructureChanged = false;
+
+        const uint32_t count = GetNodeCount();
+        if (!std::is_sorted(m_Depths.begin(), m_Depths.end()))
+        {
+            std::vector<uint32_t> order(count);
+            std::iota(order.begin(), order.end(), 0u);
+            std::stable_sort(order.begin(), order.end(), [this](uint32_t p_A, uint32_t p_B) { return m_Depths[p_A] < m_Depths[p_B]; });
+            std::vector<uint32_t> newIndices(count);
+            for (uint32_t i = 0; i < count; i++) newIndices[order[i]] = i;
+
+            for (std::vector<float>& component : m_Locals) Permute(component, order);
+            for (std::vector<float>& component : m_Worlds) Permute(component, order);
+            for (std::vector<float>& component : m_Matrices) Permute(component, order);
+            Permute(m_Parents, order);
+            Permute(m_Depths, order);
+            Permute(m_IsDirty, order);
+            Permute(m_IsChanged, order);
+            Permute(m_NodeIds, order);
+            for (uint32_t& parent : m_Parents)
+            {
+                if (parent != NO_PARENT) parent = newIndices[parent];
+            }
+            for (uint32_t i = 0; i < count; i++) m_Indices[m_NodeIds[i]] = i;
+        }
+
+        m_LevelEnds.clear();
+        for (uint32_t i = 1; i <= count; i++)
+        {
+            if ((i == count) || (m_Depths[i] != m_Depths[i - 1])) m_LevelEnds.push_back(i);
+        }
+    }
+
+    template <typename T>
+    static void Permute(std::vector<T>& p_Values, const std::vector<uint32_t>& p_Order)
+    {
+        std::vector<T> permuted(p_Values.size());
+        for (size_t i = 0; i < p_Order.size(); i++) permuted[i] = p_Values[p_Order[i]];
+        p_Values.swap(permuted);
+    }
+};
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Scene.h"
+
+// Times the transform update of a scene graph, and the copy of its world matrices to instance data, with an
+// array-of-structures glm::mat4 baseline and with Scene, one node at a time and SCENE_SIMD_WIDTH at a time. Every
+// node is rotated every frame, then only the last tenth, which are leaves; the baseline can't tell the two apart. The
+// instance data of Scene is checked against the baseline's. Prints CSV to stdout.
+//
+// Usage: SceneBenchmark [node count]...
+
+namespace
+{
+    constexpr uint32_t TREE_ARITY = 8; // Node i > 0 is a child of node (i - 1) / TREE_ARITY
+    constexpr uint32_t ROTATION_COUNT = 64;
+    constexpr uint32_t NODES_PER_BENCHMARK = 4000000; // Iterations are scaled so each configuration updates about as many nodes
+    constexpr uint32_t PARTIAL_UPDATE_PERCENT = 10; // Of the nodes rotated by the partial updates
+
+    uint32_t GetParent(uint32_t p_Node) { return (p_Node == 0) ? Scene::NO_PARENT : (p_Node - 1) / TREE_ARITY; }
+
+    glm::vec3 GetTranslation(uint32_t p_Node) { return glm::vec3(static_cast<float>(p_Node % 7) - 3.0f, static_cast<float>(p_Node % 5) - 2.0f, 1.0f); }
+
+    // The naive layout: a local and a world matrix per node, rebuilt and multiplied every frame
+    struct AosNode
+    {
+        glm::vec3 translation;
+        glm::quat rotation;
+        float scale;
+        uint32_t parent;
+        glm::mat4 local;
+        glm::mat4 world;
+    };
+
+    void UpdateAos(std::vector<AosNode>& p_Nodes)
+    {
+        for (AosNode& node : p_Nodes)
+        {
+            node.local = glm::translate(glm::mat4(1.0f), node.translation) * glm::mat4_cast(node.rotation) * glm::scale(glm::mat4(1.0f), glm::vec3(node.scale));
+            node.world = (node.parent == Scene::NO_PARENT) ? node.local : p_Nodes[node.parent].world * node.local;
+        }
+    }
+
+    // Same layout as Scene::WriteInstances(), glm matrices are column-major
+    void WriteAosInstances(const std::vector<AosNode>& p_Nodes, float* p_pDestination)
+    {
+        for (const AosNode& node : p_Nodes)
+        {
+            for (int row = 0; row < 3; row++)
+            {
+                for (int column = 0; column < 4; column++) *p_pDestination++ = node.world[column][row];
+            }
+        }
+    }
+
+    struct Timing
+    {
+        double updateMilliseconds = 0.0;
+        double writeMilliseconds = 0.0;
+    };
+
+    template <typename Update, typename Write>
+    Timing Measure(uint32_t p_IterationCount, const Update& p_Update, const Write& p_Write)
+    {
+        using Clock = std::chrono::steady_clock;
+        Timing timing;
+        for (uint32_t i = 0; i < p_IterationCount; i++)
+        {
+            const Clock::time_point startTime = Clock::now();
+            p_Update(i);
+            const Clock::time_point updateTime = Clock::now();
+            p_Write();
+            timing.updateMilliseconds += std::chrono::duration<double, std::milli>(updateTime - startTime).count();
+            timing.writeMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - updateTime).count();
+        }
+        timing.updateMilliseconds /= p_IterationCount;
+        timing.writeMilliseconds /= p_IterationCount;
+        return timing;
+    }
+
+    float GetMaxDifference(const std::vector<float>& p_A, const std::vector<float>& p_B)
+    {
+        float difference = 0.0f;
+        for (size_t i = 0; i < p_A.size(); i++) difference = std::max(difference, std::abs(p_A[i] - p_B[i]));
+        return difference;
+    }
+
+    void Benchmark(uint32_t p_NodeCount, const std::vector<glm::quat>& p_Rotations)
+    {
+        const uint32_t iterationCount = std::max(3u, NODES_PER_BENCHMARK / p_NodeCount);
+        const float scale = 0.9f;
+
+        std::vector<AosNode> aosNodes(p_NodeCount);
+        Scene scene;
+        scene.Reserve(p_NodeCount);
+        for (uint32_t i = 0; i < p_NodeCount; i++)
+        {
+            aosNodes[i] = { GetTranslation(i), p_Rotations[0], scale, GetParent(i), glm::mat4(1.0f), glm::mat4(1.0f) };
+            scene.AddNode(GetParent(i), GetTranslation(i), p_Rotations[0], scale);
+        }
+
+        // Instance data, standing in for mapped memory
+        std::vector<float> aosInstances(static_cast<size_t>(p_NodeCount) * 12);
+        std::vector<float> scalarInstances(aosInstances.size());
+        std::vector<float> simdInstances(aosInstances.size());
+
+        const auto rotate = [&](uint32_t p_First, uint32_t p_Iteration) {
+            for (uint32_t i = p_First; i < p_NodeCount; i++) scene.SetRotation(i, p_Rotations[(i + p_Iteration) % ROTATION_COUNT]);
+        };
+        const Timing aos = Measure(iterationCount,
+            [&](uint32_t p_Iteration) {
+                for (uint32_t i = 0; i < p_NodeCount; i++) aosNodes[i].rotation = p_Rotations[(i + p_Iteration) % ROTATION_COUNT];
+                UpdateAos(aosNodes);
+            },
+            [&]() { WriteAosInstances(aosNodes, aosInstances.data()); });
+        const Timing scalar = Measure(iterationCount,
+            [&](uint32_t p_Iteration) { rotate(0, p_Iteration); scene.UpdateScalar(); },
+            [&]() { scene.WriteInstances(scalarInstances.data()); });
+        const Timing simd = Measure(iterationCount,
+            [&](uint32_t p_Iteration) { rotate(0, p_Iteration); scene.Update(); },
+            [&]() { scene.WriteInstances(simdInstances.data()); });
+        // The last iteration of each left the same rotations
+        const float scalarDifference = GetMaxDifference(aosInstances, scalarInstances);
+        const float simdDifference = GetMaxDifference(aosInstances, simdInstances);
+
+        // Offset by one rotation, the last iteration leaves the last tenth one rotation ahead of the others
+        const uint32_t firstPartial = p_NodeCount - p_NodeCount * PARTIAL_UPDATE_PERCENT / 100;
+        const Timing partial = Measure(iterationCount,
+            [&](uint32_t p_Iteration) { rotate(firstPartial, p_Iteration + 1); scene.Update(); },
+            [&]() { scene.WriteInstances(simdInstances.data()); });
+        for (uint32_t i = firstPartial; i < p_NodeCount; i++) aosNodes[i].rotation = p_Rotations[(i + iterationCount) % ROTATION_COUNT];
+        UpdateAos(aosNodes);
+        WriteAosInstances(aosNodes, aosInstances.data());
+        const float partialDifference = GetMaxDifference(aosInstances, simdInstances);
+
+        const double aosMilliseconds = aos.updateMilliseconds + aos.writeMilliseconds;
+        const auto print = [&](const std::string& p_Layout, uint32_t p_DirtyPercent, const Timing& p_Timing, float p_Difference) {
+            std::cout << p_NodeCount << "," << p_Layout << "," << p_DirtyPercent << "," << p_Timing.updateMilliseconds << "," << p_Timing.writeMilliseconds
+                << "," << (aosMilliseconds / (p_Timing.updateMilliseconds + p_Timing.writeMilliseconds)) << "," << p_Difference << std::endl;
+        };
+        print("aos_mat4", 100, aos, 0.0f);
+        print("soa_scalar", 100, scalar, scalarDifference);
+        const std::string simdLayout = "soa_simd" + std::to_string(Scene::GetSimdWidth());
+        print(simdLayout, 100, simd, simdDifference);
+        print(simdLayout, PARTIAL_UPDATE_PERCENT, partial, partialDifference);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<uint32_t> nodeCounts = { 10000, 100000, 1000000 };
+    if (argc > 1) nodeCounts.clear();
+    for (int i = 1; i < argc; i++)
+    {
+        const unsigned long count = std::strtoul(argv[i], nullptr, 10);
+        if (count == 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " [node count]..." << std::endl;
+            return EXIT_FAILURE;
+        }
+        nodeCounts.push_back(static_cast<uint32_t>(count));
+    }
+
+    std::vector<glm::quat> rotations(ROTATION_COUNT);
+    const glm::vec3 axis = glm::normalize(glm::vec3(0.3f, 0.5f, 1.0f));
+    for (uint32_t i = 0; i < ROTATION_COUNT; i++) rotations[i] = glm::angleAxis(6.2831853f * i / ROTATION_COUNT, axis);
+
+    // max_difference is the largest difference of the instance data with the baseline's
+    std::cout << "nodes,layout,dirty_percent,update_ms,write_ms,speedup,max_difference" << std::endl;
+    for (uint32_t nodeCount : nodeCounts) Benchmark(nodeCount, rotations);
+    return EXIT_SUCCESS;
+}
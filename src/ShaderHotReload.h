@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "ResourceFormat.h"
+
+// Development builds only (SHADER_HOT_RELOAD, Linux). Watches the directories of the shader sources listed in the
+// manifest written by CMake, and reruns glslc on a background thread for every shader resource built from a source
+// that was saved. The render loop picks the compiled SPIR-V up with TakeCompiled(), which never blocks on
+// compilation, and hands it to PipelineStateCache::ReloadShader().
+class ShaderHotReload
+{
+public:
+    struct CompiledShader
+    {
+        std::string name; // Resource name, e.g. fragment_shader_1
+        std::vector<uint32_t> code;
+        std::chrono::steady_clock::time_point changeTime; // When the source change was noticed
+    };
+
+    ShaderHotReload() = default;
+    ShaderHotReload(const ShaderHotReload&) = delete;
+    ShaderHotReload& operator=(const ShaderHotReload&) = delete;
+
+    ~ShaderHotReload()
+    {
+        Uninitialize();
+    }
+
+    // The manifest has one line per shader resource: name, source path and glslc arguments separated by tabs
+    void Initialize(const std::string& p_ManifestPath, const std::string& p_GlslcPath, const std::string& p_OutputDirectory)
+    {
+        m_GlslcPath = p_GlslcPath;
+        m_OutputDirectory = p_OutputDirectory;
+
+        std::ifstream manifest(p_ManifestPath);
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            std::istringstream fields(line);
+            Shader shader;
+            if (!std::getline(fields, shader.name, '\t') || !std::getline(fields, shader.sourcePath, '\t')) continue;
+            std::getline(fields, shader.arguments, '\t');
+            m_Shaders.push_back(shader);
+        }
+        if (m_Shaders.empty())
+        {
+            std::cerr << "Shader hot reload: no shaders in \"" << p_ManifestPath << "\"" << std::endl;
+            return;
+        }
+
+        m_InotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_InotifyFd < 0)
+        {
+            std::cerr << "Shader hot reload: inotify is unavailable" << std::endl;
+            return;
+        }
+
+        // Editors often save by renaming a temporary file over the source, so directories are watched, not files
+        std::set<std::string> directories;
+        for (const Shader& shader : m_Shaders) directories.insert(shader.sourcePath.substr(0, shader.sourcePath.find_last_of('/')));
+        for (const std::string& directory : directories)
+        {
+            const int watch = inotify_add_watch(m_InotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (watch >= 0) m_WatchedDirectories[watch] = directory;
+        }
+
+        m_IsStopping = false;
+        m_Thread = std::thread([this]() { WatchLoop(); });
+        std::cerr << "Shader hot reload: watching " << m_Shaders.size() << " shader(s) in " << m_WatchedDirectories.size() << " directory(ies)" << std::endl;
+    }
+
+    void Uninitialize()
+    {
+        m_IsStopping = true;
+        if (m_Thread.joinable()) m_Thread.join();
+        if (m_InotifyFd >= 0) close(m_InotifyFd);
+        m_InotifyFd = -1;
+    }
+
+    std::vector<CompiledShader> TakeCompiled()
+    {
+        std::vector<CompiledShader> compiled;
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        compiled.swap(m_Compiled);
+        return compiled;
+    }
+
+private:
+    struct Shader
+    {
+        std::string name;
+        std::string sourcePath;
+        std::string arguments;
+    };
+
+    static constexpr int POLL_TIMEOUT_MS = 100; // How long Uninitialize() may wait for the thread
+    static constexpr int SETTLE_TIME_MS = 20; // Saves come in bursts of events, they are coalesced
+
+    std::string m_GlslcPath;
+    std::string m_OutputDirectory;
+    std::vector<Shader> m_Shaders;
+    int m_InotifyFd = -1;
+    std::map<int, std::string> m_WatchedDirectories; // By watch descriptor
+    std::thread m_Thread;
+    std::atomic<bool> m_IsStopping{ false };
+
+    std::mutex m_Mutex;
+    std::vector<CompiledShader> m_Compiled; // Guarded by m_Mutex
+
+    void WatchLoop()
+    {
+        while (!m_IsStopping)
+        {
+            pollfd pollFd = { m_InotifyFd, POLLIN, 0 };
+            if (poll(&pollFd, 1, POLL_TIMEOUT_MS) <= 0) continue;
+
+            const auto changeTime = std::chrono::steady_clock::now();
+            std::set<std::string> changedPaths;
+            ReadEvents(changedPaths);
+            std::this_thread::sleep_for(std::chrono::milliseconds(SETTLE_TIME_MS));
+            ReadEvents(changedPaths);
+
+            for (const Shader& shader : m_Shaders)
+            {
+                if (changedPaths.count(shader.sourcePath) == 0) continue;
+
+                CompiledShader compiled;
+                compiled.name = shader.name;
+                compiled.changeTime = changeTime;
+                if (!Compile(shader, compiled.code)) continue;
+
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Compiled.push_back(std::move(compiled));
+            }
+        }
+    }
+
+    void ReadEvents(std::set<std::string>& p_ChangedPaths)
+    {
+        alignas(inotify_event) char buffer[4096];
+        while (true)
+        {
+            const ssize_t size = read(m_InotifyFd, buffer, sizeof(buffer));
+            if (size <= 0) return; // EAGAIN once drained
+
+            for (ssize_t offset = 0; offset < size;)
+            {
+                const inotify_event* pEvent = reinterpret_cast<const inotify_event*>(buffer + offset);
+                const auto directory = m_WatchedDirectories.find(pEvent->wd);
+                if ((pEvent->len > 0) && (directory != m_WatchedDirectories.end())) p_ChangedPaths.insert(directory->second + "/" + pEvent->name);
+                offset += sizeof(inotify_event) + pEvent->len;
+            }
+        }
+    }
+
+    bool Compile(const Shader& p_Shader, std::vector<uint32_t>& p_Code) const
+    {
+        const auto startTime = std::chrono::steady_clock::now();
+        const std::string outputPath = m_OutputDirectory + "/" + p_Shader.name + ".spv";
+        const std::string command = "\"" + m_GlslcPath + "\" " + p_Shader.arguments + " \"" + p_Shader.sourcePath + "\" -o \"" + outputPath + "\"";
+        if (std::system(command.c_str()) != 0)
+        {
+            // glslc printed the errors, the current pipelines stay in use
+            std::cerr << "Shader hot reload: failed to compile \"" << p_Shader.name << "\"" << std::endl;
+            return false;
+        }
+
+        std::ifstream file(outputPath, std::ios::binary | std::ios::ate);
+        const std::streamsize size = file.tellg();
+        if (!file || (size <= 0) || (size % sizeof(uint32_t) != 0)) return false;
+        p_Code.resize(static_cast<size_t>(size) / sizeof(uint32_t));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(p_Code.data()), size);
+        if (!file || (p_Code[0] != SPIRV_MAGIC)) return false;
+
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::ostringstream message;
+        message << "Shader hot reload: compiled \"" << p_Shader.name << "\" in " << milliseconds << " ms\n";
+        std::cerr << message.str();
+        return true;
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Resource.h"
+
+// Variants of a shader compiled by target_shader_permutations(), one per combination of its features. Bit i of a
+// feature mask is the i-th feature listed in CMake; the generated header names the bits. A feature compiled out
+// costs nothing at runtime, unlike a branch on a uniform that every fragment evaluates.
+class ShaderPermutations
+{
+public:
+    ShaderPermutations(const char* p_Name, std::vector<const char*> p_Features, std::vector<const Resource*> p_Variants) :
+        m_Name(p_Name), m_Features(std::move(p_Features)), m_Variants(std::move(p_Variants))
+    {
+    }
+
+    ShaderPermutations(const ShaderPermutations&) = delete;
+    ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+    const Resource& Get(uint32_t p_FeatureMask) const
+    {
+        if (p_FeatureMask >= m_Variants.size())
+        {
+            throw std::runtime_error("Shader \"" + m_Name + "\" has no variant with the feature mask " + std::to_string(p_FeatureMask) + ".");
+        }
+        return *m_Variants[p_FeatureMask];
+    }
+
+    const std::string& GetName() const { return m_Name; }
+    size_t GetVariantCount() const { return m_Variants.size(); }
+
+    // Names of the features in the mask separated by '+', "none" for the base variant
+    std::string GetFeatureNames(uint32_t p_FeatureMask) const
+    {
+        std::string names;
+        for (size_t i = 0; i < m_Features.size(); i++)
+        {
+            if (!(p_FeatureMask & (1u << i))) continue;
+            if (!names.empty()) names += '+';
+            names += m_Features[i];
+        }
+        return names.empty() ? "none" : names;
+    }
+
+private:
+    std::string m_Name;
+    std::vector<const char*> m_Features;
+    std::vector<const Resource*> m_Variants; // Indexed by feature mask
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded queue between one producer thread and one consumer thread, without locks. Each side only writes its own
+// index and reads the other's with acquire ordering, which makes the slots published before it visible. The indices
+// only count up, the slot of an index is index % capacity. They sit on separate cache lines, and each side keeps a
+// copy of the other's index so that it only reads the shared line when the queue looks full or empty.
+template <typename T>
+class SpscQueue
+{
+public:
+    // Must be called before the threads start
+    void Initialize(size_t p_Capacity)
+    {
+        m_Slots.assign(std::max<size_t>(p_Capacity, 1), T());
+    }
+
+    size_t GetCapacity() const { return m_Slots.size(); }
+
+    // Producer only
+    bool IsFull()
+    {
+        const size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail - m_CachedHead < m_Slots.size()) return false;
+        m_CachedHead = m_Head.load(std::memory_order_acquire);
+        return tail - m_CachedHead == m_Slots.size();
+    }
+
+    // Producer only. Returns false if the queue is full.
+    bool TryPush(const T& p_Value)
+    {
+        if (IsFull()) return false;
+        const size_t tail = m_Tail.load(std::memory_order_relaxed);
+        m_Slots[tail % m_Slots.size()] = p_Value;
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    bool TryPop(T& p_Value)
+    {
+        const size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head == m_CachedTail)
+        {
+            m_CachedTail = m_Tail.load(std::memory_order_acquire);
+            if (head == m_CachedTail) return false;
+        }
+        p_Value = m_Slots[head % m_Slots.size()];
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::vector<T> m_Slots;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_Head{ 0 }; // Next slot to pop, written by the consumer
+    size_t m_CachedTail = 0; // Consumer's copy of m_Tail
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_Tail{ 0 }; // Next slot to push, written by the producer
+    size_t m_CachedHead = 0; // Producer's copy of m_Head
+};
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "FramePacer.h"
+#include "MemoryAllocator.h"
+
+// Persistently mapped host-visible ring buffer that uploads go through on their way to device-local buffers.
+// Upload() copies the data into the ring and queues the copy; RecordCopies() records every queued copy with one
+// copyBuffer per destination buffer, followed by one barrier, so that a frame's uploads cost a single submission.
+// Submitted() tags the ring space of those copies with the frame timeline value of that submission, and Reclaim()
+// releases the space of submissions whose value has been reached. The copies may run on a dedicated transfer
+// queue, in which case the written ranges are released to the queue family that uses them, which acquires them with
+// RecordAcquire(). Destinations must not be in use by frames still in flight: a buffer rewritten every frame needs a
+// range per frame in flight, reused once the frame timeline shows the frame that last used it complete.
+class StagingRing
+{
+public:
+    void Initialize(DeviceMemoryAllocator& p_Allocator, FramePacer& p_FramePacer, vk::DeviceSize p_Size)
+    {
+        m_pAllocator = &p_Allocator;
+        m_pFramePacer = &p_FramePacer;
+        m_Size = p_Size;
+
+        vk::BufferCreateInfo createInfo;
+        createInfo.size = p_Size;
+        createInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+        createInfo.sharingMode = vk::SharingMode::eExclusive;
+        m_Buffer = p_Allocator.CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, m_Allocation);
+    }
+
+    void Uninitialize()
+    {
+        m_pAllocator->DestroyBuffer(m_Buffer, m_Allocation);
+        m_Submissions.clear();
+        m_PendingCopies.clear();
+    }
+
+    // Queues a copy of p_Size bytes to p_Buffer at p_Offset. Large uploads are split in chunks of at most a quarter of
+    // the ring. When the ring is full, waits for the oldest submission to complete. Returns false, with nothing of the
+    // upload queued, if the copies queued since the last submission leave no room for all of it.
+    bool Upload(vk::Buffer p_Buffer, vk::DeviceSize p_Offset, const void* p_pData, vk::DeviceSize p_Size)
+    {
+        // Reclaim() only releases space behind the head, so the space taken by this upload can be given back
+        const size_t pendingCopyCount = m_PendingCopies.size();
+        const vk::DeviceSize head = m_Head;
+        const vk::DeviceSize pendingRingBytes = m_PendingRingBytes;
+        const vk::DeviceSize pendingUploadBytes = m_PendingUploadBytes;
+
+        const uint8_t* pData = static_cast<const uint8_t*>(p_pData);
+        while (p_Size > 0)
+        {
+            const vk::DeviceSize chunkSize = std::min(p_Size, m_Size / 4);
+            vk::DeviceSize ringOffset;
+            while (!Allocate(chunkSize, ringOffset))
+            {
+                if (m_Submissions.empty())
+                {
+                    m_PendingCopies.resize(pendingCopyCount);
+                    m_Head = head;
+                    m_Used -= m_PendingRingBytes - pendingRingBytes;
+                    m_PendingRingBytes = pendingRingBytes;
+                    m_PendingUploadBytes = pendingUploadBytes;
+                    return false;
+                }
+                const uint64_t oldestValue = m_Submissions.front().timelineValue;
+                m_pFramePacer->Wait(oldestValue);
+                Reclaim(oldestValue);
+            }
+
+            memcpy(m_Allocation.pMapped + ringOffset, pData, static_cast<size_t>(chunkSize));
+            m_PendingCopies.push_back({ p_Buffer, vk::BufferCopy(ringOffset, p_Offset, chunkSize) });
+            m_PendingUploadBytes += chunkSize;
+
+            pData += chunkSize;
+            p_Offset += chunkSize;
+            p_Size -= chunkSize;
+        }
+        return true;
+    }
+
+    bool HasPendingCopies() const { return !m_PendingCopies.empty(); }
+
+    // A leading barrier orders the copies after the copies of earlier submissions on the same queue, which may have
+    // written the same ranges. Without queue families, the trailing barrier makes the copies visible to every later
+    // vertex, index, indirect, uniform and shader read. Otherwise p_CommandBuffer runs on p_SrcQueueFamily and the
+    // barriers release the written range of each destination buffer to p_DstQueueFamily. Copies overwrite their
+    // ranges, so the ranges aren't released back to p_SrcQueueFamily first: their previous contents are discarded.
+    void RecordCopies(vk::CommandBuffer p_CommandBuffer, uint32_t p_SrcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t p_DstQueueFamily = VK_QUEUE_FAMILY_IGNORED)
+    {
+        std::stable_sort(m_PendingCopies.begin(), m_PendingCopies.end(),
+            [](const PendingCopy& p_A, const PendingCopy& p_B) { return p_A.buffer < p_B.buffer; });
+
+        vk::MemoryBarrier writeBarrier;
+        writeBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        writeBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        p_CommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), { writeBarrier }, nullptr, nullptr);
+
+        m_ReleasedRanges.clear();
+        std::vector<vk::BufferCopy> regions;
+        vk::DeviceSize rangeBegin = 0;
+        vk::DeviceSize rangeEnd = 0;
+        for (size_t i = 0; i < m_PendingCopies.size(); i++)
+        {
+            const vk::BufferCopy& region = m_PendingCopies[i].region;
+            rangeBegin = regions.empty() ? region.dstOffset : std::min(rangeBegin, region.dstOffset);
+            rangeEnd = regions.empty() ? region.dstOffset + region.size : std::max(rangeEnd, region.dstOffset + region.size);
+            regions.push_back(region);
+            if ((i + 1 == m_PendingCopies.size()) || (m_PendingCopies[i + 1].buffer != m_PendingCopies[i].buffer))
+            {
+                p_CommandBuffer.copyBuffer(m_Buffer, m_PendingCopies[i].buffer, regions);
+                m_ReleasedRanges.push_back({ m_PendingCopies[i].buffer, rangeBegin, rangeEnd - rangeBegin });
+                regions.clear();
+            }
+        }
+
+        m_SrcQueueFamily = p_SrcQueueFamily;
+        m_DstQueueFamily = p_DstQueueFamily;
+        if (p_SrcQueueFamily == p_DstQueueFamily)
+        {
+            m_ReleasedRanges.clear();
+
+            vk::MemoryBarrier barrier;
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = GetReadAccess();
+            p_CommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, GetReadStages(), vk::DependencyFlags(), { barrier }, nullptr, nullptr);
+        }
+        else
+        {
+            // Transfer queues may not support the read stages, the release only has to make the writes available
+            const std::vector<vk::BufferMemoryBarrier> barriers = GetOwnershipBarriers(vk::AccessFlagBits::eTransferWrite, vk::AccessFlags());
+            p_CommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags(), nullptr, barriers, nullptr);
+        }
+
+        m_RecordedCopyCount = m_PendingCopies.size();
+        m_PendingCopies.clear();
+    }
+
+    // Acquires the ranges released by the last RecordCopies() on the queue family they were released to. The
+    // submission must wait for the one of the copies at GetReadStages().
+    void RecordAcquire(vk::CommandBuffer p_CommandBuffer)
+    {
+        if (m_ReleasedRanges.empty()) return;
+        const std::vector<vk::BufferMemoryBarrier> barriers = GetOwnershipBarriers(vk::AccessFlags(), GetReadAccess());
+        p_CommandBuffer.pipelineBarrier(GetReadStages(), GetReadStages(), vk::DependencyFlags(), nullptr, barriers, nullptr);
+        m_ReleasedRanges.clear();
+    }
+
+    static vk::PipelineStageFlags GetReadStages()
+    {
+        return vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader |
+            vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+    }
+
+    // Called once the command buffer filled by RecordCopies() has been submitted, signaling p_TimelineValue
+    void Submitted(uint64_t p_TimelineValue)
+    {
+        Submission submission;
+        submission.timelineValue = p_TimelineValue;
+        submission.ringBytes = m_PendingRingBytes;
+        submission.submitTime = Clock::now();
+        m_Submissions.push_back(submission);
+
+        m_TotalUploadBytes += m_PendingUploadBytes;
+        m_TotalCopyCount += m_RecordedCopyCount;
+        m_SubmissionCount++;
+        m_PendingRingBytes = 0;
+        m_PendingUploadBytes = 0;
+        m_RecordedCopyCount = 0;
+    }
+
+    // Releases the ring space of submissions up to the timeline value p_CompletedValue, oldest first. Returns the
+    // latency, from submission to this call, of the most recent submission released, or a negative value if none was.
+    float Reclaim(uint64_t p_CompletedValue)
+    {
+        float latency = -1.0f;
+        while (!m_Submissions.empty() && (m_Submissions.front().timelineValue <= p_CompletedValue))
+        {
+            const Submission& submission = m_Submissions.front();
+            latency = std::chrono::duration<float, std::milli>(Clock::now() - submission.submitTime).count();
+            m_LatencySum += latency;
+            m_MaxLatency = std::max(m_MaxLatency, latency);
+            m_CompletedCount++;
+
+            m_Used -= submission.ringBytes;
+            m_Submissions.pop_front();
+        }
+        return latency;
+    }
+
+    void LogStats(double p_Seconds) const
+    {
+        if (m_SubmissionCount == 0) return;
+        const double megabytes = m_TotalUploadBytes / (1024.0 * 1024.0);
+        std::cerr << "Staging ring: " << megabytes << " MB in " << m_TotalCopyCount << " copies and " << m_SubmissionCount << " submission(s), "
+            << (megabytes / p_Seconds) << " MB/s, latency " << (m_CompletedCount ? m_LatencySum / m_CompletedCount : 0.0) << " ms average, "
+            << m_MaxLatency << " ms max (ring of " << (m_Size >> 10) << " KB)" << std::endl;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr vk::DeviceSize ALIGNMENT = 16;
+
+    struct PendingCopy
+    {
+        vk::Buffer buffer;
+        vk::BufferCopy region;
+    };
+
+    struct BufferRange
+    {
+        vk::Buffer buffer;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+    };
+
+    struct Submission
+    {
+        uint64_t timelineValue = 0;
+        vk::DeviceSize ringBytes = 0; // Ring space to release on completion, including padding
+        Clock::time_point submitTime;
+    };
+
+    DeviceMemoryAllocator* m_pAllocator = nullptr;
+    FramePacer* m_pFramePacer = nullptr;
+    vk::Buffer m_Buffer;
+    MemoryAllocation m_Allocation;
+    vk::DeviceSize m_Size = 0;
+    vk::DeviceSize m_Head = 0; // Next write offset
+    vk::DeviceSize m_Used = 0; // From the oldest in-flight byte to the head
+
+    std::vector<PendingCopy> m_PendingCopies;
+    std::vector<BufferRange> m_ReleasedRanges; // Written by the last RecordCopies(), when it changed queue family
+    uint32_t m_SrcQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t m_DstQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    std::deque<Submission> m_Submissions;
+    vk::DeviceSize m_PendingRingBytes = 0;
+    vk::DeviceSize m_PendingUploadBytes = 0;
+    size_t m_RecordedCopyCount = 0;
+
+    uint64_t m_TotalUploadBytes = 0;
+    uint64_t m_TotalCopyCount = 0;
+    uint64_t m_SubmissionCount = 0;
+    uint64_t m_CompletedCount = 0;
+    double m_LatencySum = 0.0;
+    float m_MaxLatency = 0.0f;
+
+    static vk::AccessFlags GetReadAccess()
+    {
+        return vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eIndirectCommandRead |
+            vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead;
+    }
+
+    // The release and acquire barriers of a queue family ownership transfer must match, except for the access masks
+    std::vector<vk::BufferMemoryBarrier> GetOwnershipBarriers(vk::AccessFlags p_SrcAccess, vk::AccessFlags p_DstAccess) const
+    {
+        std::vector<vk::BufferMemoryBarrier> barriers;
+        for (const BufferRange& range : m_ReleasedRanges)
+        {
+            vk::BufferMemoryBarrier barrier;
+            barrier.srcAccessMask = p_SrcAccess;
+            barrier.dstAccessMask = p_DstAccess;
+            barrier.srcQueueFamilyIndex = m_SrcQueueFamily;
+            barrier.dstQueueFamilyIndex = m_DstQueueFamily;
+            barrier.buffer = range.buffer;
+            barrier.offset = range.offset;
+            barrier.size = range.size;
+            barriers.push_back(barrier);
+        }
+        return barriers;
+    }
+
+    bool Allocate(vk::DeviceSize p_Size, vk::DeviceSize& p_Offset)
+    {
+        vk::DeviceSize offset = AlignUp(m_Head, ALIGNMENT);
+        if (offset + p_Size > m_Size) offset = 0; // Skip the end of the ring, the data must be contiguous
+
+        const vk::DeviceSize skipped = (offset >= m_Head) ? (offset - m_Head) : (m_Size - m_Head);
+        if (m_Used + skipped + p_Size > m_Size) return false;
+
+        m_Head = offset + p_Size;
+        m_Used += skipped + p_Size;
+        m_PendingRingBytes += skipped + p_Size;
+        p_Offset = offset;
+        return true;
+    }
+};
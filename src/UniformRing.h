@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+
+// Persistently mapped, host-coherent ring of uniform data with one partition per frame in flight. BeginFrame()
+// rewinds the partition of the frame slot, which the frame timeline shows free, and Allocate() hands out ranges of
+// it aligned to minUniformBufferOffsetAlignment. Per-draw constants are written in one pass and each draw binds them
+// with a dynamic offset, so they cost no allocation and no descriptor write. A frame that doesn't fit counts an
+// overflow and only gets what fits; the next BeginFrame() then doubles the partitions in a new buffer, and the old
+// one is destroyed once the frames using it are complete.
+class UniformRing
+{
+public:
+    void Initialize(DeviceMemoryAllocator& p_Allocator, vk::DeviceSize p_Alignment, uint32_t p_FramesInFlight, vk::DeviceSize p_PartitionSize)
+    {
+        m_pAllocator = &p_Allocator;
+        m_Alignment = p_Alignment;
+        m_FramesInFlight = p_FramesInFlight;
+        m_PartitionSize = AlignUp(p_PartitionSize);
+        CreateBuffer();
+    }
+
+    void Uninitialize()
+    {
+        DestroyRetired(UINT64_MAX);
+        m_pAllocator->DestroyBuffer(m_Buffer, m_Allocation);
+    }
+
+    // p_RetireValue is the frame timeline value of the last frame submitted, which may still read the buffer
+    void BeginFrame(size_t p_FrameSlot, uint64_t p_CompletedValue, uint64_t p_RetireValue)
+    {
+        DestroyRetired(p_CompletedValue);
+        if (m_HasOverflowed)
+        {
+            m_Retired.push_back({ p_RetireValue, m_Buffer, m_Allocation });
+            m_PartitionSize *= 2;
+            CreateBuffer();
+            m_HasOverflowed = false;
+            std::cerr << "Uniform ring: grown to " << (m_PartitionSize >> 10) << " KB per frame" << std::endl;
+        }
+
+        m_FrameBegin = p_FrameSlot * m_PartitionSize;
+        m_FrameUsed = 0;
+    }
+
+    // Returns the number of p_Stride-byte elements out of p_Count that fit, and the offset of the first one in
+    // GetBuffer(). p_Stride must be aligned (AlignUp()).
+    uint32_t AllocateArray(uint32_t p_Count, vk::DeviceSize p_Stride, vk::DeviceSize& p_Offset)
+    {
+        const uint32_t fitCount = static_cast<uint32_t>(std::min<vk::DeviceSize>(p_Count, (m_PartitionSize - m_FrameUsed) / p_Stride));
+        if (fitCount < p_Count)
+        {
+            m_HasOverflowed = true;
+            m_OverflowCount++;
+            m_FrameOverflowCount++;
+        }
+
+        p_Offset = m_FrameBegin + m_FrameUsed;
+        m_FrameUsed += fitCount * p_Stride;
+        m_TotalBytes += fitCount * p_Stride;
+        return fitCount;
+    }
+
+    bool Allocate(vk::DeviceSize p_Size, vk::DeviceSize& p_Offset)
+    {
+        return AllocateArray(1, AlignUp(p_Size), p_Offset) == 1;
+    }
+
+    uint8_t* GetMappedData(vk::DeviceSize p_Offset) const { return m_Allocation.pMapped + p_Offset; }
+    vk::Buffer GetBuffer() const { return m_Buffer; }
+    vk::DeviceSize AlignUp(vk::DeviceSize p_Size) const { return (p_Size + m_Alignment - 1) / m_Alignment * m_Alignment; }
+
+    // Since BeginFrame()
+    vk::DeviceSize GetFrameBytes() const { return m_FrameUsed; }
+
+    // Overflows since the last call
+    uint32_t TakeFrameOverflowCount()
+    {
+        const uint32_t count = m_FrameOverflowCount;
+        m_FrameOverflowCount = 0;
+        return count;
+    }
+
+    void LogStats(uint64_t p_FrameCount) const
+    {
+        if (p_FrameCount == 0) return;
+        std::cerr << "Uniform ring: " << (m_TotalBytes / p_FrameCount) << " bytes per frame on average, " << m_OverflowCount
+            << " overflow(s), " << (m_PartitionSize >> 10) << " KB per frame, " << m_Alignment << "-byte alignment" << std::endl;
+    }
+
+private:
+    struct RetiredBuffer
+    {
+        uint64_t retireValue; // Frame timeline value of the last frame that may use it
+        vk::Buffer buffer;
+        MemoryAllocation allocation;
+    };
+
+    DeviceMemoryAllocator* m_pAllocator = nullptr;
+    vk::DeviceSize m_Alignment = 256;
+    uint32_t m_FramesInFlight = 2;
+    vk::DeviceSize m_PartitionSize = 0;
+
+    vk::Buffer m_Buffer;
+    MemoryAllocation m_Allocation;
+    std::deque<RetiredBuffer> m_Retired;
+
+    vk::DeviceSize m_FrameBegin = 0;
+    vk::DeviceSize m_FrameUsed = 0;
+    bool m_HasOverflowed = false;
+
+    uint64_t m_TotalBytes = 0;
+    uint64_t m_OverflowCount = 0;
+    uint32_t m_FrameOverflowCount = 0;
+
+    void CreateBuffer()
+    {
+        vk::BufferCreateInfo createInfo;
+        createInfo.size = m_PartitionSize * m_FramesInFlight;
+        createInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer;
+        createInfo.sharingMode = vk::SharingMode::eExclusive;
+        m_Buffer = m_pAllocator->CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, m_Allocation);
+    }
+
+    void DestroyRetired(uint64_t p_CompletedValue)
+    {
+        while (!m_Retired.empty() && (m_Retired.front().retireValue <= p_CompletedValue))
+        {
+            m_pAllocator->DestroyBuffer(m_Retired.front().buffer, m_Retired.front().allocation);
+            m_Retired.pop_front();
+        }
+    }
+};
@@ -1,67 +1,172 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <string>
+#include <thread>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
 #include <vulkan/vulkan.hpp>
 
-#define LOAD_RESOURCE(VAR_NAME, RESOURCE_NAME) \
-    extern "C" const size_t rc_size_##RESOURCE_NAME; \
-    extern "C" const unsigned char rc_data_##RESOURCE_NAME[]; \
-    const Resource VAR_NAME = {rc_data_##RESOURCE_NAME, rc_size_##RESOURCE_NAME};
+#include "DescriptorAllocator.h"
+#include "DrawCulling.h"
+#include "FramePacer.h"
+#include "FrameSink.h"
+#include "FrameStats.h"
+#include "JobSystem.h"
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "PipelineStateCache.h"
+#include "RenderGraph.h"
+#include "Resource.h"
+#include "Scene.h"
+#include "SpscQueue.h"
+#include "StagingRing.h"
+#include "UniformRing.h"
+#ifdef SHADER_HOT_RELOAD
+#include "ShaderHotReload.h"
+#endif
+#include "fragment_shader_permutations.h"
+
+LOAD_SHADER(rcVertexShader, vertex_shader)
+LOAD_SHADER(rcCullShader, cull_shader)
 
-using Resource = std::pair<const unsigned char*, size_t>;
-LOAD_RESOURCE(rcVertexShader, vertex_shader)
-LOAD_RESOURCE(rcFragmentShader, fragment_shader)
+struct Vertex
+{
+    float position[2];
+    float color[3];
+};
+
+// Uniforms of one draw, in the uniform ring (set 1, binding 1, dynamic offset), or in the draw buffer for indirect draws
+struct DrawParameters
+{
+    uint32_t material; // Index in the material buffer
+    uint32_t instance; // Index of the world matrix in the instance buffer, see Scene::GetInstanceIndex()
+    uint32_t padding[2];
+};
+
+// Uniforms of the frame, in the uniform ring (set 1, binding 0)
+struct FrameConstants
+{
+    float time; // Seconds since startup
+    uint32_t materialBuffer; // Index of the material buffer in the bindless table
+    uint32_t drawBuffer; // Index of the draw buffer in the bindless table, for indirect draws
+    uint32_t instanceBuffer; // Index of the frame slot's partition of the instance buffer in the bindless table
+    float view[4]; // World-space center and zoom of the camera
+};
 
 struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphics;
     std::optional<uint32_t> present;
+    std::optional<uint32_t> transfer; // Transfer-only family if there is one, else a compute family without graphics, else graphics
+    bool presentRequired = true; // False when rendering headless, there is no surface to present to
 
     bool IsComplete()
     {
-        return graphics.has_value() && present.has_value();
+        return graphics.has_value() && (present.has_value() || !presentRequired);
     }
 
+    bool HasAsyncTransfer() const { return transfer != graphics; }
+
     std::set<uint32_t> GetUniqueQueueFamilies()
     {
         std::set<uint32_t> indices;
         if (graphics.has_value()) indices.insert(graphics.value());
         if (present.has_value()) indices.insert(present.value());
+        if (transfer.has_value()) indices.insert(transfer.value());
         return indices;
     }
 };
 
+struct AppOptions
+{
+    bool headless = false;
+    uint32_t frameCount = 0; // 0 runs until the window is closed
+    std::string statsPath; // Frame statistics output, empty disables the instrumentation
+    uint32_t statsInterval = 0; // Dump the statistics every N frames, 0 only dumps them on exit
+    std::string pipelineCachePath = "pipeline_cache.bin"; // Empty disables the on-disk pipeline cache
+    uint32_t streamUploadKilobytes = 0; // Synthetic streaming workload uploaded every frame, 0 disables it
+    bool asyncQueues = true; // Uploads on a dedicated transfer queue, when the device has one. There is no async compute, compute runs on the graphics queue.
+    uint32_t framesInFlight = 2; // Frames the CPU may record ahead of the GPU
+    uint32_t drawCount = 1; // Copies of the triangle, laid out in a grid
+    uint32_t uniformRingKilobytes = 0; // Uniform ring space per frame in flight, 0 sizes it for the draws
+    uint32_t recordThreadCount = 0; // Threads recording the draws, 0 uses every core
+    bool benchmarkRecording = false; // Times the recording of the draws with 1 to recordThreadCount threads and exits
+    vk::PresentModeKHR presentMode = vk::PresentModeKHR::eMailbox; // Latency policy, falls back to FIFO when unsupported
+    uint32_t frameRateLimit = 0; // Frames per second the CPU is paced to before sampling input, 0 disables the limiter
+    bool syncPipelines = false; // Waits for the pipelines during initialization instead of rendering without them
+    bool grayscale = false; // Specialization constant of the fragment shader, baked into the pipelines
+    uint32_t blurPassCount = 0; // Downsampling blits of the render graph's blur, 0 renders straight to the frame sink
+    CullingMode culling = CullingMode::None; // Frustum culling into indirect draws, on the CPU or in a compute pass
+    bool validateCulling = false; // Checks the GPU culling against the CPU one
+    float cameraZoom = 1.0f; // Above 1 the camera pans around the grid and part of it is culled
+    bool renderThread = false; // Renders on a dedicated thread, the main thread only handles events and simulates
+    uint32_t renderQueueDepth = 2; // Frame packets the main thread may get ahead of the render thread
+};
+
+// What the main thread sampled and simulated for a frame. With --render-thread it is copied through a queue to the
+// render thread, and neither thread changes it afterwards.
+struct FramePacket
+{
+    uint64_t frameIndex = 0;
+    std::chrono::steady_clock::time_point inputTime; // When input was sampled
+    float time = 0.0f; // Simulation time, seconds since startup
+    float limitMilliseconds = -1.0f; // Waited for the frame limiter, negative without a limit
+    float cameraView[4] = {}; // See FrameConstants::view
+    const float* pInstances = nullptr; // World matrices of the scene, see VulkanApp::UpdateScene()
+    uint32_t sceneNodesUpdated = 0;
+    vk::Extent2D framebufferExtent; // Of the window, zero when headless
+    bool isFramebufferResized = false; // Since the previous packet
+};
+
 class VulkanApp
 {
 public:
+    explicit VulkanApp(const AppOptions& p_Options) : m_Options(p_Options), m_StartTime(std::chrono::steady_clock::now())
+    {
+        if (m_Options.headless && (m_Options.frameCount == 0)) m_Options.frameCount = HEADLESS_DEFAULT_FRAME_COUNT;
+        m_FramesInFlight = std::max(m_Options.framesInFlight, 1u);
+        m_FrameStats.Initialize(m_Options.statsPath, m_Options.statsInterval);
+    }
+
     void Run()
     {
-        CreateWindow();
         InitializeVulkan();
-        MainLoop();
+        if (m_Options.benchmarkRecording) BenchmarkRecording();
+        else MainLoop();
         Uninitialize();
     }
 
 private:
     const uint32_t WIDTH = 1024;
     const uint32_t HEIGHT = 720;
+    const uint32_t HEADLESS_IMAGE_COUNT = 3;
+    static constexpr uint32_t HEADLESS_DEFAULT_FRAME_COUNT = 1000;
+
+    AppOptions m_Options;
 
     GLFWwindow* m_pWindow = nullptr;
+    bool m_IsFramebufferResized = false; // Set by GLFW on the main thread, handed to the render thread in the next packet
+    bool m_IsSwapChainOutOfDate = false; // Not recreated yet, the window was minimized
 
     vk::SurfaceKHR m_Surface;
-    vk::SwapchainKHR m_SwapChain;
-    std::vector<vk::Image> m_SwapChainImages;
-    std::vector<vk::ImageView> m_SwapChainImageViews;
-    std::vector<vk::Framebuffer> m_SwapChainFramebuffers;
-    vk::Format m_SwapChainImageFormat = vk::Format::eUndefined;
-    vk::Extent2D m_SwapChainExtent;
+    std::unique_ptr<FrameSink> m_pFrameSink;
 
     vk::Instance m_Instance;
     vk::DispatchLoaderDynamic m_DynamicLoader;
@@ -70,43 +175,195 @@ private:
     vk::Device m_Device;
     vk::Queue m_GraphicsQueue;
     vk::Queue m_PresentQueue;
+    vk::Queue m_TransferQueue; // Same as m_GraphicsQueue without a dedicated transfer family
     QueueFamilyIndices m_QueueFamilyIndices;
+    DeviceMemoryAllocator m_MemoryAllocator;
 
-    vk::RenderPass m_RenderPass;
+    // Declared again whenever the frame sink's images change
+    RenderGraph m_RenderGraph;
+    RenderGraph::PassHandle m_ScenePass = 0;
+    bool m_IsBlurSupported = false;
     vk::PipelineLayout m_PipelineLayout;
-    vk::Pipeline m_GraphicsPipeline;
+    PipelineCache m_PipelineCache;
+    PipelineCompiler m_PipelineCompiler;
+    PipelineStateCache m_PipelineStateCache;
+    size_t m_PendingPipelineCount = 1; // Until the first PipelineStateCache::Update()
+#ifdef SHADER_HOT_RELOAD
+    ShaderHotReload m_ShaderHotReload;
+#endif
 
-    vk::CommandPool m_CommandPool;
-    std::vector<vk::CommandBuffer> m_CommandBuffers;
+    // Materials with the same pipeline state share the pipeline
+    struct Material
+    {
+        std::string name;
+        BlendMode blendMode = BlendMode::Opaque;
+        uint32_t shaderFeatures = 0; // Variant of the fragment shader, see fragment_shader_features
+        float tint[4] = { 1.0f, 1.0f, 1.0f, 1.0f }; // In the material buffer, read by the fragment shader
+        PipelineStateCache::PipelineId pipeline = 0;
+    };
+    std::vector<Material> m_Materials;
+    static constexpr uint8_t SPECIALIZATION_GRAYSCALE = 1 << 0; // constant_id 0 of shader.frag
+    static constexpr uint8_t SPECIALIZATION_INDIRECT_DRAWS = 1 << 1; // constant_id 1 of shader.vert
+    bool m_PipelineCreationFeedbackSupported = false;
+
+    // Secondary command buffers of one recording thread for one frame in flight. The pool is reset when the frame
+    // slot comes around again, and the buffers are reused.
+    struct RecordingPool
+    {
+        vk::CommandPool pool;
+        std::vector<vk::CommandBuffer> buffers;
+        uint32_t usedCount = 0;
+    };
 
+    vk::CommandPool m_CommandPool;
+    std::vector<vk::CommandBuffer> m_CommandBuffers; // Primaries, one per frame in flight, re-recorded every frame
+    std::vector<std::vector<RecordingPool>> m_RecordingPools; // [frame in flight][recording thread]
+    std::vector<vk::CommandBuffer> m_Secondaries; // Of the frame being recorded, in draw order
+    vk::DescriptorSet m_FrameSet; // Of the frame being recorded
+    std::vector<DrawParameters> m_Draws;
+    std::vector<Scene::NodeId> m_DrawNodes; // Of each draw
+    std::vector<PipelineStateCache::PipelineId> m_DrawPipelines; // Of each draw, the draws are sorted by pipeline
+    JobSystem m_JobSystem;
+    static constexpr uint32_t MIN_DRAWS_PER_SECONDARY = 256;
+
+    // Set 0 is the bindless table, set 1 is allocated every frame and points at the frame's uniforms in the ring
+    BindlessTable m_BindlessTable;
+    FrameDescriptorAllocator m_FrameDescriptors;
+    vk::DescriptorSetLayout m_FrameSetLayout;
+    UniformRing m_UniformRing;
+    vk::DeviceSize m_DrawUniformStride = 0; // sizeof(DrawParameters) aligned for dynamic offsets
+    uint32_t m_FrameDrawCount = 0; // Draws whose uniforms fit in the ring this frame, the others are skipped
+    vk::Buffer m_MaterialBuffer;
+    MemoryAllocation m_MaterialBufferAllocation;
+    uint32_t m_MaterialBufferIndex = 0;
+
+    // With --culling, the draws are culled into indirect draws, one per batch of draws sharing a pipeline, which
+    // read their parameters from the draw buffer instead of the uniform ring
+    DrawCuller m_DrawCuller;
+    DrawCuller::Features m_DrawCullerFeatures;
+    std::vector<PipelineStateCache::PipelineId> m_BatchPipelines;
+    vk::Buffer m_DrawBuffer;
+    MemoryAllocation m_DrawBufferAllocation;
+    uint32_t m_DrawBufferIndex = 0;
+    float m_CameraView[4] = { 0.0f, 0.0f, 1.0f, 0.0f }; // Of the frame being recorded, see FrameConstants::view
+    float m_FrameTime = 0.0f; // Simulation time of the frame being recorded, see FramePacket::time
+
+    // A root, a node per row of the grid and a node per draw. The glow draws spin, their world matrices and those of
+    // nothing else change every frame. Every frame writes all of them to its slot's partition of the instance buffer.
+    // The main thread updates the scene, so the matrices reach the render thread through a snapshot per packet.
+    Scene m_Scene;
+    std::vector<Scene::NodeId> m_SpinningNodes;
+    std::vector<float> m_InstanceSnapshots;
+    size_t m_InstanceSnapshotSize = 0; // In bytes
+    vk::Buffer m_InstanceBuffer;
+    MemoryAllocation m_InstanceBufferAllocation;
+    vk::DeviceSize m_InstancePartitionSize = 0;
+    std::vector<uint32_t> m_InstanceBufferIndices; // Of each frame slot's partition
+    static constexpr float SPIN_SPEED = 1.5f; // Radians per second
+    static constexpr uint32_t BINDLESS_MAX_TEXTURES = 4096;
+    static constexpr uint32_t BINDLESS_MAX_BUFFERS = 4096;
+    static constexpr uint32_t FRAME_DESCRIPTOR_SETS_PER_POOL = 64;
+    static constexpr vk::DeviceSize UNIFORM_RING_MIN_SIZE = 64 * 1024;
+
+    vk::Buffer m_VertexBuffer;
+    MemoryAllocation m_VertexBufferAllocation;
+    vk::Buffer m_IndexBuffer;
+    MemoryAllocation m_IndexBufferAllocation;
+    uint32_t m_IndexCount = 0;
+
+    StagingRing m_StagingRing;
+    // With a dedicated transfer family, the copies of each frame are submitted to m_TransferQueue, which signals the
+    // frame's value on m_TransferSemaphore for the graphics submission to wait on
+    vk::CommandPool m_TransferCommandPool;
+    std::vector<vk::CommandBuffer> m_TransferCommandBuffers; // One per frame in flight
+    vk::Semaphore m_TransferSemaphore;
+    vk::Buffer m_StreamBuffer; // Destination of the synthetic streaming workload, a partition per frame in flight
+    MemoryAllocation m_StreamBufferAllocation;
+    std::vector<uint8_t> m_StreamData;
+    static constexpr vk::DeviceSize STREAM_UPLOAD_CHUNK_SIZE = 64 * 1024;
+    static constexpr vk::DeviceSize STAGING_RING_MIN_SIZE = 4 * 1024 * 1024;
+
+    // Binary semaphores are only needed by the swapchain, frames are paced with the timeline of m_FramePacer
     std::vector<vk::Semaphore> m_ImageAvailableSemaphores;
     std::vector<vk::Semaphore> m_RenderFinishedSemaphores;
-    std::vector<vk::Fence> m_InFlightFences;
-    std::vector<vk::Fence> m_ImagesInFlight;
-    const int MAX_FRAMES_IN_FLIGHT = 2;
+    FramePacer m_FramePacer;
+    size_t m_FramesInFlight = 2;
     size_t currentFrame = 0;
 
+    FrameStats m_FrameStats;
+    const std::chrono::steady_clock::time_point m_StartTime; // Time to first frame is measured from here
+    bool m_IsFirstFramePresented = false;
+    bool m_IsFirstCompleteFramePresented = false; // First frame rendered with every pipeline
+    std::chrono::steady_clock::time_point m_InputTime; // When input was sampled for the frame being rendered
+    std::chrono::steady_clock::time_point m_NextFrameTime; // Frame limiter schedule
+    double m_InputLatencySum = 0.0;
+    float m_MaxInputLatency = 0.0f;
+    uint64_t m_PresentCount = 0;
+    uint32_t m_SwapChainRecreateCount = 0;
+    vk::QueryPool m_TimestampQueryPool; // Two timestamps per frame in flight, around the render graph
+    std::vector<bool> m_TimestampsWritten;
+    float m_TimestampPeriod = 0.0f; // Nanoseconds per tick
+
+    // With --render-thread, GLFW stays on the main thread, which polls events, simulates and pushes a packet per
+    // frame. The render thread pops them and does everything else, including the waits on the GPU and the acquire.
+    SpscQueue<FramePacket> m_FramePackets;
+    std::thread m_RenderThread;
+    std::atomic<bool> m_IsRenderThreadStopping{ false };
+    std::atomic<bool> m_IsRenderThreadFailed{ false };
+    std::exception_ptr m_RenderThreadException;
+    IntervalStats m_MainLoopIntervals; // Between input samples
+    IntervalStats m_RenderIntervals; // Between frame submissions
+    uint64_t m_QueueFullCount = 0; // Packets the main thread had to wait to push
+    double m_QueueWaitMilliseconds = 0.0;
+    static constexpr uint32_t IDLE_SPIN_COUNT = 64; // Yields before a waiting thread starts sleeping
+    uint64_t m_TimestampMask = 0;
+
+    // Must run on the main thread, after glfwInit()
     void CreateWindow()
     {
-        glfwInit();
-
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         m_pWindow = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        glfwSetWindowUserPointer(m_pWindow, this);
+        glfwSetFramebufferSizeCallback(m_pWindow, [](GLFWwindow* p_pWindow, int, int) {
+            static_cast<VulkanApp*>(glfwGetWindowUserPointer(p_pWindow))->m_IsFramebufferResized = true;
+        });
     }
 
     void InitializeVulkan()
     {
-        CreateInstance();
-        CreateSurface(); // Should be called before createDevice() as it may affect the query results
+        const auto startTime = std::chrono::steady_clock::now();
+
+        // The instance is created while the main thread opens the window, which GLFW only allows there
+        if (!m_Options.headless) glfwInit();
+        std::future<void> instanceCreated = std::async(std::launch::async, [this]() { CreateInstance(); });
+        if (!m_Options.headless) CreateWindow();
+        instanceCreated.get();
+
+        if (!m_Options.headless) CreateSurface(); // Should be called before createDevice() as it may affect the query results
         CreateDevice();
-        CreateSwapChain();
-        CreateRenderPass();
-        CreateGraphicsPipeline();
-        CreateFramebuffers();
+        m_PipelineCompiler.Initialize(std::max(1u, std::thread::hardware_concurrency() / 2));
+        CreateFrameSink();
+        CreateRenderGraph();
+        CreateDescriptors();
+        CreatePipelineLayout();
+        CreateGraphicsPipelines();
+#ifdef SHADER_HOT_RELOAD
+        m_ShaderHotReload.Initialize(SHADER_MANIFEST_PATH, GLSLC_PATH, SHADER_HOT_RELOAD_DIR);
+#endif
+        CreateTransferObjects();
+        CreateGeometryBuffers();
+        CreateInstanceBuffer();
+        CreateMaterialBuffer();
+        CreateDrawCuller();
+        CreateUniformRing();
+        CreateTimestampQueryPool();
         CreateCommandBuffers();
         CreateSyncObjects();
+
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::cerr << "Vulkan initialized in " << milliseconds << " ms" << std::endl;
     }
 
     std::vector<const char*> GetValidationLayers()
@@ -126,6 +383,7 @@ private:
             if (it == availableLayers.end())
             {
                 std::cerr << "- Layer \"" << layerToEnable << "\" is not available, ignoring." << std::endl;
+                continue;
             }
             layers.push_back(layerToEnable.data());
         }
@@ -137,9 +395,12 @@ private:
     {
         std::vector<const char*> extensions;
 
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-        for (uint32_t i = 0; i < glfwExtensionCount; i++) extensions.push_back(glfwExtensions[i]);
+        if (!m_Options.headless)
+        {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            for (uint32_t i = 0; i < glfwExtensionCount; i++) extensions.push_back(glfwExtensions[i]);
+        }
 
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
@@ -151,7 +412,7 @@ private:
         vk::ApplicationInfo appInfo;
         appInfo.pApplicationName = "Vulkan Playground";
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_2;
 
         vk::InstanceCreateInfo createInfo;
         createInfo.pApplicationInfo = &appInfo;
@@ -192,6 +453,40 @@ private:
         }
     }
 
+    // Takes the first match of each kind rather than the last one, preferring a graphics family that can present so
+    // that swapchain images never change queue family
+    void SelectQueueFamilies()
+    {
+        m_QueueFamilyIndices.presentRequired = !m_Options.headless;
+        std::optional<uint32_t> graphicsAndPresent;
+        std::optional<uint32_t> compute; // Without graphics, the transfer family when there is no transfer-only one
+        const std::vector<vk::QueueFamilyProperties> queueFamilyProperties = m_PhysicalDevice.getQueueFamilyProperties();
+        for (uint32_t i = 0; i < queueFamilyProperties.size(); i++)
+        {
+            const vk::QueueFlags flags = queueFamilyProperties[i].queueFlags;
+            const bool isGraphics = static_cast<bool>(flags & vk::QueueFlagBits::eGraphics);
+            const bool isCompute = static_cast<bool>(flags & vk::QueueFlagBits::eCompute);
+            const bool isPresent = m_Surface && m_PhysicalDevice.getSurfaceSupportKHR(i, m_Surface);
+
+            if (isGraphics && !m_QueueFamilyIndices.graphics.has_value()) m_QueueFamilyIndices.graphics = i;
+            if (isPresent && !m_QueueFamilyIndices.present.has_value()) m_QueueFamilyIndices.present = i;
+            if (isGraphics && isPresent && !graphicsAndPresent.has_value()) graphicsAndPresent = i;
+            if (!m_Options.asyncQueues) continue;
+
+            // Compute families also support transfers, implicitly
+            if (isCompute && !isGraphics && !compute.has_value()) compute = i;
+            if ((flags & vk::QueueFlagBits::eTransfer) && !isGraphics && !isCompute && !m_QueueFamilyIndices.transfer.has_value()) m_QueueFamilyIndices.transfer = i;
+        }
+        if (graphicsAndPresent.has_value()) m_QueueFamilyIndices.graphics = m_QueueFamilyIndices.present = graphicsAndPresent;
+        if (!m_QueueFamilyIndices.IsComplete()) throw std::runtime_error("Failed to find a queue supporting graphics.");
+
+        if (!m_QueueFamilyIndices.transfer.has_value()) m_QueueFamilyIndices.transfer = compute;
+        if (!m_QueueFamilyIndices.transfer.has_value()) m_QueueFamilyIndices.transfer = m_QueueFamilyIndices.graphics;
+
+        std::cerr << "Queue families: graphics " << m_QueueFamilyIndices.graphics.value()
+            << ", transfer " << m_QueueFamilyIndices.transfer.value() << (m_QueueFamilyIndices.HasAsyncTransfer() ? "" : " (graphics)") << std::endl;
+    }
+
     void CreateDevice()
     {
         const std::vector<vk::PhysicalDevice> physicalDevices = m_Instance.enumeratePhysicalDevices();
@@ -200,16 +495,9 @@ private:
         m_PhysicalDevice = physicalDevices[0];
         const vk::PhysicalDeviceProperties properties = m_PhysicalDevice.getProperties();
         std::cerr << "Selected device \"" << properties.deviceName << "\"" << std::endl;
+        if (properties.apiVersion < VK_API_VERSION_1_2) throw std::runtime_error("Vulkan 1.2 is required for timeline semaphores.");
 
-        const std::vector<vk::QueueFamilyProperties> queueFamilyProperties = m_PhysicalDevice.getQueueFamilyProperties();
-        for (uint32_t i = 0; i < queueFamilyProperties.size(); i++)
-        {
-            if (queueFamilyProperties[i].queueFlags & vk::QueueFlagBits::eGraphics) m_QueueFamilyIndices.graphics = i;
-            if (m_PhysicalDevice.getSurfaceSupportKHR(i, m_Surface)) m_QueueFamilyIndices.present = i;
-
-            if (m_QueueFamilyIndices.IsComplete()) break;
-        }
-        if (!m_QueueFamilyIndices.IsComplete()) throw std::runtime_error("Failed to find a queue supporting graphics.");
+        SelectQueueFamilies();
 
         std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
         const float queuePriority = 1.0f;
@@ -222,15 +510,47 @@ private:
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        // Descriptor indexing is optional in Vulkan 1.2, the bindless table needs these parts of it
+        const auto supportedFeatures = m_PhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        const vk::PhysicalDeviceVulkan12Features& supported12 = supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>();
+        if (!supported12.runtimeDescriptorArray || !supported12.descriptorBindingPartiallyBound ||
+            !supported12.descriptorBindingSampledImageUpdateAfterBind || !supported12.descriptorBindingStorageBufferUpdateAfterBind)
+        {
+            throw std::runtime_error("Descriptor indexing with update-after-bind is required for the bindless table.");
+        }
+
         vk::PhysicalDeviceFeatures deviceFeatures;
+        vk::PhysicalDeviceVulkan12Features vulkan12Features;
+        vulkan12Features.timelineSemaphore = VK_TRUE; // Required by Vulkan 1.2
+        vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+
+        // Optional, the culling falls back to the CPU and to one draw per object without them
+        const vk::PhysicalDeviceFeatures& supported10 = supportedFeatures.get<vk::PhysicalDeviceFeatures2>().features;
+        m_DrawCullerFeatures.drawIndirectCount = supported12.drawIndirectCount;
+        m_DrawCullerFeatures.multiDrawIndirect = supported10.multiDrawIndirect && supported10.drawIndirectFirstInstance;
+        vulkan12Features.drawIndirectCount = supported12.drawIndirectCount;
+        deviceFeatures.multiDrawIndirect = m_DrawCullerFeatures.multiDrawIndirect;
+        deviceFeatures.drawIndirectFirstInstance = m_DrawCullerFeatures.multiDrawIndirect;
 
         vk::DeviceCreateInfo deviceCreateInfo;
+        deviceCreateInfo.pNext = &vulkan12Features;
         deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-        const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+        std::vector<const char*> deviceExtensions;
+        if (!m_Options.headless) deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+        // Optional, used to report pipeline cache hits
+        for (const vk::ExtensionProperties& extension : m_PhysicalDevice.enumerateDeviceExtensionProperties())
+        {
+            if (std::string(extension.extensionName) == VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) m_PipelineCreationFeedbackSupported = true;
+        }
+        if (m_PipelineCreationFeedbackSupported) deviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
         deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.empty() ? nullptr : deviceExtensions.data();
 
         m_Device = m_PhysicalDevice.createDevice(deviceCreateInfo);
 #ifndef _WIN64
@@ -238,269 +558,737 @@ private:
 #endif
 
         m_GraphicsQueue = m_Device.getQueue(m_QueueFamilyIndices.graphics.value(), 0);
-        m_PresentQueue = m_Device.getQueue(m_QueueFamilyIndices.present.value(), 0);
+        m_TransferQueue = m_Device.getQueue(m_QueueFamilyIndices.transfer.value(), 0);
+        m_PipelineCache.Initialize(m_PhysicalDevice, m_Device, m_Options.pipelineCachePath);
+        m_MemoryAllocator.Initialize(m_PhysicalDevice, m_Device);
+        if (m_QueueFamilyIndices.present.has_value()) m_PresentQueue = m_Device.getQueue(m_QueueFamilyIndices.present.value(), 0);
     }
 
-    void CreateSwapChain()
+    void CreateFrameSink()
     {
-        // Surface format
-        std::optional<vk::SurfaceFormatKHR> surfaceFormat;
-        const std::vector<vk::SurfaceFormatKHR> formats = m_PhysicalDevice.getSurfaceFormatsKHR(m_Surface);
-        for (const auto& format : formats) {
-            if ((format.format == vk::Format::eB8G8R8A8Unorm) && (format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear)) {
-                surfaceFormat = format;
-            }
+        if (m_Options.headless)
+        {
+            auto pOffscreenSink = std::make_unique<OffscreenFrameSink>();
+            pOffscreenSink->Initialize(m_MemoryAllocator, vk::Format::eR8G8B8A8Unorm, vk::Extent2D(WIDTH, HEIGHT), HEADLESS_IMAGE_COUNT);
+            m_pFrameSink = std::move(pOffscreenSink);
+        }
+        else
+        {
+            auto pSwapChainSink = std::make_unique<SwapChainFrameSink>();
+            pSwapChainSink->Initialize(m_PhysicalDevice, m_Device, m_Surface, m_PresentQueue,
+                m_QueueFamilyIndices.graphics.value(), m_QueueFamilyIndices.present.value(), m_Options.presentMode, vk::Extent2D(WIDTH, HEIGHT));
+            std::cerr << "Present mode " << GetPresentModeName(pSwapChainSink->GetPresentMode()) << std::endl;
+            m_pFrameSink = std::move(pSwapChainSink);
+        }
+    }
+
+    void CreateRenderGraph()
+    {
+        m_RenderGraph.Initialize(m_Device, m_MemoryAllocator);
+
+        const vk::FormatFeatureFlags blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+            vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+        const vk::FormatFeatureFlags features = m_PhysicalDevice.getFormatProperties(m_pFrameSink->GetFormat()).optimalTilingFeatures;
+        m_IsBlurSupported = ((features & blitFeatures) == blitFeatures) && (m_pFrameSink->GetImageUsage() & vk::ImageUsageFlagBits::eTransferDst);
+        if ((m_Options.blurPassCount > 0) && !m_IsBlurSupported) std::cerr << "The frame sink's images can't be blitted to, blurring is disabled." << std::endl;
+
+        BuildRenderGraph();
+    }
+
+    // The scene pass draws into the frame sink's image. With --blur-passes it draws into a transient image instead,
+    // which is halved that many times with blits and scaled back up into the frame sink's image; the images of the
+    // chain whose lifetimes don't overlap share memory. With --culling gpu the culling passes come first.
+    void BuildRenderGraph()
+    {
+        const vk::Format format = m_pFrameSink->GetFormat();
+        const vk::Extent2D extent = m_pFrameSink->GetExtent();
+        // Swapchain images are available once the acquire semaphore is waited on, at the color attachment output
+        // stage. Offscreen images were last written by the render pass or a blit of an earlier frame.
+        const RenderGraph::ImageHandle backbuffer = m_RenderGraph.ImportImage("backbuffer", m_pFrameSink->GetImages(), m_pFrameSink->GetImageViews(),
+            format, extent, vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eTransfer);
+        m_RenderGraph.ExportImage(backbuffer, m_pFrameSink->GetFinalLayout());
+
+        const uint32_t blurPassCount = m_IsBlurSupported ? m_Options.blurPassCount : 0;
+        const RenderGraph::ImageHandle sceneColor = (blurPassCount > 0) ? m_RenderGraph.CreateImage("scene_color", format, extent) : backbuffer;
+        m_DrawCuller.AddPasses(m_RenderGraph);
+        RenderGraph::Pass& scenePass = m_RenderGraph.AddPass("scene").WriteColor(sceneColor, vk::AttachmentLoadOp::eClear, { 0.2f, 0.2f, 0.2f, 1.0f });
+        if (m_DrawCuller.IsEnabled())
+        {
+            // A few indirect draws, recorded inline
+            m_DrawCuller.ReadDraws(scenePass);
+            scenePass.SetExecute([this](const RenderGraph::PassContext& p_Context) { RecordIndirectDraws(p_Context.commandBuffer, m_FrameSet); });
+        }
+        else
+        {
+            scenePass.UseSecondaryCommandBuffers().SetExecute([this](const RenderGraph::PassContext& p_Context) {
+                RecordSecondaries(m_JobSystem, currentFrame, p_Context.renderPass, p_Context.framebuffer, m_FrameSet);
+                if (!m_Secondaries.empty()) p_Context.commandBuffer.executeCommands(m_Secondaries);
+            });
         }
-        if (!surfaceFormat.has_value() && !formats.empty()) surfaceFormat = formats[0];
-        if (!surfaceFormat.has_value()) throw std::runtime_error("Failed to find suitable surface format.");
-
-        // Present mode: Prefer Mailbox present mode, but use FIFO if not available. FIFO has to be supported.
-        const std::vector<vk::PresentModeKHR> presentModes = m_PhysicalDevice.getSurfacePresentModesKHR(m_Surface);
-        const bool isMailboxSupported = std::find(presentModes.begin(), presentModes.end(), vk::PresentModeKHR::eMailbox) != presentModes.end();
-        const vk::PresentModeKHR presentMode = isMailboxSupported ? vk::PresentModeKHR::eMailbox : vk::PresentModeKHR::eFifo;
-
-        // ROI of the Window
-        const vk::SurfaceCapabilitiesKHR capabilities = m_PhysicalDevice.getSurfaceCapabilitiesKHR(m_Surface);
-        const vk::Extent2D extent = (capabilities.currentExtent.width != UINT32_MAX) ?
-            capabilities.currentExtent :
-            vk::Extent2D(std::clamp(WIDTH, capabilities.minImageExtent.width, capabilities.maxImageExtent.width), std::clamp(HEIGHT, capabilities.minImageExtent.height, capabilities.maxImageExtent.height));
-
-        // Chain length
-        uint32_t imageCount = capabilities.minImageCount + 1;
-        if (capabilities.maxImageCount > 0) imageCount = std::min(imageCount, capabilities.maxImageCount);
-
-        vk::SwapchainCreateInfoKHR createInfo;
-        createInfo.surface = m_Surface;
-        createInfo.minImageCount = imageCount;
-        createInfo.imageFormat = surfaceFormat.value().format;
-        createInfo.imageColorSpace = surfaceFormat.value().colorSpace;
-        createInfo.imageExtent = extent;
-        createInfo.imageArrayLayers = 1; // Mono, 2 for stereo
-        createInfo.imageUsage = vk::ImageUsageFlagBits::eColorAttachment;
-        createInfo.preTransform = capabilities.currentTransform; // No transform
-        createInfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque; // Ignore alpha when compositing window
-        createInfo.presentMode = presentMode;
-        createInfo.clipped = VK_TRUE;
-
-        createInfo.imageSharingMode = vk::SharingMode::eExclusive;
-        uint32_t queueFamilyIndices[] = { m_QueueFamilyIndices.graphics.value(), m_QueueFamilyIndices.present.value() };
-        if (m_QueueFamilyIndices.graphics != m_QueueFamilyIndices.present) {
-            createInfo.imageSharingMode = vk::SharingMode::eConcurrent;
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
-        }
-
-        m_SwapChain = m_Device.createSwapchainKHR(createInfo);
-        m_SwapChainImageFormat = createInfo.imageFormat;
-        m_SwapChainExtent = createInfo.imageExtent;
-
-        // Get images and image views
-        for (const vk::Image& image : m_Device.getSwapchainImagesKHR(m_SwapChain)) m_SwapChainImages.push_back(image);
-
-        for (const vk::Image& image : m_SwapChainImages)
-        {
-            vk::ImageViewCreateInfo createInfo;
-            createInfo.image = image;
-            createInfo.viewType = vk::ImageViewType::e2D;
-            createInfo.format = m_SwapChainImageFormat;
-            createInfo.components.r = vk::ComponentSwizzle::eIdentity;
-            createInfo.components.g = vk::ComponentSwizzle::eIdentity;;
-            createInfo.components.b = vk::ComponentSwizzle::eIdentity;;
-            createInfo.components.a = vk::ComponentSwizzle::eIdentity;;
-            createInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-            createInfo.subresourceRange.baseMipLevel = 0;
-            createInfo.subresourceRange.levelCount = 1;
-            createInfo.subresourceRange.baseArrayLayer = 0;
-            createInfo.subresourceRange.layerCount = 1;
-
-            m_SwapChainImageViews.push_back(m_Device.createImageView(createInfo));
-        }
-    }
-
-    vk::UniqueShaderModule CreateShaderModule(const Resource& p_Resource)
-    {
-        std::vector<uint32_t> data(p_Resource.second / 4 + 1);
-        memcpy(data.data(), p_Resource.first, p_Resource.second);
-        vk::ShaderModuleCreateInfo createInfo;
-        createInfo.codeSize = p_Resource.second;
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(data.data());
-        return m_Device.createShaderModuleUnique(createInfo);
-    }
-
-    void CreateRenderPass()
-    {
-        vk::AttachmentDescription colorAttachment;
-        colorAttachment.format = m_SwapChainImageFormat;
-        colorAttachment.samples = vk::SampleCountFlagBits::e1;
-        colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-        colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
-        colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-        colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        colorAttachment.initialLayout = vk::ImageLayout::eUndefined;
-        colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
-
-        vk::AttachmentReference colorAttachmentRef;
-        colorAttachmentRef.attachment = 0;
-        colorAttachmentRef.layout = vk::ImageLayout::eColorAttachmentOptimal;
-
-        vk::SubpassDescription subpass;
-        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-        subpass.colorAttachmentCount = 1; // Fragment shader layout(location = 0) out vec4 outColor
-        subpass.pColorAttachments = &colorAttachmentRef;
-
-        vk::RenderPassCreateInfo renderPassInfo;
-        renderPassInfo.attachmentCount = 1;
-        renderPassInfo.pAttachments = &colorAttachment;
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-
-        vk::SubpassDependency dependency;
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-        dependency.srcAccessMask = vk::AccessFlags();
-        dependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-        dependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
-
-        m_RenderPass = m_Device.createRenderPass(renderPassInfo);
-    }
-
-    void CreateGraphicsPipeline()
-    {
-        vk::UniqueShaderModule vertexShaderModule = CreateShaderModule(rcVertexShader);
-        vk::UniqueShaderModule fragmentShaderModule = CreateShaderModule(rcFragmentShader);
-
-        vk::PipelineShaderStageCreateInfo vertexShaderStageInfo;
-        vertexShaderStageInfo.stage = vk::ShaderStageFlagBits::eVertex;
-        vertexShaderStageInfo.module = vertexShaderModule.get();
-        vertexShaderStageInfo.pName = "main";
-
-        vk::PipelineShaderStageCreateInfo fragmentShaderStageInfo;
-        fragmentShaderStageInfo.stage = vk::ShaderStageFlagBits::eFragment;
-        fragmentShaderStageInfo.module = fragmentShaderModule.get();
-        fragmentShaderStageInfo.pName = "main";
-
-        vk::PipelineShaderStageCreateInfo shaderStageInfos[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
-
-        vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
-
-        vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
-        inputAssembly.topology = vk::PrimitiveTopology::eTriangleList;
+        m_ScenePass = scenePass.GetHandle();
 
-        vk::Viewport viewport;
-        viewport.width = static_cast<float>(m_SwapChainExtent.width);
-        viewport.height = static_cast<float>(m_SwapChainExtent.height);
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        vk::Rect2D scissor;
-        scissor.offset = vk::Offset2D{ 0, 0 };
-        scissor.extent = m_SwapChainExtent;
-
-        vk::PipelineViewportStateCreateInfo viewportState;
-        viewportState.viewportCount = 1;
-        viewportState.pViewports = &viewport;
-        viewportState.scissorCount = 1;
-        viewportState.pScissors = &scissor;
-
-        vk::PipelineRasterizationStateCreateInfo rasterizer;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = vk::PolygonMode::eFill;
-        rasterizer.cullMode = vk::CullModeFlagBits::eBack;
-        rasterizer.frontFace = vk::FrontFace::eClockwise;
-        rasterizer.lineWidth = 1.0f;
+        std::vector<RenderGraph::ImageHandle> chain = { sceneColor };
+        for (uint32_t i = 1; i <= blurPassCount; i++)
+        {
+            const vk::Extent2D previous = m_RenderGraph.GetExtent(chain.back());
+            const vk::Extent2D size(std::max(previous.width / 2, 1u), std::max(previous.height / 2, 1u));
+            chain.push_back(m_RenderGraph.CreateImage("downsample_" + std::to_string(i), format, size));
+            AddBlitPass("downsample_" + std::to_string(i), chain[i - 1], chain[i]);
+        }
+        RenderGraph::ImageHandle source = chain.back();
+        for (uint32_t i = blurPassCount; i > 0; i--)
+        {
+            const std::string name = "upsample_" + std::to_string(blurPassCount - i + 1);
+            const RenderGraph::ImageHandle target = (i > 1) ? m_RenderGraph.CreateImage(name, format, m_RenderGraph.GetExtent(chain[i - 1])) : backbuffer;
+            AddBlitPass(name, source, target);
+            source = target;
+        }
+
+        m_RenderGraph.Compile();
+    }
 
-        vk::PipelineMultisampleStateCreateInfo multisampling;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = vk::SampleCountFlagBits::e1;
-
-        vk::PipelineColorBlendAttachmentState colorBlendAttachment;
-        colorBlendAttachment.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-        colorBlendAttachment.blendEnable = VK_FALSE;
-
-        vk::PipelineColorBlendStateCreateInfo colorBlending;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
+    void AddBlitPass(const std::string& p_Name, RenderGraph::ImageHandle p_Source, RenderGraph::ImageHandle p_Destination)
+    {
+        m_RenderGraph.AddPass(p_Name)
+            .ReadImage(p_Source, RenderGraph::ImageUsage::TransferSrc())
+            .WriteImage(p_Destination, RenderGraph::ImageUsage::TransferDst())
+            .SetExecute([p_Source, p_Destination](const RenderGraph::PassContext& p_Context) {
+                const vk::Extent2D sourceExtent = p_Context.GetExtent(p_Source);
+                const vk::Extent2D destinationExtent = p_Context.GetExtent(p_Destination);
+                vk::ImageBlit region;
+                region.srcSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+                region.srcOffsets[1] = vk::Offset3D(static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height), 1);
+                region.dstSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+                region.dstOffsets[1] = vk::Offset3D(static_cast<int32_t>(destinationExtent.width), static_cast<int32_t>(destinationExtent.height), 1);
+                p_Context.commandBuffer.blitImage(p_Context.GetImage(p_Source), vk::ImageLayout::eTransferSrcOptimal,
+                    p_Context.GetImage(p_Destination), vk::ImageLayout::eTransferDstOptimal, { region }, vk::Filter::eLinear);
+            });
+    }
 
+    void CreateDescriptors()
+    {
+        // Every stage may index the table, it has to fit the per-stage update-after-bind limits
+        const auto properties = m_PhysicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+        const vk::PhysicalDeviceVulkan12Properties& limits = properties.get<vk::PhysicalDeviceVulkan12Properties>();
+        const uint32_t maxTextures = std::min({ BINDLESS_MAX_TEXTURES, limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            limits.maxPerStageDescriptorUpdateAfterBindSamplers, limits.maxPerStageUpdateAfterBindResources / 2 });
+        const uint32_t maxBuffers = std::min({ BINDLESS_MAX_BUFFERS, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+            limits.maxPerStageUpdateAfterBindResources / 2 });
+        m_BindlessTable.Initialize(m_Device, maxTextures, maxBuffers);
+
+        // The draw's uniforms are bound with a dynamic offset, one set serves every draw of the frame
+        const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
+        const vk::DescriptorSetLayoutBinding frameBindings[] = {
+            vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, stages),
+            vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eUniformBufferDynamic, 1, stages),
+        };
+        vk::DescriptorSetLayoutCreateInfo layoutInfo;
+        layoutInfo.bindingCount = 2;
+        layoutInfo.pBindings = frameBindings;
+        m_FrameSetLayout = m_Device.createDescriptorSetLayout(layoutInfo);
+
+        m_FrameDescriptors.Initialize(m_Device, static_cast<uint32_t>(m_FramesInFlight),
+            {
+                vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, FRAME_DESCRIPTOR_SETS_PER_POOL),
+                vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, FRAME_DESCRIPTOR_SETS_PER_POOL),
+            }, FRAME_DESCRIPTOR_SETS_PER_POOL);
+    }
+
+    void CreatePipelineLayout()
+    {
+        const vk::DescriptorSetLayout setLayouts[] = { m_BindlessTable.GetLayout(), m_FrameSetLayout };
         vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+        pipelineLayoutInfo.setLayoutCount = 2;
+        pipelineLayoutInfo.pSetLayouts = setLayouts;
         m_PipelineLayout = m_Device.createPipelineLayout(pipelineLayoutInfo);
+    }
+
+    // The pipelines are built on the compiler's threads while the rest of the initialization goes on. Frames are
+    // rendered without the draws of a pipeline until it is ready, unless --sync-pipelines waits for them here.
+    void CreateGraphicsPipelines()
+    {
+        m_PipelineStateCache.Initialize(m_Device, m_PipelineCache, m_PipelineCompiler, m_PipelineCreationFeedbackSupported);
+
+        PipelineStateKey key;
+        key.vertexLayout = m_PipelineStateCache.RegisterVertexLayout(
+            { vk::VertexInputBindingDescription(0, sizeof(Vertex), vk::VertexInputRate::eVertex) },
+            {
+                vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, position)),
+                vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, color)),
+            });
+        key.renderPass = m_PipelineStateCache.RegisterRenderPass(m_RenderGraph.GetRenderPass(m_ScenePass));
+
+        key.specializationFlags = m_Options.grayscale ? SPECIALIZATION_GRAYSCALE : 0;
+        if (m_Options.culling != CullingMode::None) key.specializationFlags |= SPECIALIZATION_INDIRECT_DRAWS;
+
+        m_Materials = {
+            { "ground", BlendMode::Opaque, 0, { 0.8f, 1.0f, 0.8f, 1.0f } },
+            { "props", BlendMode::Opaque, 0, { 1.0f, 0.9f, 0.7f, 1.0f } },
+            { "faded", BlendMode::Opaque, fragment_shader_features::DESATURATE },
+            { "glow", BlendMode::Additive, fragment_shader_features::GLOW, { 1.0f, 0.8f, 0.4f, 1.0f } },
+        };
+        for (Material& material : m_Materials)
+        {
+            key.program = m_PipelineStateCache.RegisterProgram(rcVertexShader, fragment_shader_permutations.Get(material.shaderFeatures), m_PipelineLayout);
+            key.blendMode = material.blendMode;
+            material.pipeline = m_PipelineStateCache.Request(key, material.name + " (" + fragment_shader_permutations.GetFeatureNames(material.shaderFeatures) + ")");
+        }
+        if (m_Options.syncPipelines) m_PipelineStateCache.WaitAll();
+    }
+
+    // Device-local vertex and index buffers, filled through the staging ring by the first frame's upload submission
+    void CreateGeometryBuffers()
+    {
+        const Vertex vertices[] = {
+            { { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+            { { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+            { { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } },
+        };
+        const uint16_t indices[] = { 0, 1, 2 };
+        m_IndexCount = 3;
+
+        const vk::DeviceSize streamSize = vk::DeviceSize(m_Options.streamUploadKilobytes) * 1024;
+        // Nothing is submitted before the first frame, so every initialization upload must fit in the ring at once:
+        // the draws' parameters and culling objects grow with --draws
+        const vk::DeviceSize drawsSize = vk::DeviceSize(m_Options.drawCount) * (sizeof(DrawParameters) + sizeof(CullObject));
+        m_StagingRing.Initialize(m_MemoryAllocator, m_FramePacer, std::max(STAGING_RING_MIN_SIZE, vk::DeviceSize(m_FramesInFlight + 1) * streamSize) + drawsSize);
+
+        vk::BufferCreateInfo createInfo;
+        createInfo.sharingMode = vk::SharingMode::eExclusive;
+        createInfo.size = sizeof(vertices);
+        createInfo.usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst;
+        m_VertexBuffer = m_MemoryAllocator.CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_VertexBufferAllocation);
+        createInfo.size = sizeof(indices);
+        createInfo.usage = vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst;
+        m_IndexBuffer = m_MemoryAllocator.CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_IndexBufferAllocation);
+
+        if (!m_StagingRing.Upload(m_VertexBuffer, 0, vertices, sizeof(vertices)) || !m_StagingRing.Upload(m_IndexBuffer, 0, indices, sizeof(indices)))
+            throw std::runtime_error("The staging ring is too small for the geometry.");
+
+        if (streamSize > 0)
+        {
+            createInfo.size = vk::DeviceSize(m_FramesInFlight) * streamSize;
+            createInfo.usage = vk::BufferUsageFlagBits::eTransferDst;
+            m_StreamBuffer = m_MemoryAllocator.CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_StreamBufferAllocation);
+            m_StreamData.resize(static_cast<size_t>(streamSize));
+            for (size_t i = 0; i < m_StreamData.size(); i++) m_StreamData[i] = static_cast<uint8_t>(i * 31);
+        }
 
-        vk::GraphicsPipelineCreateInfo pipelineCreateInfo;
-        pipelineCreateInfo.stageCount = 2;
-        pipelineCreateInfo.pStages = shaderStageInfos;
-        pipelineCreateInfo.pVertexInputState = &vertexInputInfo;
-        pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-        pipelineCreateInfo.pViewportState = &viewportState;
-        pipelineCreateInfo.pRasterizationState = &rasterizer;
-        pipelineCreateInfo.pMultisampleState = &multisampling;
-        pipelineCreateInfo.pDepthStencilState = nullptr;
-        pipelineCreateInfo.pColorBlendState = &colorBlending;
-        pipelineCreateInfo.pDynamicState = nullptr;
-        pipelineCreateInfo.layout = m_PipelineLayout;
-        pipelineCreateInfo.renderPass = m_RenderPass;
-        pipelineCreateInfo.subpass = 0;
+        // One triangle in the middle, or a grid of them
+        const uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(m_Options.drawCount))));
+        const uint32_t rowCount = (m_Options.drawCount + gridSize - 1) / gridSize;
+        const float cellSize = 2.0f / gridSize;
+        m_Scene.Reserve(1 + rowCount + m_Options.drawCount);
+        const Scene::NodeId root = m_Scene.AddNode(Scene::NO_PARENT, glm::vec3(0.0f));
+        std::vector<Scene::NodeId> rows(rowCount);
+        for (uint32_t i = 0; i < rowCount; i++) rows[i] = m_Scene.AddNode(root, glm::vec3(0.0f, -1.0f + cellSize * (i + 0.5f), 0.0f));
 
-        m_GraphicsPipeline = m_Device.createGraphicsPipeline(nullptr, pipelineCreateInfo);
+        struct Draw
+        {
+            PipelineStateCache::PipelineId pipeline;
+            DrawParameters parameters;
+            Scene::NodeId node;
+        };
+        std::vector<Draw> draws(m_Options.drawCount);
+        m_SpinningNodes.clear();
+        for (uint32_t i = 0; i < m_Options.drawCount; i++)
+        {
+            const Material& material = m_Materials[i % m_Materials.size()];
+            draws[i].pipeline = material.pipeline;
+            draws[i].parameters = {};
+            draws[i].parameters.material = static_cast<uint32_t>(i % m_Materials.size());
+            draws[i].node = m_Scene.AddNode(rows[i / gridSize], glm::vec3(-1.0f + cellSize * ((i % gridSize) + 0.5f), 0.0f, 0.0f),
+                glm::quat(1.0f, 0.0f, 0.0f, 0.0f), cellSize / 2.0f);
+            if (material.blendMode == BlendMode::Additive) m_SpinningNodes.push_back(draws[i].node);
+        }
+        m_Scene.Update();
+        std::cerr << "Scene: " << m_Scene.GetNodeCount() << " node(s), " << m_SpinningNodes.size() << " spinning, updated "
+            << Scene::GetSimdWidth() << " at a time" << std::endl;
+
+        // Grouped by pipeline so that each secondary binds as few pipelines as possible
+        std::stable_sort(draws.begin(), draws.end(), [](const Draw& p_A, const Draw& p_B) { return p_A.pipeline < p_B.pipeline; });
+        m_Draws.clear();
+        m_DrawPipelines.clear();
+        m_DrawNodes.clear();
+        for (Draw& draw : draws)
+        {
+            draw.parameters.instance = m_Scene.GetInstanceIndex(draw.node);
+            m_DrawPipelines.push_back(draw.pipeline);
+            m_Draws.push_back(draw.parameters);
+            m_DrawNodes.push_back(draw.node);
+        }
     }
 
-    void CreateFramebuffers()
+    // Host-visible, a partition per frame in flight, each in the bindless table. The scene's world matrices are
+    // copied from the packet's snapshot to the partition of the frame slot every frame.
+    void CreateInstanceBuffer()
     {
-        for (vk::ImageView& swapChainImageView : m_SwapChainImageViews)
+        const vk::DeviceSize alignment = m_PhysicalDevice.getProperties().limits.minStorageBufferOffsetAlignment;
+        const vk::DeviceSize size = vk::DeviceSize(m_Scene.GetNodeCount()) * Scene::INSTANCE_SIZE;
+        m_InstancePartitionSize = (size + alignment - 1) / alignment * alignment;
+
+        vk::BufferCreateInfo createInfo;
+        createInfo.sharingMode = vk::SharingMode::eExclusive;
+        createInfo.size = m_InstancePartitionSize * m_FramesInFlight;
+        createInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+        m_InstanceBuffer = m_MemoryAllocator.CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+            m_InstanceBufferAllocation);
+        m_InstanceBufferIndices.clear();
+        for (size_t i = 0; i < m_FramesInFlight; i++)
         {
-            vk::ImageView attachments[] = { swapChainImageView };
+            m_InstanceBufferIndices.push_back(m_BindlessTable.AddBuffer(m_InstanceBuffer, i * m_InstancePartitionSize, size));
+            m_Scene.WriteInstances(m_InstanceBufferAllocation.pMapped + i * m_InstancePartitionSize);
+        }
+
+        // The render thread may still read the snapshots of every queued packet and of the one it renders
+        const size_t snapshotCount = m_Options.renderThread ? static_cast<size_t>(std::max(m_Options.renderQueueDepth, 1u)) + 1 : 1;
+        m_InstanceSnapshotSize = static_cast<size_t>(size);
+        m_InstanceSnapshots.resize(snapshotCount * m_InstanceSnapshotSize / sizeof(float));
+    }
+
+    // Spins the glow draws and writes every world matrix to the packet's snapshot. Snapshots are reused in turn, once
+    // the packets that used them have been rendered.
+    void UpdateScene(FramePacket& p_Packet)
+    {
+        const glm::quat rotation = glm::angleAxis(SPIN_SPEED * p_Packet.time, glm::vec3(0.0f, 0.0f, 1.0f));
+        for (Scene::NodeId node : m_SpinningNodes) m_Scene.SetRotation(node, rotation);
+        p_Packet.sceneNodesUpdated = m_Scene.Update();
+
+        const size_t snapshotFloats = m_InstanceSnapshotSize / sizeof(float);
+        float* pSnapshot = m_InstanceSnapshots.data() + (p_Packet.frameIndex % (m_InstanceSnapshots.size() / snapshotFloats)) * snapshotFloats;
+        m_Scene.WriteInstances(pSnapshot);
+        p_Packet.pInstances = pSnapshot;
+    }
 
-            vk::FramebufferCreateInfo createInfo;
-            createInfo.renderPass = m_RenderPass;
-            createInfo.attachmentCount = 1;
-            createInfo.pAttachments = attachments;
-            createInfo.width = m_SwapChainExtent.width;
-            createInfo.height = m_SwapChainExtent.height;
-            createInfo.layers = 1;
+    // One tint per material, read by the fragment shader through the bindless table
+    void CreateMaterialBuffer()
+    {
+        std::vector<float> tints;
+        for (const Material& material : m_Materials) tints.insert(tints.end(), material.tint, material.tint + 4);
+
+        vk::BufferCreateInfo createInfo;
+        createInfo.sharingMode = vk::SharingMode::eExclusive;
+        createInfo.size = tints.size() * sizeof(float);
+        createInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+        m_MaterialBuffer = m_MemoryAllocator.CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_MaterialBufferAllocation);
+        if (!m_StagingRing.Upload(m_MaterialBuffer, 0, tints.data(), createInfo.size)) throw std::runtime_error("The staging ring is too small for the materials.");
+        m_MaterialBufferIndex = m_BindlessTable.AddBuffer(m_MaterialBuffer);
+    }
 
-            m_SwapChainFramebuffers.push_back(m_Device.createFramebuffer(createInfo));
+    // The draws' parameters in a buffer of the bindless table, and a culling object per draw. Consecutive draws with
+    // the same pipeline form a batch. The render graph was compiled before the pipelines, which need its scene pass,
+    // so it is declared again with the culling; the render passes are kept and the pipelines stay compatible.
+    void CreateDrawCuller()
+    {
+        if (m_Options.culling == CullingMode::None) return;
+
+        vk::BufferCreateInfo createInfo;
+        createInfo.sharingMode = vk::SharingMode::eExclusive;
+        createInfo.size = m_Draws.size() * sizeof(DrawParameters);
+        createInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+        m_DrawBuffer = m_MemoryAllocator.CreateBuffer(createInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, m_DrawBufferAllocation);
+        if (!m_StagingRing.Upload(m_DrawBuffer, 0, m_Draws.data(), createInfo.size)) throw std::runtime_error("The staging ring is too small for the draws.");
+        m_DrawBufferIndex = m_BindlessTable.AddBuffer(m_DrawBuffer);
+
+        // The triangle fits in a circle of radius sqrt(0.5) around its origin. The scene only spins draws about their
+        // origin, the spheres don't move.
+        const float boundingRadius = 0.7072f;
+        std::vector<CullObject> objects(m_Draws.size());
+        m_BatchPipelines.clear();
+        for (size_t i = 0; i < m_Draws.size(); i++)
+        {
+            if ((i == 0) || (m_DrawPipelines[i] != m_DrawPipelines[i - 1]))
+            {
+                m_BatchPipelines.push_back(m_DrawPipelines[i]);
+                objects[i].firstCommand = static_cast<uint32_t>(i);
+            }
+            else
+            {
+                objects[i].firstCommand = objects[i - 1].firstCommand;
+            }
+            const glm::vec3 center = m_Scene.GetWorldTranslation(m_DrawNodes[i]);
+            objects[i].boundingSphere[0] = center.x;
+            objects[i].boundingSphere[1] = center.y;
+            objects[i].boundingSphere[2] = center.z;
+            objects[i].boundingSphere[3] = m_Scene.GetWorldScale(m_DrawNodes[i]) * boundingRadius;
+            objects[i].batch = static_cast<uint32_t>(m_BatchPipelines.size() - 1);
+            objects[i].indexCount = m_IndexCount;
+            objects[i].padding = 0;
         }
+
+        m_DrawCuller.Initialize(m_Device, m_MemoryAllocator, m_StagingRing, m_BindlessTable, m_PipelineCache.Get(), rcCullShader, m_Options.culling,
+            m_DrawCullerFeatures, static_cast<uint32_t>(m_FramesInFlight), objects, m_Options.validateCulling);
+        std::cerr << "Draw culling: " << GetCullingModeName(m_DrawCuller.GetMode()) << ", " << objects.size() << " object(s) in "
+            << m_DrawCuller.GetBatchCount() << " indirect draw(s)" << std::endl;
+
+        m_RenderGraph.Reset(0);
+        BuildRenderGraph();
+    }
+
+    // The camera pans in a circle, as far as the zoom allows without leaving the grid, and the culling frustum is
+    // the four sides of the view. Runs on the main thread, the view is part of the frame packet.
+    void UpdateCamera(float p_Time, float* p_pView) const
+    {
+        const float zoom = std::max(m_Options.cameraZoom, 1.0f);
+        const float radius = 1.0f - 1.0f / zoom;
+        p_pView[0] = radius * std::cos(0.25f * p_Time);
+        p_pView[1] = radius * std::sin(0.25f * p_Time);
+        p_pView[2] = zoom;
+        p_pView[3] = 0.0f;
+    }
+
+    CullFrustum GetCameraFrustum() const
+    {
+        const float halfSize = 1.0f / m_CameraView[2];
+        const float centerX = m_CameraView[0];
+        const float centerY = m_CameraView[1];
+        return { {
+            { 1.0f, 0.0f, 0.0f, halfSize - centerX },
+            { -1.0f, 0.0f, 0.0f, halfSize + centerX },
+            { 0.0f, 1.0f, 0.0f, halfSize - centerY },
+            { 0.0f, -1.0f, 0.0f, halfSize + centerY },
+        } };
+    }
+
+    // Sized so the uniforms of every draw fit, unless --uniform-ring says otherwise
+    void CreateUniformRing()
+    {
+        const vk::DeviceSize alignment = m_PhysicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+        const auto alignUp = [alignment](vk::DeviceSize p_Size) { return (p_Size + alignment - 1) / alignment * alignment; };
+        m_DrawUniformStride = alignUp(sizeof(DrawParameters));
+
+        vk::DeviceSize partitionSize = alignUp(sizeof(FrameConstants)) + m_Draws.size() * m_DrawUniformStride;
+        if (m_Options.uniformRingKilobytes > 0) partitionSize = static_cast<vk::DeviceSize>(m_Options.uniformRingKilobytes) * 1024;
+        else partitionSize = std::max(partitionSize, UNIFORM_RING_MIN_SIZE);
+        m_UniformRing.Initialize(m_MemoryAllocator, alignment, static_cast<uint32_t>(m_FramesInFlight), partitionSize);
+    }
+
+    // Writes the frame's uniforms and those of every draw to the frame slot's partition of the ring in one pass, and
+    // points a set allocated from the slot's pools at them. The pools were reset when the slot became free, nothing is
+    // freed here. Draws are bound at m_DrawUniformStride steps from binding 1. Indirect draws read the draw buffer,
+    // binding 1 only gets one unused entry to be valid.
+    vk::DescriptorSet PrepareFrameSet()
+    {
+        FrameConstants constants = {};
+        constants.time = m_FrameTime;
+        constants.materialBuffer = m_MaterialBufferIndex;
+        constants.drawBuffer = m_DrawBufferIndex;
+        constants.instanceBuffer = m_InstanceBufferIndices[currentFrame];
+        memcpy(constants.view, m_CameraView, sizeof(constants.view));
+        vk::DeviceSize constantsOffset = 0;
+        m_UniformRing.Allocate(sizeof(constants), constantsOffset);
+        memcpy(m_UniformRing.GetMappedData(constantsOffset), &constants, sizeof(constants));
+
+        vk::DeviceSize drawsOffset = 0;
+        const uint32_t drawCount = m_DrawCuller.IsEnabled() ? 1 : static_cast<uint32_t>(m_Draws.size());
+        m_FrameDrawCount = m_UniformRing.AllocateArray(drawCount, m_DrawUniformStride, drawsOffset);
+        uint8_t* pDrawData = m_UniformRing.GetMappedData(drawsOffset);
+        for (uint32_t i = 0; i < m_FrameDrawCount; i++) memcpy(pDrawData + i * m_DrawUniformStride, &m_Draws[i], sizeof(DrawParameters));
+
+        const vk::DescriptorSet set = m_FrameDescriptors.Allocate(m_FrameSetLayout);
+        const vk::DescriptorBufferInfo constantsInfo(m_UniformRing.GetBuffer(), constantsOffset, sizeof(FrameConstants));
+        const vk::DescriptorBufferInfo drawInfo(m_UniformRing.GetBuffer(), drawsOffset, sizeof(DrawParameters));
+        m_Device.updateDescriptorSets({
+            vk::WriteDescriptorSet(set, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &constantsInfo),
+            vk::WriteDescriptorSet(set, 1, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &drawInfo),
+        }, {});
+        return set;
+    }
+
+    void CreateTransferObjects()
+    {
+        if (!m_QueueFamilyIndices.HasAsyncTransfer()) return;
+
+        vk::CommandPoolCreateInfo poolInfo;
+        poolInfo.queueFamilyIndex = m_QueueFamilyIndices.transfer.value();
+        poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+        m_TransferCommandPool = m_Device.createCommandPool(poolInfo);
+
+        vk::CommandBufferAllocateInfo allocInfo;
+        allocInfo.commandPool = m_TransferCommandPool;
+        allocInfo.level = vk::CommandBufferLevel::ePrimary;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(m_FramesInFlight);
+        m_TransferCommandBuffers = m_Device.allocateCommandBuffers(allocInfo);
+
+        vk::SemaphoreTypeCreateInfo typeInfo;
+        typeInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+        typeInfo.initialValue = 0;
+        vk::SemaphoreCreateInfo semaphoreInfo;
+        semaphoreInfo.pNext = &typeInfo;
+        m_TransferSemaphore = m_Device.createSemaphore(semaphoreInfo);
+    }
+
+    void SubmitTransfer(uint64_t p_FrameValue)
+    {
+        vk::TimelineSemaphoreSubmitInfo timelineInfo;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &p_FrameValue;
+
+        vk::SubmitInfo submitInfo;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_TransferCommandBuffers[currentFrame];
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &m_TransferSemaphore;
+        m_TransferQueue.submit({ submitInfo }, vk::Fence());
+    }
+
+    // Stages this frame's uploads and records their copies, into p_CommandBuffer or, with a dedicated transfer
+    // family, into this frame's transfer command buffer, and then p_CommandBuffer acquires the destination buffers.
+    // Returns false if there was nothing to upload.
+    bool RecordUploads(vk::CommandBuffer p_CommandBuffer)
+    {
+        // Synthetic streaming workload: the frame slot's whole partition of the stream buffer, in chunks, every frame.
+        // The slot is free, so the last frame that wrote the partition has completed. Chunks that don't fit in the ring
+        // are left for the next frame of the slot, which uploads the whole partition again.
+        const vk::DeviceSize partitionOffset = vk::DeviceSize(currentFrame) * m_StreamData.size();
+        for (vk::DeviceSize offset = 0; offset < m_StreamData.size(); offset += STREAM_UPLOAD_CHUNK_SIZE)
+        {
+            const vk::DeviceSize size = std::min<vk::DeviceSize>(STREAM_UPLOAD_CHUNK_SIZE, m_StreamData.size() - offset);
+            if (!m_StagingRing.Upload(m_StreamBuffer, partitionOffset + offset, m_StreamData.data() + offset, size))
+            {
+                m_FrameStats.Count(FrameCounter::StagingOverflows, static_cast<uint32_t>((m_StreamData.size() - offset + STREAM_UPLOAD_CHUNK_SIZE - 1) / STREAM_UPLOAD_CHUNK_SIZE));
+                break;
+            }
+        }
+
+        if (!m_StagingRing.HasPendingCopies()) return false;
+        if (!m_QueueFamilyIndices.HasAsyncTransfer())
+        {
+            m_StagingRing.RecordCopies(p_CommandBuffer);
+            return true;
+        }
+
+        // The previous use of this command buffer has completed, the frame slot is free
+        const vk::CommandBuffer transferCommandBuffer = m_TransferCommandBuffers[currentFrame];
+        vk::CommandBufferBeginInfo beginInfo;
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+        transferCommandBuffer.begin(beginInfo);
+        m_StagingRing.RecordCopies(transferCommandBuffer, m_QueueFamilyIndices.transfer.value(), m_QueueFamilyIndices.graphics.value());
+        transferCommandBuffer.end();
+
+        m_StagingRing.RecordAcquire(p_CommandBuffer);
+        return true;
+    }
+
+    void CreateTimestampQueryPool()
+    {
+        if (!m_FrameStats.IsEnabled()) return;
+
+        const uint32_t validBits = m_PhysicalDevice.getQueueFamilyProperties()[m_QueueFamilyIndices.graphics.value()].timestampValidBits;
+        if (validBits == 0)
+        {
+            std::cerr << "Graphics queue doesn't support timestamps, GPU frame times won't be measured." << std::endl;
+            return;
+        }
+        m_TimestampMask = (validBits >= 64) ? UINT64_MAX : ((uint64_t(1) << validBits) - 1);
+        m_TimestampPeriod = m_PhysicalDevice.getProperties().limits.timestampPeriod;
+
+        vk::QueryPoolCreateInfo createInfo;
+        createInfo.queryType = vk::QueryType::eTimestamp;
+        createInfo.queryCount = 2 * static_cast<uint32_t>(m_FramesInFlight);
+        m_TimestampQueryPool = m_Device.createQueryPool(createInfo);
+        m_TimestampsWritten.assign(m_FramesInFlight, false);
+    }
+
+    // Reads the timestamps of the previous submission of the frame slot. Must be called once that submission is known to be complete.
+    void ReadGpuTimestamps(uint32_t p_FrameSlot)
+    {
+        if (!m_TimestampQueryPool || !m_TimestampsWritten[p_FrameSlot]) return;
+
+        uint64_t timestamps[2] = {};
+        const vk::Result result = m_Device.getQueryPoolResults(m_TimestampQueryPool, 2 * p_FrameSlot, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+            vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+        if (result != vk::Result::eSuccess) return;
+
+        const uint64_t ticks = (timestamps[1] - timestamps[0]) & m_TimestampMask;
+        m_FrameStats.SetMilliseconds(FramePhase::Gpu, static_cast<float>(ticks * m_TimestampPeriod * 1e-6));
     }
 
     void CreateCommandBuffers()
     {
         vk::CommandPoolCreateInfo poolInfo;
         poolInfo.queueFamilyIndex = m_QueueFamilyIndices.graphics.value();
-        // If our command buffers were going to be created often
-        //poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient; 
+        poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
         m_CommandPool = m_Device.createCommandPool(poolInfo);
 
         vk::CommandBufferAllocateInfo allocInfo;
         allocInfo.commandPool = m_CommandPool;
         allocInfo.level = vk::CommandBufferLevel::ePrimary;
-        allocInfo.commandBufferCount = static_cast<uint32_t>(m_SwapChainFramebuffers.size());
+        allocInfo.commandBufferCount = static_cast<uint32_t>(m_FramesInFlight);
         m_CommandBuffers = m_Device.allocateCommandBuffers(allocInfo);
 
-        assert(m_SwapChainFramebuffers.size() == m_CommandBuffers.size());
-        for (size_t i = 0; i < m_CommandBuffers.size(); i++)
+        const uint32_t threadCount = (m_Options.recordThreadCount > 0) ? m_Options.recordThreadCount : std::max(1u, std::thread::hardware_concurrency());
+        m_JobSystem.Initialize(threadCount);
+
+        // Command pools can only be used from one thread at a time, so every recording thread has its own
+        poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+        m_RecordingPools.resize(m_FramesInFlight);
+        for (std::vector<RecordingPool>& pools : m_RecordingPools)
+        {
+            pools.resize(threadCount);
+            for (RecordingPool& pool : pools) pool.pool = m_Device.createCommandPool(poolInfo);
+        }
+    }
+
+    vk::CommandBuffer AcquireSecondary(RecordingPool& p_Pool)
+    {
+        if (p_Pool.usedCount == p_Pool.buffers.size())
+        {
+            vk::CommandBufferAllocateInfo allocInfo;
+            allocInfo.commandPool = p_Pool.pool;
+            allocInfo.level = vk::CommandBufferLevel::eSecondary;
+            allocInfo.commandBufferCount = 1;
+            p_Pool.buffers.push_back(m_Device.allocateCommandBuffers(allocInfo)[0]);
+        }
+        return p_Pool.buffers[p_Pool.usedCount++];
+    }
+
+    // Records the draws into secondaries, a slice per job, on every thread of p_JobSystem. m_Secondaries ends up in
+    // draw order whichever thread recorded each slice. The previous use of the frame slot's pools must be complete.
+    void RecordSecondaries(JobSystem& p_JobSystem, size_t p_FrameSlot, vk::RenderPass p_RenderPass, vk::Framebuffer p_Framebuffer, vk::DescriptorSet p_FrameSet)
+    {
+        std::vector<RecordingPool>& pools = m_RecordingPools[p_FrameSlot];
+        for (RecordingPool& pool : pools)
         {
-            vk::CommandBuffer& commandBuffer = m_CommandBuffers[i];
+            m_Device.resetCommandPool(pool.pool, vk::CommandPoolResetFlags());
+            pool.usedCount = 0;
+        }
+
+        const vk::Extent2D extent = m_pFrameSink->GetExtent();
+        const vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f);
+        const vk::Rect2D scissor(vk::Offset2D(0, 0), extent);
+
+        const uint32_t drawCount = m_FrameDrawCount;
+        const uint32_t drawsPerSecondary = std::max(MIN_DRAWS_PER_SECONDARY, drawCount / (4 * p_JobSystem.GetThreadCount()) + 1);
+        m_Secondaries.assign((drawCount + drawsPerSecondary - 1) / drawsPerSecondary, vk::CommandBuffer());
+
+        p_JobSystem.ParallelFor(drawCount, drawsPerSecondary, [&](uint32_t p_Begin, uint32_t p_End, uint32_t p_ThreadIndex) {
+            const vk::CommandBuffer commandBuffer = AcquireSecondary(pools[p_ThreadIndex]);
+
+            vk::CommandBufferInheritanceInfo inheritanceInfo;
+            inheritanceInfo.renderPass = p_RenderPass;
+            inheritanceInfo.subpass = 0;
+            inheritanceInfo.framebuffer = p_Framebuffer;
+
             vk::CommandBufferBeginInfo beginInfo;
+            beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
             commandBuffer.begin(beginInfo);
 
-            vk::RenderPassBeginInfo renderPassInfo;
-            renderPassInfo.renderPass = m_RenderPass;
-            renderPassInfo.framebuffer = m_SwapChainFramebuffers[i];
-            renderPassInfo.renderArea.offset = vk::Offset2D{0, 0};
-            renderPassInfo.renderArea.extent = m_SwapChainExtent;
-
-            vk::ClearValue clearColor(std::array<float, 4>{ 0.2f, 0.2f, 0.2f, 1.0f });
-            renderPassInfo.clearValueCount = 1;
-            renderPassInfo.pClearValues = &clearColor;
+            // Dynamic state outlives pipeline binds, every pipeline has the same dynamic state
+            commandBuffer.setViewport(0, { viewport });
+            commandBuffer.setScissor(0, { scissor });
+            commandBuffer.bindVertexBuffers(0, { m_VertexBuffer }, { 0 });
+            commandBuffer.bindIndexBuffer(m_IndexBuffer, 0, vk::IndexType::eUint16);
+            // Secondaries don't inherit bindings. The bindless table is bound once, the frame set is rebound for
+            // every draw with the dynamic offset of the draw's uniforms, which needs no descriptor write.
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, { m_BindlessTable.GetSet() }, {});
+            vk::Pipeline boundPipeline;
+            for (uint32_t i = p_Begin; i < p_End; i++)
+            {
+                const vk::Pipeline pipeline = m_PipelineStateCache.Get(m_DrawPipelines[i]);
+                if (!pipeline) continue; // Still compiling
+                if (pipeline != boundPipeline) commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+                boundPipeline = pipeline;
+
+                const uint32_t dynamicOffset = static_cast<uint32_t>(i * m_DrawUniformStride);
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 1, { p_FrameSet }, { dynamicOffset });
+                commandBuffer.drawIndexed(m_IndexCount, 1, 0, 0, 0);
+            }
 
-            commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
-            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_GraphicsPipeline);
-            commandBuffer.draw(3, 1, 0, 0);
-            commandBuffer.endRenderPass();
             commandBuffer.end();
+            m_Secondaries[p_Begin / drawsPerSecondary] = commandBuffer;
+        });
+    }
+
+    // One indirect draw per batch, the culling wrote the commands. Every draw reads its parameters from the draw
+    // buffer, so the sets are bound once.
+    void RecordIndirectDraws(vk::CommandBuffer p_CommandBuffer, vk::DescriptorSet p_FrameSet)
+    {
+        const vk::Extent2D extent = m_pFrameSink->GetExtent();
+        p_CommandBuffer.setViewport(0, { vk::Viewport(0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f) });
+        p_CommandBuffer.setScissor(0, { vk::Rect2D(vk::Offset2D(0, 0), extent) });
+        p_CommandBuffer.bindVertexBuffers(0, { m_VertexBuffer }, { 0 });
+        p_CommandBuffer.bindIndexBuffer(m_IndexBuffer, 0, vk::IndexType::eUint16);
+        p_CommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, { m_BindlessTable.GetSet(), p_FrameSet }, { 0 });
+        for (uint32_t i = 0; i < m_DrawCuller.GetBatchCount(); i++)
+        {
+            const vk::Pipeline pipeline = m_PipelineStateCache.Get(m_BatchPipelines[i]);
+            if (!pipeline) continue; // Still compiling
+            p_CommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+            m_DrawCuller.RecordDraws(p_CommandBuffer, i);
+        }
+    }
+
+    void RecordFrame(vk::CommandBuffer p_CommandBuffer, uint32_t p_ImageIndex, bool& p_HasUploads)
+    {
+        vk::CommandBufferBeginInfo beginInfo;
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+        p_CommandBuffer.begin(beginInfo);
+
+        // The uploads go first, the draws read them
+        p_HasUploads = RecordUploads(p_CommandBuffer);
+        m_FrameStats.Mark(FramePhase::Upload);
+
+        const uint32_t firstQuery = 2 * static_cast<uint32_t>(currentFrame);
+        if (m_TimestampQueryPool)
+        {
+            p_CommandBuffer.resetQueryPool(m_TimestampQueryPool, firstQuery, 2);
+            p_CommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_TimestampQueryPool, firstQuery);
+        }
+
+        // The scene pass records the draws into secondaries on the job system, or the culled indirect draws
+        m_FrameSet = PrepareFrameSet();
+        m_RenderGraph.Execute(p_CommandBuffer, p_ImageIndex);
+        const bool isCulled = m_DrawCuller.IsEnabled();
+        m_FrameStats.Count(FrameCounter::DescriptorAllocations, m_FrameDescriptors.GetFrameAllocationCount());
+        m_FrameStats.Count(FrameCounter::DescriptorBinds, isCulled ? 1 : static_cast<uint32_t>(m_Secondaries.size()) + m_FrameDrawCount);
+        m_FrameStats.Count(FrameCounter::VisibleDraws, isCulled ? m_DrawCuller.GetVisibleCount() : m_FrameDrawCount);
+        m_FrameStats.Count(FrameCounter::UniformBytes, static_cast<uint32_t>(m_UniformRing.GetFrameBytes()));
+        m_FrameStats.Count(FrameCounter::UniformOverflows, m_UniformRing.TakeFrameOverflowCount());
+        m_FrameStats.Count(FrameCounter::GraphBarriers, m_RenderGraph.GetBarrierCount());
+        m_FrameStats.Count(FrameCounter::TransientKilobytes, static_cast<uint32_t>(m_RenderGraph.GetTransientMemorySize() >> 10));
+
+        if (m_TimestampQueryPool) p_CommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampQueryPool, firstQuery + 1);
+
+        p_CommandBuffer.end();
+        m_FrameStats.Mark(FramePhase::Record);
+    }
+
+    // Records the draws with 1 to GetThreadCount() threads, nothing is submitted
+    void BenchmarkRecording()
+    {
+        constexpr uint32_t ITERATION_COUNT = 20;
+        m_PipelineStateCache.WaitAll();
+        m_PendingPipelineCount = 0;
+
+        std::vector<uint32_t> threadCounts;
+        for (uint32_t threadCount = 1; threadCount < m_JobSystem.GetThreadCount(); threadCount *= 2) threadCounts.push_back(threadCount);
+        threadCounts.push_back(m_JobSystem.GetThreadCount());
+
+        m_FrameDescriptors.BeginFrame(0);
+        m_UniformRing.BeginFrame(0, 0, 0);
+        const vk::DescriptorSet frameSet = PrepareFrameSet();
+        const vk::RenderPass renderPass = m_RenderGraph.GetRenderPass(m_ScenePass);
+        const vk::Framebuffer framebuffer = m_RenderGraph.GetFramebuffer(m_ScenePass, 0);
+
+        std::cout << "threads,draws,secondaries,record_ms,speedup" << std::endl;
+        double singleThreadMilliseconds = 0.0;
+
+        for (uint32_t threadCount : threadCounts)
+        {
+            JobSystem jobSystem;
+            jobSystem.Initialize(threadCount);
+            RecordSecondaries(jobSystem, 0, renderPass, framebuffer, frameSet); // Warm up the pools
+
+            const auto startTime = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < ITERATION_COUNT; i++) RecordSecondaries(jobSystem, 0, renderPass, framebuffer, frameSet);
+            const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() / ITERATION_COUNT;
+
+            if (threadCount == 1) singleThreadMilliseconds = milliseconds;
+            std::cout << threadCount << "," << m_Draws.size() << "," << m_Secondaries.size() << "," << milliseconds << ","
+                << (singleThreadMilliseconds / milliseconds) << std::endl;
         }
     }
 
@@ -508,64 +1296,193 @@ private:
     {
         vk::SemaphoreCreateInfo semaphoreInfo;
 
-        m_ImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        m_ImageAvailableSemaphores.resize(m_FramesInFlight);
         for (vk::Semaphore& semaphore : m_ImageAvailableSemaphores) semaphore = m_Device.createSemaphore(semaphoreInfo);
 
-        m_RenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        m_RenderFinishedSemaphores.resize(m_FramesInFlight);
         for (vk::Semaphore& semaphore : m_RenderFinishedSemaphores) semaphore = m_Device.createSemaphore(semaphoreInfo);
 
-        vk::FenceCreateInfo fenceInfo;
-        fenceInfo.flags = vk::FenceCreateFlagBits::eSignaled;
+        m_FramePacer.Initialize(m_Device, static_cast<uint32_t>(m_FramesInFlight));
+    }
+
+    // Rebuilds the swapchain and framebuffers for p_Extent, the window size the main thread sampled. Submitted
+    // frames keep using the old ones, which are destroyed once the frame timeline shows those frames complete, so
+    // nothing waits here. A minimized window has nothing to present to, the swapchain stays out of date until then.
+    void RecreateSwapChain(vk::Extent2D p_Extent)
+    {
+        m_IsSwapChainOutOfDate = (p_Extent.width == 0) || (p_Extent.height == 0);
+        if (m_IsSwapChainOutOfDate) return;
+
+        const uint64_t retireValue = m_FramePacer.GetFrameValue() - 1;
+        m_pFrameSink->Recreate(p_Extent, retireValue);
+        m_RenderGraph.Reset(retireValue);
+        BuildRenderGraph();
+        m_SwapChainRecreateCount++;
+    }
+
+    void DestroyRetiredRenderTargets(uint64_t p_CompletedValue)
+    {
+        m_pFrameSink->DestroyRetired(p_CompletedValue);
+        m_RenderGraph.DestroyRetired(p_CompletedValue);
+    }
+
+    // Sleeps until the frame's slot in the limiter's schedule, right before input is sampled so the wait shortens
+    // the input latency instead of queuing frames. Returns the time waited, or a negative value without a limit.
+    float WaitForFrameLimit()
+    {
+        if (m_Options.frameRateLimit == 0) return -1.0f;
+
+        using Clock = std::chrono::steady_clock;
+        const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_Options.frameRateLimit));
+        const Clock::time_point startTime = Clock::now();
 
-        m_InFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-        for (vk::Fence& fence : m_InFlightFences) fence = m_Device.createFence(fenceInfo);
+        // A late frame restarts the schedule instead of letting the next ones catch up back to back
+        m_NextFrameTime = std::max(m_NextFrameTime + period, startTime);
+        const Clock::duration spinTime = std::chrono::milliseconds(1); // Sleep granularity, spin for the rest
+        if (m_NextFrameTime - startTime > spinTime) std::this_thread::sleep_until(m_NextFrameTime - spinTime);
+        while (Clock::now() < m_NextFrameTime) std::this_thread::yield();
 
-        m_ImagesInFlight.resize(m_SwapChainImages.size());
+        return std::chrono::duration<float, std::milli>(Clock::now() - startTime).count();
     }
 
-    void DrawFrame()
+    // Submission of the present, not when it reaches the display
+    void LogTimeToFirstFrame()
     {
+        const bool isComplete = (m_PendingPipelineCount == 0);
+        if (m_IsFirstCompleteFramePresented || (m_IsFirstFramePresented && !isComplete)) return;
+
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_StartTime).count();
+        if (!m_IsFirstFramePresented) std::cerr << "Time to first frame: " << milliseconds << " ms" << std::endl;
+        if (isComplete) std::cerr << "Time to first frame with every pipeline: " << milliseconds << " ms" << std::endl;
+        m_IsFirstFramePresented = true;
+        m_IsFirstCompleteFramePresented = isComplete;
+    }
+
+    void DrawFrame(const FramePacket& p_Packet)
+    {
+        if (m_IsSwapChainOutOfDate)
+        {
+            RecreateSwapChain(p_Packet.framebufferExtent);
+            if (m_IsSwapChainOutOfDate) return;
+        }
+
         vk::Semaphore& availableSemaphore = m_ImageAvailableSemaphores[currentFrame];
         vk::Semaphore& renderFinishedSemaphore = m_RenderFinishedSemaphores[currentFrame];
-        vk::Fence& inFlightFence = m_InFlightFences[currentFrame];
-
-        m_Device.waitForFences({ inFlightFence }, VK_TRUE, UINT64_MAX);
 
-        const uint32_t imageIndex = m_Device.acquireNextImageKHR(m_SwapChain, UINT64_MAX, availableSemaphore, vk::Fence()).value;
+        // Command buffers, pools and semaphores are per frame slot, and images are only written by the GPU in
+        // submission order, so waiting for the frame slot is all the CPU needs
+        const uint64_t completedValue = m_FramePacer.BeginFrame();
+        m_FrameStats.Mark(FramePhase::Wait);
 
-        // Check if a previous frame is using this image (i.e. there is its fence to wait on)
-        vk::Fence& imageInFlightFence = m_ImagesInFlight[imageIndex];
-        if (imageInFlightFence) {
-            m_Device.waitForFences({ imageInFlightFence }, VK_TRUE, UINT64_MAX);
+#ifdef SHADER_HOT_RELOAD
+        // Only SPIR-V the watcher has finished compiling is picked up, the pipelines are rebuilt on the compiler
+        for (const ShaderHotReload::CompiledShader& shader : m_ShaderHotReload.TakeCompiled())
+        {
+            m_PendingPipelineCount += m_PipelineStateCache.ReloadShader(shader.name, shader.code, shader.changeTime);
         }
-        // Mark the image as now being in use by this frame
-        imageInFlightFence = inFlightFence;
-
-        vk::SubmitInfo submitInfo;
-        vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &availableSemaphore;
-        submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_CommandBuffers[imageIndex];
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &renderFinishedSemaphore;
-       
-        m_Device.resetFences({ inFlightFence });
+#endif
 
-        m_GraphicsQueue.submit({ submitInfo }, inFlightFence);
+        // Published between frames so the recording threads see stable pipelines. Pipelines replaced by a reload
+        // may still be used by the frames already submitted.
+        if (m_PendingPipelineCount > 0) m_PendingPipelineCount = m_PipelineStateCache.Update(m_FramePacer.GetFrameValue() - 1);
+        std::chrono::steady_clock::time_point reloadChangeTime;
+        const bool hasReloadedPipelines = m_PipelineStateCache.TakeReloadChangeTime(reloadChangeTime);
+
+        // The previous submission of this frame slot has completed, its timestamps are available
+        ReadGpuTimestamps(static_cast<uint32_t>(currentFrame));
+        DestroyRetiredRenderTargets(completedValue);
+        m_PipelineStateCache.DestroyRetired(completedValue);
+        m_FrameDescriptors.BeginFrame(currentFrame);
+        m_UniformRing.BeginFrame(currentFrame, completedValue, m_FramePacer.GetFrameValue() - 1);
+        m_FrameStats.Skip();
+
+        const bool usesSemaphores = m_pFrameSink->UsesSemaphores();
+        uint32_t imageIndex = 0;
+        if (!m_pFrameSink->AcquireNextImage(availableSemaphore, imageIndex))
+        {
+            // Nothing was acquired or submitted, the frame is dropped
+            RecreateSwapChain(p_Packet.framebufferExtent);
+            return;
+        }
+        m_FrameStats.Mark(FramePhase::Acquire);
+
+        // Releases the ring space of every upload the GPU has completed
+        const float uploadLatency = m_StagingRing.Reclaim(completedValue);
+        if (uploadLatency >= 0.0f) m_FrameStats.SetMilliseconds(FramePhase::UploadLatency, uploadLatency);
+
+        // The frame is submitted from here on, the culling of its frame slot may begin
+        // The frame slot's partition of the instance buffer is free too
+        m_FrameTime = p_Packet.time;
+        memcpy(m_InstanceBufferAllocation.pMapped + currentFrame * m_InstancePartitionSize, p_Packet.pInstances, m_InstanceSnapshotSize);
+        m_FrameStats.Count(FrameCounter::SceneNodesUpdated, p_Packet.sceneNodesUpdated);
+        memcpy(m_CameraView, p_Packet.cameraView, sizeof(m_CameraView));
+        if (m_DrawCuller.IsEnabled()) m_DrawCuller.BeginFrame(currentFrame, GetCameraFrustum());
+
+        bool hasUploads = false;
+        RecordFrame(m_CommandBuffers[currentFrame], imageIndex, hasUploads);
+
+        const uint64_t frameValue = m_FramePacer.GetFrameValue();
+        std::vector<vk::Semaphore> waitSemaphores;
+        std::vector<vk::PipelineStageFlags> waitStages;
+        std::vector<uint64_t> waitValues;
+        if (usesSemaphores)
+        {
+            waitSemaphores.push_back(availableSemaphore);
+            waitStages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+            waitValues.push_back(0);
+        }
+        if (hasUploads && m_QueueFamilyIndices.HasAsyncTransfer())
+        {
+            SubmitTransfer(frameValue);
+            waitSemaphores.push_back(m_TransferSemaphore);
+            waitStages.push_back(StagingRing::GetReadStages());
+            waitValues.push_back(frameValue);
+        }
 
-        vk::PresentInfoKHR presentInfo;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &renderFinishedSemaphore;
+        // The timeline value is signaled along with the binary semaphore of the swapchain, if any
+        const vk::Semaphore signalSemaphores[] = { m_FramePacer.GetSemaphore(), renderFinishedSemaphore };
+        const uint64_t signalValues[] = { frameValue, 0 };
 
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = &m_SwapChain;
-        presentInfo.pImageIndices = &imageIndex;
+        vk::TimelineSemaphoreSubmitInfo timelineInfo;
+        timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = usesSemaphores ? 2 : 1;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
 
-        m_PresentQueue.presentKHR(presentInfo);
+        vk::SubmitInfo submitInfo;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_CommandBuffers[currentFrame];
+        submitInfo.signalSemaphoreCount = usesSemaphores ? 2 : 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        m_GraphicsQueue.submit({ submitInfo }, vk::Fence());
+        m_FramePacer.Submitted();
+        if (hasUploads) m_StagingRing.Submitted(frameValue);
+        if (m_TimestampQueryPool) m_TimestampsWritten[currentFrame] = true;
+        m_FrameStats.Mark(FramePhase::Submit);
+
+        const bool isUpToDate = m_pFrameSink->Present(imageIndex, renderFinishedSemaphore);
+        m_FrameStats.Mark(FramePhase::Present);
+
+        // Sampled once the present call returns, so a present that blocks (FIFO with a full queue) is counted
+        const float inputLatency = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_InputTime).count();
+        m_FrameStats.SetMilliseconds(FramePhase::InputLatency, inputLatency);
+        m_InputLatencySum += inputLatency;
+        m_MaxInputLatency = std::max(m_MaxInputLatency, inputLatency);
+        m_PresentCount++;
+        LogTimeToFirstFrame();
+        if (hasReloadedPipelines)
+        {
+            const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reloadChangeTime).count();
+            std::cerr << "Shader reload: " << milliseconds << " ms from save to the first frame presented with the new shader" << std::endl;
+        }
+        if (!isUpToDate || p_Packet.isFramebufferResized) RecreateSwapChain(p_Packet.framebufferExtent);
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        currentFrame = m_FramePacer.GetFrameSlot();
     }
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
@@ -586,36 +1503,219 @@ private:
         return debugCreateInfo;
     }
 
-    void MainLoop()
+    bool ShouldClose(uint64_t p_FrameIndex)
     {
-        while (!glfwWindowShouldClose(m_pWindow))
+        if ((m_Options.frameCount > 0) && (p_FrameIndex >= m_Options.frameCount)) return true;
+        return m_pWindow && glfwWindowShouldClose(m_pWindow);
+    }
+
+    // Yields a few times, then sleeps, so that a thread waiting on the other doesn't hold a core
+    static void Backoff(uint32_t& p_Attempt)
+    {
+        if (p_Attempt++ < IDLE_SPIN_COUNT) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    // Samples input and simulates the frame. Returns false while the window is minimized, after waiting for events.
+    bool SampleFrame(uint64_t p_FrameIndex, float p_LimitMilliseconds, FramePacket& p_Packet)
+    {
+        if (m_pWindow)
         {
             glfwPollEvents();
-            DrawFrame();
+            int width = 0;
+            int height = 0;
+            glfwGetFramebufferSize(m_pWindow, &width, &height);
+            if ((width == 0) || (height == 0))
+            {
+                glfwWaitEvents();
+                return false;
+            }
+            p_Packet.framebufferExtent = vk::Extent2D(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+            p_Packet.isFramebufferResized = m_IsFramebufferResized;
+            m_IsFramebufferResized = false;
+        }
+
+        p_Packet.frameIndex = p_FrameIndex;
+        p_Packet.inputTime = std::chrono::steady_clock::now();
+        p_Packet.time = std::chrono::duration<float>(p_Packet.inputTime - m_StartTime).count();
+        p_Packet.limitMilliseconds = p_LimitMilliseconds;
+        UpdateCamera(p_Packet.time, p_Packet.cameraView);
+        UpdateScene(p_Packet);
+        return true;
+    }
+
+    void RenderFrame(const FramePacket& p_Packet)
+    {
+        m_InputTime = p_Packet.inputTime;
+        m_FrameStats.BeginFrame(p_Packet.frameIndex);
+        if (p_Packet.limitMilliseconds >= 0.0f) m_FrameStats.SetMilliseconds(FramePhase::Limit, p_Packet.limitMilliseconds);
+        DrawFrame(p_Packet);
+        m_FrameStats.EndFrame();
+        m_RenderIntervals.Tick(std::chrono::steady_clock::now());
+    }
+
+    // Renders the packets until the main thread stops it, and then the packets left in the queue
+    void RenderLoop()
+    {
+        try
+        {
+            FramePacket packet;
+            uint32_t attempt = 0;
+            while (true)
+            {
+                // Read first: once stopping, every packet has been pushed, an empty queue is drained
+                const bool isStopping = m_IsRenderThreadStopping.load(std::memory_order_acquire);
+                if (m_FramePackets.TryPop(packet))
+                {
+                    RenderFrame(packet);
+                    attempt = 0;
+                }
+                else if (isStopping) break;
+                else Backoff(attempt);
+            }
+        }
+        catch (...)
+        {
+            m_RenderThreadException = std::current_exception();
+            m_IsRenderThreadFailed = true;
+        }
+    }
+
+    // Waits for room in the queue before input is sampled, so that a packet is never older than the queue is deep.
+    // Events are still handled while the render thread catches up.
+    void WaitForQueueRoom()
+    {
+        if (!m_FramePackets.IsFull()) return;
+
+        const auto startTime = std::chrono::steady_clock::now();
+        uint32_t attempt = 0;
+        while (m_FramePackets.IsFull() && !m_IsRenderThreadFailed)
+        {
+            if (m_pWindow) glfwPollEvents();
+            Backoff(attempt);
+        }
+        m_QueueFullCount++;
+        m_QueueWaitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    // The render thread finishes the packets already queued, nothing is submitted after it returns
+    void StopRenderThread()
+    {
+        if (!m_RenderThread.joinable()) return;
+        m_IsRenderThreadStopping.store(true, std::memory_order_release);
+        m_RenderThread.join();
+    }
+
+    void MainLoop()
+    {
+        const auto startTime = std::chrono::steady_clock::now();
+
+        // Joins the render thread however the main loop exits, an exception thrown here is only rethrown after it
+        struct RenderThreadStopper
+        {
+            VulkanApp& app;
+            ~RenderThreadStopper() { app.StopRenderThread(); }
+        } renderThreadStopper{ *this };
+        if (m_Options.renderThread)
+        {
+            m_FramePackets.Initialize(std::max(m_Options.renderQueueDepth, 1u));
+            m_RenderThread = std::thread([this]() { RenderLoop(); });
+        }
+
+        uint64_t frameIndex = 0;
+        while (!ShouldClose(frameIndex) && !m_IsRenderThreadFailed)
+        {
+            if (m_Options.renderThread) WaitForQueueRoom();
+            const float limitMilliseconds = WaitForFrameLimit();
+            FramePacket packet;
+            if (!SampleFrame(frameIndex, limitMilliseconds, packet)) continue;
+            m_MainLoopIntervals.Tick(packet.inputTime);
+
+            // Only this thread pushes, there is room since WaitForQueueRoom()
+            if (m_Options.renderThread) m_FramePackets.TryPush(packet);
+            else RenderFrame(packet);
+            frameIndex++;
+
+            // Frames rendered so far, a few behind the ones pushed when the render thread renders them
+            m_FrameStats.DumpIfDue();
         }
 
+        StopRenderThread();
+
         // Wait before we start to uninit stuff
         m_Device.waitIdle();
+        if (m_RenderThreadException) std::rethrow_exception(m_RenderThreadException);
+        m_FrameStats.Dump();
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cerr << "Rendered " << frameIndex << " frames in " << seconds << " s (" << (frameIndex / seconds) << " fps)" << std::endl;
+        if (m_PresentCount > 0)
+        {
+            std::cerr << "Input to present: " << (m_InputLatencySum / m_PresentCount) << " ms average, " << m_MaxInputLatency << " ms max";
+            if (m_Options.frameRateLimit > 0) std::cerr << ", limited to " << m_Options.frameRateLimit << " fps";
+            std::cerr << ", " << m_SwapChainRecreateCount << " swapchain recreation(s)" << std::endl;
+        }
+        m_MainLoopIntervals.Log(m_Options.renderThread ? "Main thread" : "Main loop");
+        m_RenderIntervals.Log(m_Options.renderThread ? "Render thread" : "Frames");
+        if (m_Options.renderThread)
+        {
+            std::cerr << "Render queue: " << m_FramePackets.GetCapacity() << " packet(s) deep, the main thread waited for room " << m_QueueFullCount
+                << " time(s), " << m_QueueWaitMilliseconds << " ms in total" << std::endl;
+        }
+        m_PipelineStateCache.LogStats();
+        m_FrameDescriptors.LogStats();
+        m_UniformRing.LogStats(frameIndex);
+        m_DrawCuller.LogStats();
+        m_FramePacer.LogStats();
+        m_StagingRing.LogStats(seconds);
     }
 
     void Uninitialize()
     {
         for (vk::Semaphore& semaphore : m_RenderFinishedSemaphores) m_Device.destroySemaphore(semaphore);
         for (vk::Semaphore& semaphore : m_ImageAvailableSemaphores) m_Device.destroySemaphore(semaphore);
-        for (vk::Fence& fence : m_InFlightFences) m_Device.destroyFence(fence);
+        m_FramePacer.Uninitialize();
 
+        m_JobSystem.Uninitialize();
+        for (std::vector<RecordingPool>& pools : m_RecordingPools)
+        {
+            for (RecordingPool& pool : pools) m_Device.destroyCommandPool(pool.pool);
+        }
         m_Device.destroyCommandPool(m_CommandPool);
-
-        for (auto framebuffer : m_SwapChainFramebuffers) m_Device.destroyFramebuffer(framebuffer);
-
-        m_Device.destroyPipeline(m_GraphicsPipeline);
+        if (m_TransferCommandPool) m_Device.destroyCommandPool(m_TransferCommandPool);
+        if (m_TransferSemaphore) m_Device.destroySemaphore(m_TransferSemaphore);
+        m_StagingRing.Uninitialize();
+        m_MemoryAllocator.DestroyBuffer(m_StreamBuffer, m_StreamBufferAllocation);
+        m_MemoryAllocator.DestroyBuffer(m_MaterialBuffer, m_MaterialBufferAllocation);
+        if (m_DrawCuller.IsEnabled()) m_DrawCuller.Uninitialize();
+        m_MemoryAllocator.DestroyBuffer(m_DrawBuffer, m_DrawBufferAllocation);
+        m_MemoryAllocator.DestroyBuffer(m_InstanceBuffer, m_InstanceBufferAllocation);
+        m_UniformRing.Uninitialize();
+
+        m_MemoryAllocator.DestroyBuffer(m_IndexBuffer, m_IndexBufferAllocation);
+        m_MemoryAllocator.DestroyBuffer(m_VertexBuffer, m_VertexBufferAllocation);
+        if (m_TimestampQueryPool) m_Device.destroyQueryPool(m_TimestampQueryPool);
+
+        DestroyRetiredRenderTargets(UINT64_MAX);
+
+#ifdef SHADER_HOT_RELOAD
+        m_ShaderHotReload.Uninitialize();
+#endif
+        // Finishes the builds still running, their pipelines are destroyed with the others
+        m_PipelineCompiler.Uninitialize();
+        m_PipelineStateCache.Uninitialize();
+        m_PipelineCache.Uninitialize();
         m_Device.destroyPipelineLayout(m_PipelineLayout);
-        m_Device.destroyRenderPass(m_RenderPass);
+        m_FrameDescriptors.Uninitialize();
+        m_Device.destroyDescriptorSetLayout(m_FrameSetLayout);
+        m_BindlessTable.Uninitialize();
+        m_RenderGraph.Uninitialize();
 
-        for (auto& imageView : m_SwapChainImageViews) m_Device.destroyImageView(imageView);
-        m_SwapChainImageViews.clear();
+        m_pFrameSink->Uninitialize(m_Device);
+        m_pFrameSink.reset();
 
-        m_SwapChainImages.clear(); // No need to destroy, we didn't create them
+        m_MemoryAllocator.LogStats();
+        m_MemoryAllocator.Uninitialize();
 
 #ifndef _WIN64
         auto loader = m_DynamicLoader;
@@ -623,21 +1723,100 @@ private:
         auto loader = vk::DispatchLoaderDynamic(m_Instance);
 #endif
 
-        m_Device.destroySwapchainKHR(m_SwapChain);
         m_Device.destroy();
-        m_Instance.destroySurfaceKHR(m_Surface);
+        if (m_Surface) m_Instance.destroySurfaceKHR(m_Surface);
         m_Instance.destroyDebugUtilsMessengerEXT(m_DebugMessenger, nullptr, loader);
         m_Instance.destroy();
 
-        glfwDestroyWindow(m_pWindow);
-
-        glfwTerminate();
+        if (m_pWindow)
+        {
+            glfwDestroyWindow(m_pWindow);
+            glfwTerminate();
+        }
     }
 };
 
-int main()
+int main(int argc, char* argv[])
 {
-    VulkanApp app;
+    AppOptions options;
+    const auto printUsage = [&]() {
+        std::cerr << "Usage: " << argv[0] << " [--headless] [--frames count] [--stats file.json|file.csv] [--stats-interval frames]"
+            " [--pipeline-cache file] [--stream-upload kilobytes per frame] [--frames-in-flight count] [--no-async-queues]"
+            " [--present-mode immediate|mailbox|fifo|fifo-relaxed] [--fps-limit fps] [--sync-pipelines] [--grayscale] [--blur-passes count] [--culling none|cpu|gpu] [--validate-culling] [--camera-zoom factor] [--render-thread] [--render-queue-depth packets] [--draws count] [--uniform-ring kilobytes per frame] [--record-threads count] [--benchmark-recording]"
+            " [--resource-pack file.pak]..." << std::endl;
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        try
+        {
+            if (arg == "--headless") options.headless = true;
+            else if ((arg == "--frames") && (i + 1 < argc)) options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if ((arg == "--stats") && (i + 1 < argc)) options.statsPath = argv[++i];
+            else if ((arg == "--stats-interval") && (i + 1 < argc)) options.statsInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if ((arg == "--pipeline-cache") && (i + 1 < argc)) options.pipelineCachePath = argv[++i];
+            else if ((arg == "--stream-upload") && (i + 1 < argc)) options.streamUploadKilobytes = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if ((arg == "--present-mode") && (i + 1 < argc))
+            {
+                const std::string mode = argv[++i];
+                if (mode == "immediate") options.presentMode = vk::PresentModeKHR::eImmediate;
+                else if (mode == "mailbox") options.presentMode = vk::PresentModeKHR::eMailbox;
+                else if (mode == "fifo") options.presentMode = vk::PresentModeKHR::eFifo;
+                else if (mode == "fifo-relaxed") options.presentMode = vk::PresentModeKHR::eFifoRelaxed;
+                else
+                {
+                    std::cerr << "Unknown present mode \"" << mode << "\"." << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+            else if ((arg == "--fps-limit") && (i + 1 < argc)) options.frameRateLimit = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--sync-pipelines") options.syncPipelines = true;
+            else if (arg == "--grayscale") options.grayscale = true;
+            else if ((arg == "--blur-passes") && (i + 1 < argc)) options.blurPassCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if ((arg == "--culling") && (i + 1 < argc))
+            {
+                const std::string mode = argv[++i];
+                if (mode == "none") options.culling = CullingMode::None;
+                else if (mode == "cpu") options.culling = CullingMode::Cpu;
+                else if (mode == "gpu") options.culling = CullingMode::Gpu;
+                else
+                {
+                    std::cerr << "Unknown culling mode \"" << mode << "\"." << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (arg == "--validate-culling") options.validateCulling = true;
+            else if ((arg == "--camera-zoom") && (i + 1 < argc)) options.cameraZoom = std::stof(argv[++i]);
+            else if (arg == "--render-thread") options.renderThread = true;
+            else if ((arg == "--render-queue-depth") && (i + 1 < argc)) options.renderQueueDepth = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--no-async-queues") options.asyncQueues = false;
+            else if ((arg == "--frames-in-flight") && (i + 1 < argc)) options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if ((arg == "--draws") && (i + 1 < argc)) options.drawCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+            else if ((arg == "--uniform-ring") && (i + 1 < argc)) options.uniformRingKilobytes = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if ((arg == "--record-threads") && (i + 1 < argc)) options.recordThreadCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--benchmark-recording") options.benchmarkRecording = true;
+            else if ((arg == "--resource-pack") && (i + 1 < argc))
+            {
+                // Mounted before any resource is accessed, so its resources replace the embedded ones
+                if (!ResourcePacks::Get().Mount(argv[++i])) return EXIT_FAILURE;
+            }
+            else
+            {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            // std::stoul() and std::stof() throw std::invalid_argument or std::out_of_range, argv[i] is the value
+            std::cerr << "Invalid value \"" << argv[i] << "\" for " << arg << "." << std::endl;
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    VulkanApp app(options);
 
     try
     {